@@ -0,0 +1,114 @@
+#include "batch.h"
+
+#include <stdio.h>
+
+#include "gl_state.h"
+#include "microbench.h"
+
+void batcher_begin(draw_batcher *b) {
+	b->items.clear();
+	b->batchesUsed = 0;
+}
+
+void batcher_add_arrays(draw_batcher *b, unsigned int program, unsigned int VAO, GLenum mode, GLint first, GLsizei count) {
+	draw_item item = { program, VAO, mode, false, first, count, 0 };
+	b->items.push_back(item);
+}
+
+void batcher_add_elements(draw_batcher *b, unsigned int program, unsigned int VAO, GLenum mode,
+	GLsizei count, unsigned int indexOffset, GLint baseVertex) {
+	draw_item item = { program, VAO, mode, true, baseVertex, count, indexOffset };
+	b->items.push_back(item);
+}
+
+void batcher_build(draw_batcher *b) {
+	b->batchesUsed = 0;
+	b->lookup.clear();
+
+	// one pass, items go to the end of their group's batch so the order
+	// inside a group stays the order they were added in
+	for (size_t i = 0; i < b->items.size(); i++) {
+		const draw_item &item = b->items[i];
+		batch_key key = { item.program, item.VAO, item.mode, item.indexed };
+
+		std::map<batch_key, unsigned int>::iterator it = b->lookup.find(key);
+		draw_batch *batch;
+		if (it != b->lookup.end()) {
+			batch = &b->batches[it->second];
+		} else {
+			if (b->batchesUsed == b->batches.size()) {
+				b->batches.push_back(draw_batch());
+			}
+			b->lookup[key] = b->batchesUsed;
+			batch = &b->batches[b->batchesUsed++];
+			batch->program = item.program;
+			batch->VAO = item.VAO;
+			batch->mode = item.mode;
+			batch->indexed = item.indexed;
+			batch->firsts.clear();
+			batch->counts.clear();
+			batch->offsets.clear();
+			batch->baseVertices.clear();
+		}
+
+		batch->counts.push_back(item.count);
+		if (item.indexed) {
+			batch->offsets.push_back((const void *) (item.indexOffset * sizeof(unsigned int)));
+			batch->baseVertices.push_back(item.first);
+		} else {
+			batch->firsts.push_back(item.first);
+		}
+	}
+}
+
+unsigned int batcher_submit(const draw_batcher *b) {
+	for (unsigned int i = 0; i < b->batchesUsed; i++) {
+		const draw_batch &batch = b->batches[i];
+
+		gls_use_program(batch.program);
+		gls_bind_vertex_array(batch.VAO);
+
+		if (batch.indexed) {
+			glMultiDrawElementsBaseVertex(batch.mode, batch.counts.data(), GL_UNSIGNED_INT,
+				batch.offsets.data(), (GLsizei) batch.counts.size(), batch.baseVertices.data());
+		} else {
+			glMultiDrawArrays(batch.mode, batch.firsts.data(), batch.counts.data(), (GLsizei) batch.counts.size());
+		}
+	}
+	return b->batchesUsed;
+}
+
+void batch_bench() {
+	// 10k objects spread over a handful of programs and shared vertex buffers,
+	// like a scene where every mesh of one vertex format lives in one big VBO
+	const int objectCount = 10000;
+	const int programs = 4;
+	const int layouts = 3;
+
+	draw_batcher b;
+	unsigned int seed = 777;
+
+	double start = bench_now_ms();
+	const int frames = 100;
+	for (int frame = 0; frame < frames; frame++) {
+		seed = 777;
+		batcher_begin(&b);
+		for (int i = 0; i < objectCount; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			unsigned int program = 1 + (seed >> 8) % programs;
+			unsigned int VAO = 1 + (seed >> 16) % layouts;
+			if (i % 2) {
+				batcher_add_elements(&b, program, VAO, GL_TRIANGLES, 36, (unsigned int) i * 36, i * 8);
+			} else {
+				batcher_add_arrays(&b, program, VAO, GL_TRIANGLES, i * 3, 3);
+			}
+		}
+		batcher_build(&b);
+	}
+	double buildMs = (bench_now_ms() - start) / frames;
+
+	printf("batch: %d objects, %d programs x %d vertex layouts (arrays + indexed)\n", objectCount, programs, layouts);
+	printf("  draw calls without batching: %d\n", objectCount);
+	printf("  draw calls with batching:    %u (%.0fx fewer)\n", b.batchesUsed, (double) objectCount / b.batchesUsed);
+	printf("  CPU cost to build the batches: %.3f ms per frame\n", buildMs);
+}
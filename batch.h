@@ -0,0 +1,70 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <map>
+#include <vector>
+
+#include "glad/glad.h"
+
+// one object's draw. the VAO stands in for "vertex layout + buffers", so two
+// draws can only be merged if they use the same program and the same VAO,
+// i.e. their geometry lives in the same shared buffer
+struct draw_item {
+	unsigned int program;
+	unsigned int VAO;
+	GLenum mode;
+	bool indexed;
+	GLint first; // first vertex (arrays) or base vertex (elements)
+	GLsizei count;
+	unsigned int indexOffset; // in indices, only for indexed draws
+};
+
+// everything that goes into one glMultiDrawArrays / glMultiDrawElementsBaseVertex
+struct draw_batch {
+	unsigned int program;
+	unsigned int VAO;
+	GLenum mode;
+	bool indexed;
+	std::vector<GLint> firsts;
+	std::vector<GLsizei> counts;
+	std::vector<const void *> offsets;
+	std::vector<GLint> baseVertices;
+};
+
+// what has to match for two draws to end up in the same batch
+struct batch_key {
+	unsigned int program;
+	unsigned int VAO;
+	GLenum mode;
+	bool indexed;
+
+	bool operator<(const batch_key &o) const {
+		if (program != o.program) return program < o.program;
+		if (VAO != o.VAO) return VAO < o.VAO;
+		if (mode != o.mode) return mode < o.mode;
+		return indexed < o.indexed;
+	}
+};
+
+struct draw_batcher {
+	std::vector<draw_item> items;
+	std::map<batch_key, unsigned int> lookup; // key -> index into batches
+	std::vector<draw_batch> batches; // kept around between frames so the arrays don't get reallocated
+	unsigned int batchesUsed;
+};
+
+void batcher_begin(draw_batcher *b);
+void batcher_add_arrays(draw_batcher *b, unsigned int program, unsigned int VAO, GLenum mode, GLint first, GLsizei count);
+void batcher_add_elements(draw_batcher *b, unsigned int program, unsigned int VAO, GLenum mode,
+	GLsizei count, unsigned int indexOffset, GLint baseVertex);
+
+// group the items by program / VAO / mode. order inside a group is kept, order
+// between groups is not, so only use it for stuff that doesn't care (opaque)
+void batcher_build(draw_batcher *b);
+
+// one glUseProgram + glBindVertexArray + multi draw per group, returns the number of draw calls
+unsigned int batcher_submit(const draw_batcher *b);
+
+void batch_bench();
+
+#endif
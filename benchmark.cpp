@@ -0,0 +1,496 @@
+#include "benchmark.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "glad/glad.h"
+#include "glfw/include/GLFW/glfw3.h"
+
+#include "frame_pacing.h"
+#include "gl_state.h"
+#include "instancing.h"
+#include "lod.h"
+#include "mesh.h"
+#include "microbench.h"
+#include "shader.h"
+
+// TIME_ELAPSED queries in flight. the pacer never lets the CPU get more than
+// FRAME_PACER_MAX_IN_FLIGHT frames ahead, so a slot is always done by the time
+// it comes around again and reading it back doesn't stall
+#define BENCH_GPU_QUERIES (FRAME_PACER_MAX_IN_FLIGHT + 2)
+
+// the instanced shader from main.cpp without the simulation offset
+static const char *benchVertexSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec4 aTransform;\n" // xy offset, z scale, w rotation
+	"layout (location = 2) in vec4 aColor;\n"
+	"out vec4 vColor;\n"
+	"void main() {\n"
+	"	float c = cos(aTransform.w);\n"
+	"	float s = sin(aTransform.w);\n"
+	"	vec2 p = mat2(c, s, -s, c) * (aPos.xy * aTransform.z) + aTransform.xy;\n"
+	"	gl_Position = vec4(p.x, p.y, aPos.z, 1.0f);\n"
+	"	vColor = aColor;\n"
+	"}\n";
+
+static const char *benchFragmentSource = "#version 330 core\n"
+	"in vec4 vColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"	FragColor = vColor;\n"
+	"}\n";
+
+// the shapes from old_stuff/, same coordinates
+static const float triangleVertices[] = {
+	-0.5f, -0.5f, 0.0f,
+	0.0f, -0.5f, 0.0f,
+	-0.25f, 0.0f, 0.0f,
+};
+
+static const float rectVertices[] = {
+	-0.5f, -0.5f, 0.0f, // bot left
+	-0.5f, 0.5f, 0.0f, // top left
+	0.5f, 0.5f, 0.0f, // top right
+	0.5f, -0.5f, 0.0f, // bot right
+};
+static const unsigned int rectIndices[] = {
+	0, 1, 2,
+	0, 2, 3,
+};
+
+static const float triforceVertices[] = {
+	-0.5f, -0.5f, 0.0f,
+	0.0f, -0.5f, 0.0f,
+	-0.25f, 0.0f, 0.0f,
+
+	0.0f, -0.5f, 0.0f,
+	0.5f, -0.5f, 0.0f,
+	0.25f, 0.0f, 0.0f,
+
+	-0.25f, 0.0f, 0.0f,
+	0.25f, 0.0f, 0.0f,
+	0.0f, 0.5f, 0.0f,
+};
+
+struct bench_shape_info {
+	const char *name;
+	const float *vertices;
+	unsigned int vertexCount;
+	const unsigned int *indices; // NULL draws arrays
+	unsigned int indexCount;
+	unsigned int triangles; // per object, 0 when it depends on the LOD picked
+	float minX, minY, size; // bounds, for instance_make_grid
+};
+
+static const bench_shape_info shapes[] = {
+	{ "triangle", triangleVertices, 3, NULL, 0, 1, -0.5f, -0.5f, 0.5f },
+	{ "rect", rectVertices, 4, rectIndices, 6, 2, -0.5f, -0.5f, 1.0f },
+	{ "triforce", triforceVertices, 9, NULL, 0, 3, -0.5f, -0.5f, 1.0f },
+	{ "sphere", NULL, 0, NULL, 0, 0, -0.5f, -0.5f, 1.0f }, // made in bench_scene_create, drawn through a LOD chain
+};
+
+// the sphere's tessellation and how far off its LODs can be on screen
+#define BENCH_SPHERE_RINGS 48
+#define BENCH_SPHERE_SEGMENTS 96
+#define BENCH_LOD_PIXELS 1.0f
+
+bool parse_benchmark_shape(const char *name, benchmark_shape *shape) {
+	for (int i = 0; i < (int) (sizeof(shapes) / sizeof(shapes[0])); i++) {
+		if (strcmp(name, shapes[i].name) == 0) {
+			*shape = (benchmark_shape) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parse_object_counts(const char *list, std::vector<unsigned int> *counts) {
+	counts->clear();
+	const char *p = list;
+	while (*p) {
+		char *end = NULL;
+		unsigned long count = strtoul(p, &end, 10);
+		if (end == p || count == 0 || (*end != ',' && *end != '\0')) {
+			return false;
+		}
+		counts->push_back((unsigned int) count);
+		p = *end == ',' ? end + 1 : end;
+	}
+	return !counts->empty();
+}
+
+struct bench_series {
+	double mean, p50, p95, p99, max;
+};
+
+// nearest rank
+static double percentile(const std::vector<double> &sorted, double p) {
+	size_t rank = (size_t) (p / 100.0 * sorted.size() + 0.999999);
+	rank = rank < 1 ? 1 : rank > sorted.size() ? sorted.size() : rank;
+	return sorted[rank - 1];
+}
+
+static bench_series summarize(std::vector<double> samples) {
+	bench_series s = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	if (samples.empty()) {
+		return s;
+	}
+	std::sort(samples.begin(), samples.end());
+	for (size_t i = 0; i < samples.size(); i++) {
+		s.mean += samples[i];
+	}
+	s.mean /= samples.size();
+	s.p50 = percentile(samples, 50.0);
+	s.p95 = percentile(samples, 95.0);
+	s.p99 = percentile(samples, 99.0);
+	s.max = samples.back();
+	return s;
+}
+
+struct bench_result {
+	unsigned int objects;
+	unsigned int drawCalls; // per frame
+	unsigned long long trianglesPerFrame;
+	unsigned long long bytesPerFrame; // uploaded
+	unsigned int gpuSamples;
+	bench_series cpu, frame, gpu;
+	double trianglesPerSecond;
+};
+
+struct bench_scene {
+	unsigned int VAO, VBO, EBO;
+	instance_buffer instances;
+	std::vector<instance_data> base; // where the grid puts everything
+	std::vector<instance_data> frame; // base plus this frame's animation
+
+	// sphere only. every level shares the VBO and lives in the one EBO, objects
+	// get sorted by level each frame and each level is one instanced draw
+	lod_chain lod;
+	std::vector<instance_data> sorted;
+	std::vector<unsigned int> levelCounts;
+
+	unsigned int drawCalls; // in the last frame
+	unsigned long long triangles;
+};
+
+static void bench_scene_create(bench_scene *scene, const bench_shape_info &shape, unsigned int objects) {
+	glGenVertexArrays(1, &scene->VAO);
+	glGenBuffers(1, &scene->VBO);
+	scene->EBO = 0;
+
+	mesh sphere;
+	if (!shape.vertices) {
+		sphere = mesh_make_sphere(BENCH_SPHERE_RINGS, BENCH_SPHERE_SEGMENTS, 0.5f);
+		scene->lod = lod_build_chain(sphere, 8, 64);
+	}
+
+	gls_bind_vertex_array(scene->VAO);
+	gls_bind_buffer(GL_ARRAY_BUFFER, scene->VBO);
+	if (shape.vertices) {
+		glBufferData(GL_ARRAY_BUFFER, shape.vertexCount * 3 * sizeof(float), shape.vertices, GL_STATIC_DRAW);
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, sphere.positions.size() * sizeof(float), sphere.positions.data(), GL_STATIC_DRAW);
+	}
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+	glEnableVertexAttribArray(0);
+	if (shape.indices) {
+		glGenBuffers(1, &scene->EBO);
+		gls_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, scene->EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shape.indexCount * sizeof(unsigned int), shape.indices, GL_STATIC_DRAW);
+	} else if (!shape.vertices) {
+		glGenBuffers(1, &scene->EBO);
+		gls_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, scene->EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene->lod.indices.size() * sizeof(unsigned int), scene->lod.indices.data(), GL_STATIC_DRAW);
+	}
+	gls_bind_vertex_array(0);
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	scene->instances = instance_buffer_create(scene->VAO, 1);
+	instance_make_grid(scene->base, objects, shape.minX, shape.minY, shape.size);
+	scene->frame = scene->base;
+	scene->drawCalls = 0;
+	scene->triangles = 0;
+}
+
+static void bench_scene_destroy(bench_scene *scene) {
+	instance_buffer_destroy(&scene->instances);
+	gls_delete_vertex_arrays(1, &scene->VAO);
+	gls_delete_buffers(1, &scene->VBO);
+	if (scene->EBO) {
+		gls_delete_buffers(1, &scene->EBO);
+	}
+}
+
+// the instance attributes start at object first. with 3.3 there's no base
+// instance, so every batch after the first re-points them instead
+static void point_instances(const bench_scene &scene, unsigned int first) {
+	size_t base = first * sizeof(instance_data);
+	gls_bind_buffer(GL_ARRAY_BUFFER, scene.instances.VBO);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (void *) (base + offsetof(instance_data, transform)));
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (void *) (base + offsetof(instance_data, color)));
+}
+
+// objects [first, first + count) of the uploaded stream, batch per draw call.
+// level is the LOD to draw the sphere at, -1 for the fixed shapes
+static void draw_objects(bench_scene *scene, const bench_shape_info &shape, int level,
+	unsigned int first, unsigned int count, unsigned int batch) {
+	unsigned int perDraw = batch == 0 ? count : batch;
+	for (unsigned int done = 0; done < count; done += perDraw) {
+		GLsizei n = (GLsizei) (count - done < perDraw ? count - done : perDraw);
+		if (first + done != 0) {
+			point_instances(*scene, first + done);
+		}
+		if (level >= 0) {
+			lod_draw_instanced(scene->lod, level, n);
+			scene->triangles += (unsigned long long) n * (scene->lod.levels[level].indexCount / 3);
+		} else if (shape.indices) {
+			glDrawElementsInstanced(GL_TRIANGLES, shape.indexCount, GL_UNSIGNED_INT, (void *) 0, n);
+			scene->triangles += (unsigned long long) n * shape.triangles;
+		} else {
+			glDrawArraysInstanced(GL_TRIANGLES, 0, shape.vertexCount, n);
+			scene->triangles += (unsigned long long) n * shape.triangles;
+		}
+		scene->drawCalls++;
+	}
+}
+
+// every object picks its own level from how big it is on screen, then they
+// get bucketed by level (counting sort, the order inside a level is kept)
+static void sort_by_lod(bench_scene *scene, int viewportHeight) {
+	unsigned int objects = (unsigned int) scene->frame.size();
+	unsigned int levels = (unsigned int) scene->lod.levels.size();
+	std::vector<unsigned char> picked(objects);
+	scene->levelCounts.assign(levels, 0);
+	for (unsigned int i = 0; i < objects; i++) {
+		// the grid's scale is in NDC, which spans 2 units of the viewport
+		float pixelsPerUnit = scene->frame[i].transform[2] * viewportHeight * 0.5f;
+		picked[i] = (unsigned char) lod_select_scale(scene->lod, pixelsPerUnit, BENCH_LOD_PIXELS);
+		scene->levelCounts[picked[i]]++;
+	}
+
+	std::vector<unsigned int> next(levels, 0);
+	for (unsigned int l = 1; l < levels; l++) {
+		next[l] = next[l - 1] + scene->levelCounts[l - 1];
+	}
+	scene->sorted.resize(objects);
+	for (unsigned int i = 0; i < objects; i++) {
+		scene->sorted[next[picked[i]]++] = scene->frame[i];
+	}
+}
+
+// animation goes by frame number, not time, so every run draws the same frames
+static void bench_scene_draw(bench_scene *scene, const bench_shape_info &shape, unsigned int program,
+	unsigned int frameNumber, unsigned int batch, int viewportHeight) {
+	unsigned int objects = (unsigned int) scene->base.size();
+	float spin = frameNumber * 0.02f;
+	for (unsigned int i = 0; i < objects; i++) {
+		scene->frame[i].transform[3] = scene->base[i].transform[3] + spin;
+	}
+
+	bool lod = !scene->lod.levels.empty();
+	if (lod) {
+		sort_by_lod(scene, viewportHeight);
+		instance_buffer_upload(&scene->instances, scene->sorted.data(), objects);
+	} else {
+		instance_buffer_upload(&scene->instances, scene->frame.data(), objects);
+	}
+
+	gls_use_program(program);
+	gls_bind_vertex_array(scene->VAO);
+	scene->drawCalls = 0;
+	scene->triangles = 0;
+	if (lod) {
+		unsigned int first = 0;
+		for (size_t l = 0; l < scene->levelCounts.size(); l++) {
+			draw_objects(scene, shape, (int) l, first, scene->levelCounts[l], batch);
+			first += scene->levelCounts[l];
+		}
+	} else {
+		draw_objects(scene, shape, -1, 0, objects, batch);
+	}
+	if (scene->drawCalls > 1) {
+		point_instances(*scene, 0);
+	}
+}
+
+static bool run_one(GLFWwindow *window, const benchmark_options &options, unsigned int program,
+	unsigned int objects, bench_result *result) {
+	const bench_shape_info &shape = shapes[options.shape];
+	bench_scene scene;
+	bench_scene_create(&scene, shape, objects);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	frame_pacer pacer;
+	frame_pacer_init(&pacer, VSYNC_OFF, 0.0, options.framesInFlight);
+
+	GLuint queries[BENCH_GPU_QUERIES];
+	int queryFrame[BENCH_GPU_QUERIES]; // measured frame index, -1 for warmup / unused
+	glGenQueries(BENCH_GPU_QUERIES, queries);
+	for (int i = 0; i < BENCH_GPU_QUERIES; i++) {
+		queryFrame[i] = -1;
+	}
+
+	std::vector<double> cpuMs, frameMs, gpuMs;
+	unsigned int total = options.warmupFrames + options.frames;
+	double lastFrameStart = 0.0;
+	unsigned int f = 0;
+	for (; f < total && !glfwWindowShouldClose(window); f++) {
+		double frameStart = bench_now_ms();
+		bool measured = f >= options.warmupFrames;
+		if (measured && f > options.warmupFrames) {
+			frameMs.push_back(frameStart - lastFrameStart);
+		}
+		lastFrameStart = frameStart;
+
+		frame_pacer_begin_frame(&pacer);
+		double workStart = bench_now_ms();
+		glfwPollEvents();
+
+		unsigned int slot = f % BENCH_GPU_QUERIES;
+		if (queryFrame[slot] >= 0) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+			gpuMs.push_back(ns / 1000000.0);
+			queryFrame[slot] = -1;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+
+		gls_clear_color(0.2f, 0.8f, 0.2f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		bench_scene_draw(&scene, shape, program, f, options.batch, viewport[3]);
+
+		glEndQuery(GL_TIME_ELAPSED);
+		queryFrame[slot] = measured ? (int) f : -1;
+
+		if (options.present) {
+			glfwSwapBuffers(window);
+		} else {
+			glFlush();
+		}
+		frame_pacer_end_frame(&pacer);
+		gl_state_end_frame();
+
+		if (measured) {
+			cpuMs.push_back(bench_now_ms() - workStart);
+		}
+	}
+	if (f == total) {
+		frameMs.push_back(bench_now_ms() - lastFrameStart);
+	}
+
+	// the last few frames are still out, wait for them
+	glFinish();
+	for (unsigned int i = 0; i < BENCH_GPU_QUERIES; i++) {
+		unsigned int slot = (f + i) % BENCH_GPU_QUERIES;
+		if (queryFrame[slot] >= 0) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+			gpuMs.push_back(ns / 1000000.0);
+		}
+	}
+	glDeleteQueries(BENCH_GPU_QUERIES, queries);
+	frame_pacer_destroy(&pacer);
+
+	// every frame of a run draws the same grid, so the last one speaks for all of them
+	result->objects = objects;
+	result->drawCalls = scene.drawCalls;
+	result->trianglesPerFrame = scene.triangles;
+	bench_scene_destroy(&scene);
+	result->bytesPerFrame = (unsigned long long) objects * sizeof(instance_data);
+	result->gpuSamples = (unsigned int) gpuMs.size();
+	result->cpu = summarize(cpuMs);
+	result->frame = summarize(frameMs);
+	result->gpu = summarize(gpuMs);
+	result->trianglesPerSecond = result->frame.mean > 0.0 ? result->trianglesPerFrame * 1000.0 / result->frame.mean : 0.0;
+	return f == total;
+}
+
+static void write_series(FILE *file, const char *name, const bench_series &s, bool last) {
+	fprintf(file, "\t\t\t\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+		name, s.mean, s.p50, s.p95, s.p99, s.max, last ? "" : ",");
+}
+
+static bool write_json(const benchmark_options &options, const std::vector<bench_result> &results) {
+	FILE *file = fopen(options.outPath, "w");
+	if (!file) {
+		printf("couldn't open %s for the benchmark results\n", options.outPath);
+		return false;
+	}
+
+	const char *renderer = (const char *) glGetString(GL_RENDERER);
+	const char *version = (const char *) glGetString(GL_VERSION);
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"scene\": \"%s\",\n", shapes[options.shape].name);
+	// driver strings, anything can be in there
+	fprintf(file, "\t\"renderer\": ");
+	json_write_string(file, renderer ? renderer : "");
+	fprintf(file, ",\n\t\"glVersion\": ");
+	json_write_string(file, version ? version : "");
+	fprintf(file, ",\n");
+	fprintf(file, "\t\"frames\": %u,\n", options.frames);
+	fprintf(file, "\t\"warmupFrames\": %u,\n", options.warmupFrames);
+	fprintf(file, "\t\"batch\": %u,\n", options.batch);
+	fprintf(file, "\t\"framesInFlight\": %u,\n", options.framesInFlight);
+	fprintf(file, "\t\"headless\": %s,\n", options.present ? "false" : "true");
+	fprintf(file, "\t\"runs\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const bench_result &r = results[i];
+		fprintf(file, "\t\t{\n");
+		fprintf(file, "\t\t\t\"objects\": %u,\n", r.objects);
+		fprintf(file, "\t\t\t\"drawCalls\": %u,\n", r.drawCalls);
+		fprintf(file, "\t\t\t\"trianglesPerFrame\": %llu,\n", r.trianglesPerFrame);
+		fprintf(file, "\t\t\t\"trianglesPerSecond\": %.0f,\n", r.trianglesPerSecond);
+		fprintf(file, "\t\t\t\"bytesUploadedPerFrame\": %llu,\n", r.bytesPerFrame);
+		fprintf(file, "\t\t\t\"gpuSamples\": %u,\n", r.gpuSamples);
+		write_series(file, "cpuMs", r.cpu, false);
+		write_series(file, "frameMs", r.frame, false);
+		write_series(file, "gpuMs", r.gpu, true);
+		fprintf(file, "\t\t}%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+int benchmark_run(GLFWwindow *window, const benchmark_options &options) {
+	unsigned int program = shader_program(benchVertexSource, benchFragmentSource, "BENCH");
+	if (!program) {
+		return 1;
+	}
+
+	printf("bench %s: %u warmup + %u measured frames per run, %s per draw call, %s\n",
+		shapes[options.shape].name, options.warmupFrames, options.frames,
+		options.batch == 0 ? "all objects" : "batches of objects", (const char *) glGetString(GL_RENDERER));
+	printf("  %9s %6s  %-31s  %-31s  %-31s %10s %9s\n", "objects", "draws",
+		"cpu ms mean/p50/p95/p99", "frame ms mean/p50/p95/p99", "gpu ms mean/p50/p95/p99", "Mtris/s", "MB/frame");
+
+	std::vector<bench_result> results;
+	for (size_t i = 0; i < options.objectCounts.size(); i++) {
+		bench_result r;
+		bool complete = run_one(window, options, program, options.objectCounts[i], &r);
+		printf("  %9u %6u  %7.3f %7.3f %7.3f %7.3f  %7.3f %7.3f %7.3f %7.3f  %7.3f %7.3f %7.3f %7.3f %10.2f %9.3f\n",
+			r.objects, r.drawCalls,
+			r.cpu.mean, r.cpu.p50, r.cpu.p95, r.cpu.p99,
+			r.frame.mean, r.frame.p50, r.frame.p95, r.frame.p99,
+			r.gpu.mean, r.gpu.p50, r.gpu.p95, r.gpu.p99,
+			r.trianglesPerSecond / 1000000.0, r.bytesPerFrame / (1024.0 * 1024.0));
+		results.push_back(r);
+		if (!complete) {
+			printf("  window closed, stopping early\n");
+			break;
+		}
+	}
+
+	glDeleteProgram(program);
+	if (!write_json(options, results)) {
+		return 1;
+	}
+	printf("wrote %s\n", options.outPath);
+	return 0;
+}
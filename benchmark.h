@@ -0,0 +1,45 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <vector>
+
+// test --bench <scene>: a grid of copies of one of the old shapes (triangle,
+// rect, triforce) or of a sphere, run once per object count so the numbers
+// show how things scale. every frame animates and re-uploads the whole
+// instance stream and draws it, batch objects per draw call. the sphere goes
+// through a LOD chain: every object picks the coarsest level that stays within
+// a pixel and each level gets its own instanced glDrawElements, so the smaller
+// the grid cells the fewer triangles. after the warmup frames it records
+// CPU / frame / GPU time per frame and reports mean, p50, p95 and p99 next to
+// draw calls, triangles per second and bytes uploaded, on stdout and as JSON
+
+struct GLFWwindow;
+
+enum benchmark_shape {
+	BENCH_TRIANGLE,
+	BENCH_RECT,
+	BENCH_TRIFORCE,
+	BENCH_SPHERE,
+};
+
+struct benchmark_options {
+	benchmark_shape shape;
+	std::vector<unsigned int> objectCounts; // one run each
+	unsigned int frames; // measured, per run
+	unsigned int warmupFrames;
+	unsigned int batch; // objects per draw call, 0 puts them all in one
+	unsigned int framesInFlight;
+	const char *outPath; // JSON results
+	bool present; // swap buffers at the end of a frame, off when headless
+};
+
+bool parse_benchmark_shape(const char *name, benchmark_shape *shape);
+
+// "1000,10000,100000"
+bool parse_object_counts(const char *list, std::vector<unsigned int> *counts);
+
+// needs a current context with the target framebuffer and viewport set up.
+// returns what main should return
+int benchmark_run(GLFWwindow *window, const benchmark_options &options);
+
+#endif
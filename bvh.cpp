@@ -0,0 +1,711 @@
+#include "bvh.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "job_system.h"
+#include "microbench.h"
+
+// subtrees bigger than this get built as their own job
+#define BVH_TASK_MIN 8192
+
+// bounds and binning over more primitives than this go through parallel_for
+#define BVH_PARALLEL_MIN 65536
+
+// past this depth nodes are split at the median, which keeps the depth (and
+// the traversal stacks) bounded whatever the SAH decides
+#define BVH_MEDIAN_DEPTH 64
+
+// a refit tree more than this much worse than when it was built should be rebuilt
+static const float rebuildRatio = 1.5f;
+
+// what the builder shuffles around. keeping the box next to the index means
+// binning and partitioning walk memory in order instead of hopping through indices
+struct bvh_ref {
+	float bmin[3];
+	float bmax[3];
+	unsigned int index;
+};
+
+// boxes of the primitives and of their centroids
+struct range_bounds {
+	float bmin[3], bmax[3];
+	float cmin[3], cmax[3];
+};
+
+struct bvh_bin {
+	range_bounds bounds;
+	unsigned int count;
+};
+
+// bins for all three axes at once
+struct bin_set {
+	bvh_bin bins[3][BVH_BINS];
+};
+
+struct bvh_builder {
+	bvh *tree;
+	std::vector<bvh_ref> refs;
+	std::atomic<unsigned int> nodeCount;
+	job_counter counter;
+};
+
+struct bvh_task {
+	bvh_builder *builder;
+	unsigned int node;
+	unsigned int first;
+	unsigned int count;
+	unsigned int depth;
+	range_bounds bounds;
+};
+
+static void box_empty(float bmin[3], float bmax[3]) {
+	for (int k = 0; k < 3; k++) {
+		bmin[k] = FLT_MAX;
+		bmax[k] = -FLT_MAX;
+	}
+}
+
+static void box_grow(float bmin[3], float bmax[3], const float *omin, const float *omax) {
+	for (int k = 0; k < 3; k++) {
+		bmin[k] = omin[k] < bmin[k] ? omin[k] : bmin[k];
+		bmax[k] = omax[k] > bmax[k] ? omax[k] : bmax[k];
+	}
+}
+
+// half the surface area, the factor of 2 cancels out everywhere it's used
+static float box_area(const float bmin[3], const float bmax[3]) {
+	float dx = bmax[0] - bmin[0], dy = bmax[1] - bmin[1], dz = bmax[2] - bmin[2];
+	if (dx < 0.0f || dy < 0.0f || dz < 0.0f) {
+		return 0.0f;
+	}
+	return dx * dy + dy * dz + dz * dx;
+}
+
+static void range_empty(range_bounds *rb) {
+	box_empty(rb->bmin, rb->bmax);
+	box_empty(rb->cmin, rb->cmax);
+}
+
+static void range_grow(range_bounds *rb, const range_bounds &other) {
+	box_grow(rb->bmin, rb->bmax, other.bmin, other.bmax);
+	box_grow(rb->cmin, rb->cmax, other.cmin, other.cmax);
+}
+
+static void range_add(range_bounds *rb, const bvh_ref &ref, const float c[3]) {
+	box_grow(rb->bmin, rb->bmax, ref.bmin, ref.bmax);
+	box_grow(rb->cmin, rb->cmax, c, c);
+}
+
+static void centroid(const bvh_ref &ref, float c[3]) {
+	for (int k = 0; k < 3; k++) {
+		c[k] = (ref.bmin[k] + ref.bmax[k]) * 0.5f;
+	}
+}
+
+static void bounds_of(const bvh_ref *refs, unsigned int begin, unsigned int end, range_bounds *out) {
+	range_empty(out);
+	for (unsigned int i = begin; i < end; i++) {
+		float c[3];
+		centroid(refs[i], c);
+		range_add(out, refs[i], c);
+	}
+}
+
+struct bin_job {
+	const bvh_ref *refs;
+	unsigned int first;
+	unsigned int grain;
+	float cmin[3];
+	float scale[3];
+	bin_set *partial;
+};
+
+static int bin_index(float c, float cmin, float scale) {
+	int i = (int) ((c - cmin) * scale);
+	return i < 0 ? 0 : i >= BVH_BINS ? BVH_BINS - 1 : i;
+}
+
+static void bin_range(const bin_job *job, unsigned int begin, unsigned int end, bin_set *out) {
+	for (int a = 0; a < 3; a++) {
+		for (int i = 0; i < BVH_BINS; i++) {
+			range_empty(&out->bins[a][i].bounds);
+			out->bins[a][i].count = 0;
+		}
+	}
+
+	for (unsigned int i = begin; i < end; i++) {
+		const bvh_ref &ref = job->refs[i];
+		float c[3];
+		centroid(ref, c);
+		for (int a = 0; a < 3; a++) {
+			bvh_bin &bin = out->bins[a][bin_index(c[a], job->cmin[a], job->scale[a])];
+			range_add(&bin.bounds, ref, c);
+			bin.count++;
+		}
+	}
+}
+
+static void bin_chunk(unsigned int begin, unsigned int end, void *user) {
+	bin_job *job = (bin_job *) user;
+	bin_range(job, job->first + begin, job->first + end, &job->partial[begin / job->grain]);
+}
+
+static void bin_all(bin_job *job, unsigned int count, bin_set *bins) {
+	if (count < BVH_PARALLEL_MIN) {
+		bin_range(job, job->first, job->first + count, bins);
+		return;
+	}
+
+	job->grain = count / (job_system_thread_count() * 4) + 1;
+	std::vector<bin_set> partial((count + job->grain - 1) / job->grain);
+	job->partial = partial.data();
+	parallel_for(count, job->grain, bin_chunk, job);
+
+	*bins = partial[0];
+	for (size_t p = 1; p < partial.size(); p++) {
+		for (int a = 0; a < 3; a++) {
+			for (int i = 0; i < BVH_BINS; i++) {
+				range_grow(&bins->bins[a][i].bounds, partial[p].bins[a][i].bounds);
+				bins->bins[a][i].count += partial[p].bins[a][i].count;
+			}
+		}
+	}
+}
+
+static void make_leaf(bvh_builder *b, bvh_node *node, unsigned int first, unsigned int count) {
+	node->leftOrFirst = first;
+	node->count = count;
+	for (unsigned int i = 0; i < count; i++) {
+		b->tree->indices[first + i] = b->refs[first + i].index;
+	}
+}
+
+// true for primitives whose centroid lands left of the split bin
+struct split_left {
+	int axis;
+	float cmin;
+	float scale;
+	int split;
+
+	bool operator()(const bvh_ref &ref) const {
+		return bin_index((ref.bmin[axis] + ref.bmax[axis]) * 0.5f, cmin, scale) < split;
+	}
+};
+
+static void build_node(bvh_builder *b, unsigned int nodeIndex, unsigned int first, unsigned int count,
+	unsigned int depth, const range_bounds &rb);
+
+static void build_task(void *data) {
+	bvh_task *task = (bvh_task *) data;
+	build_node(task->builder, task->node, task->first, task->count, task->depth, task->bounds);
+	delete task;
+}
+
+// rb is the bounds of refs[first, first + count), worked out by whoever split
+// the parent so it doesn't take another pass over the primitives
+static void build_node(bvh_builder *b, unsigned int nodeIndex, unsigned int first, unsigned int count,
+	unsigned int depth, const range_bounds &rb) {
+
+	bvh_node *node = &b->tree->nodes[nodeIndex];
+	memcpy(node->bmin, rb.bmin, sizeof(node->bmin));
+	memcpy(node->bmax, rb.bmax, sizeof(node->bmax));
+
+	if (count <= BVH_MAX_LEAF) {
+		make_leaf(b, node, first, count);
+		return;
+	}
+
+	// bin the centroids along every axis and find the cheapest split
+	bin_job job;
+	job.refs = b->refs.data();
+	job.first = first;
+	bool degenerate = true;
+	for (int a = 0; a < 3; a++) {
+		float extent = rb.cmax[a] - rb.cmin[a];
+		job.cmin[a] = rb.cmin[a];
+		job.scale[a] = extent > 0.0f ? BVH_BINS / extent : 0.0f;
+		degenerate = degenerate && extent <= 0.0f;
+	}
+
+	int bestAxis = -1, bestSplit = 0;
+	float bestCost = FLT_MAX;
+	bin_set bins;
+	if (!degenerate && depth < BVH_MEDIAN_DEPTH) {
+		bin_all(&job, count, &bins);
+
+		// sweep from the right to get the area/count of everything past each split,
+		// then from the left. cost = area(L) * n(L) + area(R) * n(R)
+		for (int a = 0; a < 3; a++) {
+			if (job.scale[a] == 0.0f) {
+				continue;
+			}
+			float rightArea[BVH_BINS];
+			unsigned int rightCount[BVH_BINS];
+			float rmin[3], rmax[3];
+			box_empty(rmin, rmax);
+			unsigned int n = 0;
+			for (int i = BVH_BINS - 1; i > 0; i--) {
+				box_grow(rmin, rmax, bins.bins[a][i].bounds.bmin, bins.bins[a][i].bounds.bmax);
+				n += bins.bins[a][i].count;
+				rightArea[i] = box_area(rmin, rmax);
+				rightCount[i] = n;
+			}
+
+			float lmin[3], lmax[3];
+			box_empty(lmin, lmax);
+			n = 0;
+			for (int i = 0; i < BVH_BINS - 1; i++) {
+				box_grow(lmin, lmax, bins.bins[a][i].bounds.bmin, bins.bins[a][i].bounds.bmax);
+				n += bins.bins[a][i].count;
+				if (n == 0 || rightCount[i + 1] == 0) {
+					continue;
+				}
+				float cost = box_area(lmin, lmax) * n + rightArea[i + 1] * rightCount[i + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = i + 1;
+				}
+			}
+		}
+	}
+
+	// split cost relative to the parent, traversal counts as 1 and each primitive test as 1
+	float parentArea = box_area(node->bmin, node->bmax);
+	float splitCost = parentArea > 0.0f ? 1.0f + bestCost / parentArea : FLT_MAX;
+	if (bestAxis >= 0 && splitCost >= (float) count && count <= BVH_MAX_LEAF * 4) {
+		make_leaf(b, node, first, count);
+		return;
+	}
+
+	bvh_ref *begin = &b->refs[first];
+	bvh_ref *end = begin + count;
+	bvh_ref *mid = begin;
+	range_bounds leftBounds, rightBounds;
+	if (bestAxis >= 0) {
+		split_left pred = { bestAxis, job.cmin[bestAxis], job.scale[bestAxis], bestSplit };
+		mid = std::partition(begin, end, pred);
+
+		// the bins already know both sides' bounds
+		range_empty(&leftBounds);
+		range_empty(&rightBounds);
+		for (int i = 0; i < BVH_BINS; i++) {
+			range_grow(i < bestSplit ? &leftBounds : &rightBounds, bins.bins[bestAxis][i].bounds);
+		}
+	} else {
+		// all the centroids in one spot, or the tree got too deep: split down the middle
+		mid = begin + count / 2;
+		bounds_of(b->refs.data(), first, first + count / 2, &leftBounds);
+		bounds_of(b->refs.data(), first + count / 2, first + count, &rightBounds);
+	}
+
+	unsigned int leftCount = (unsigned int) (mid - begin);
+	unsigned int left = b->nodeCount.fetch_add(2);
+	node->leftOrFirst = left;
+	node->count = 0;
+
+	if (count >= BVH_TASK_MIN) {
+		bvh_task *task = new bvh_task;
+		task->builder = b;
+		task->node = left;
+		task->first = first;
+		task->count = leftCount;
+		task->depth = depth + 1;
+		task->bounds = leftBounds;
+		job_run(build_task, task, &b->counter);
+	} else {
+		build_node(b, left, first, leftCount, depth + 1, leftBounds);
+	}
+	build_node(b, left + 1, first + leftCount, count - leftCount, depth + 1, rightBounds);
+}
+
+struct root_job {
+	const bvh_ref *refs;
+	unsigned int grain;
+	range_bounds *partial;
+};
+
+static void root_bounds_chunk(unsigned int begin, unsigned int end, void *user) {
+	root_job *job = (root_job *) user;
+	bounds_of(job->refs, begin, end, &job->partial[begin / job->grain]);
+}
+
+void bvh_build(bvh *tree, const float *bounds, unsigned int count) {
+	tree->bounds.assign(bounds, bounds + count * 6);
+	tree->indices.resize(count);
+
+	// a binary tree with at most one primitive per leaf can't need more
+	tree->nodes.resize(count > 0 ? count * 2 - 1 : 1);
+
+	bvh_builder b;
+	b.tree = tree;
+	b.refs.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		memcpy(&b.refs[i], &bounds[i * 6], 6 * sizeof(float));
+		b.refs[i].index = i;
+	}
+	b.nodeCount.store(1);
+
+	if (count == 0) {
+		box_empty(tree->nodes[0].bmin, tree->nodes[0].bmax);
+		make_leaf(&b, &tree->nodes[0], 0, 0);
+	} else {
+		// the only full pass over the bounds, every split after this gets its
+		// children's bounds from the bins
+		root_job job;
+		job.refs = b.refs.data();
+		job.grain = count / (job_system_thread_count() * 4) + 1;
+		std::vector<range_bounds> partial((count + job.grain - 1) / job.grain);
+		job.partial = partial.data();
+		parallel_for(count, job.grain, root_bounds_chunk, &job);
+
+		range_bounds rb = partial[0];
+		for (size_t i = 1; i < partial.size(); i++) {
+			range_grow(&rb, partial[i]);
+		}
+		build_node(&b, 0, 0, count, 0, rb);
+	}
+	job_wait(&b.counter);
+
+	tree->nodeCount = b.nodeCount.load();
+	tree->builtCost = bvh_sah_cost(*tree);
+}
+
+void bvh_update(bvh *tree, unsigned int primitive, const float bounds[6]) {
+	memcpy(&tree->bounds[primitive * 6], bounds, 6 * sizeof(float));
+}
+
+void bvh_refit(bvh *tree) {
+	if (tree->indices.empty()) {
+		return; // just an empty root leaf, nothing to grow
+	}
+
+	// children are always allocated after their parent, so walking backwards
+	// sees both children of a node before the node itself
+	for (unsigned int i = tree->nodeCount; i-- > 0;) {
+		bvh_node &node = tree->nodes[i];
+		box_empty(node.bmin, node.bmax);
+		if (node.count > 0) {
+			for (unsigned int k = 0; k < node.count; k++) {
+				const float *pb = &tree->bounds[tree->indices[node.leftOrFirst + k] * 6];
+				box_grow(node.bmin, node.bmax, pb, pb + 3);
+			}
+		} else {
+			const bvh_node &l = tree->nodes[node.leftOrFirst];
+			const bvh_node &r = tree->nodes[node.leftOrFirst + 1];
+			box_grow(node.bmin, node.bmax, l.bmin, l.bmax);
+			box_grow(node.bmin, node.bmax, r.bmin, r.bmax);
+		}
+	}
+}
+
+float bvh_sah_cost(const bvh &tree) {
+	if (tree.indices.empty()) {
+		return 0.0f;
+	}
+	float rootArea = box_area(tree.nodes[0].bmin, tree.nodes[0].bmax);
+	if (rootArea <= 0.0f) {
+		return 0.0f;
+	}
+
+	double cost = 0.0;
+	for (unsigned int i = 0; i < tree.nodeCount; i++) {
+		const bvh_node &node = tree.nodes[i];
+		float area = box_area(node.bmin, node.bmax);
+		cost += node.count > 0 ? area * node.count : area;
+	}
+	return (float) (cost / rootArea);
+}
+
+bool bvh_needs_rebuild(const bvh &tree) {
+	if (tree.indices.empty()) {
+		return false;
+	}
+	return bvh_sah_cost(tree) > tree.builtCost * rebuildRatio;
+}
+
+// BVH_MEDIAN_DEPTH plus the median splits below it for 2^32 primitives,
+// and a traversal never has more than depth + 1 nodes on its stack
+#define BVH_STACK (BVH_MEDIAN_DEPTH + 34)
+
+static void collect_all(const bvh &tree, unsigned int nodeIndex, std::vector<unsigned int> &out) {
+	unsigned int stack[BVH_STACK];
+	int top = 0;
+	stack[top++] = nodeIndex;
+	while (top > 0) {
+		const bvh_node &node = tree.nodes[stack[--top]];
+		if (node.count > 0) {
+			out.insert(out.end(), &tree.indices[node.leftOrFirst], &tree.indices[node.leftOrFirst] + node.count);
+		} else {
+			stack[top++] = node.leftOrFirst + 1;
+			stack[top++] = node.leftOrFirst;
+		}
+	}
+}
+
+// 0 outside, 1 intersecting, 2 inside. mask says which planes still need testing
+static int box_vs_frustum(const frustum &f, const float bmin[3], const float bmax[3], unsigned int *mask) {
+	float c[3], e[3];
+	for (int k = 0; k < 3; k++) {
+		c[k] = (bmin[k] + bmax[k]) * 0.5f;
+		e[k] = (bmax[k] - bmin[k]) * 0.5f;
+	}
+
+	for (int p = 0; p < 6; p++) {
+		if (!(*mask & (1u << p))) {
+			continue;
+		}
+		const float *pl = f.planes[p];
+		float d = pl[0] * c[0] + pl[1] * c[1] + pl[2] * c[2] + pl[3];
+		float r = fabsf(pl[0]) * e[0] + fabsf(pl[1]) * e[1] + fabsf(pl[2]) * e[2];
+		if (d + r < 0.0f) {
+			return 0;
+		}
+		if (d - r >= 0.0f) {
+			*mask &= ~(1u << p); // everything below is inside this plane too
+		}
+	}
+	return *mask == 0 ? 2 : 1;
+}
+
+void bvh_query_frustum(const bvh &tree, const frustum &f, std::vector<unsigned int> &out) {
+	out.clear();
+	if (tree.indices.empty()) {
+		return;
+	}
+
+	unsigned int stack[BVH_STACK];
+	unsigned int masks[BVH_STACK];
+	int top = 0;
+	stack[top] = 0;
+	masks[top++] = 0x3f;
+
+	while (top > 0) {
+		top--;
+		const bvh_node &node = tree.nodes[stack[top]];
+		unsigned int mask = masks[top];
+		int result = box_vs_frustum(f, node.bmin, node.bmax, &mask);
+		if (result == 0) {
+			continue;
+		}
+		if (result == 2) {
+			collect_all(tree, stack[top], out);
+			continue;
+		}
+
+		if (node.count > 0) {
+			for (unsigned int k = 0; k < node.count; k++) {
+				unsigned int p = tree.indices[node.leftOrFirst + k];
+				unsigned int primMask = mask;
+				if (box_vs_frustum(f, &tree.bounds[p * 6], &tree.bounds[p * 6 + 3], &primMask) != 0) {
+					out.push_back(p);
+				}
+			}
+		} else {
+			stack[top] = node.leftOrFirst + 1;
+			masks[top++] = mask;
+			stack[top] = node.leftOrFirst;
+			masks[top++] = mask;
+		}
+	}
+}
+
+static bool boxes_overlap(const float *amin, const float *amax, const float *bmin, const float *bmax) {
+	return amin[0] <= bmax[0] && amax[0] >= bmin[0]
+		&& amin[1] <= bmax[1] && amax[1] >= bmin[1]
+		&& amin[2] <= bmax[2] && amax[2] >= bmin[2];
+}
+
+void bvh_query_box(const bvh &tree, const float boxMin[3], const float boxMax[3], std::vector<unsigned int> &out) {
+	out.clear();
+	if (tree.indices.empty()) {
+		return;
+	}
+
+	unsigned int stack[BVH_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const bvh_node &node = tree.nodes[stack[--top]];
+		if (!boxes_overlap(node.bmin, node.bmax, boxMin, boxMax)) {
+			continue;
+		}
+		if (node.count > 0) {
+			for (unsigned int k = 0; k < node.count; k++) {
+				unsigned int p = tree.indices[node.leftOrFirst + k];
+				if (boxes_overlap(&tree.bounds[p * 6], &tree.bounds[p * 6 + 3], boxMin, boxMax)) {
+					out.push_back(p);
+				}
+			}
+		} else {
+			stack[top++] = node.leftOrFirst + 1;
+			stack[top++] = node.leftOrFirst;
+		}
+	}
+}
+
+// slab test, returns the entry distance or FLT_MAX for a miss
+static float ray_box(const float origin[3], const float invDir[3], const float bmin[3], const float bmax[3], float maxT) {
+	float tmin = 0.0f, tmax = maxT;
+	for (int k = 0; k < 3; k++) {
+		float t0 = (bmin[k] - origin[k]) * invDir[k];
+		float t1 = (bmax[k] - origin[k]) * invDir[k];
+		if (t0 > t1) {
+			float t = t0; t0 = t1; t1 = t;
+		}
+		tmin = t0 > tmin ? t0 : tmin;
+		tmax = t1 < tmax ? t1 : tmax;
+		if (tmin > tmax) {
+			return FLT_MAX;
+		}
+	}
+	return tmin;
+}
+
+bool bvh_pick(const bvh &tree, const float origin[3], const float dir[3], unsigned int *primitive, float *distance) {
+	if (tree.indices.empty()) {
+		return false;
+	}
+
+	// 1/0 gives inf, which the slab test handles fine for axis parallel rays
+	float invDir[3] = { 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+	float best = FLT_MAX;
+	bool hit = false;
+
+	unsigned int stack[BVH_STACK];
+	int top = 0;
+	if (ray_box(origin, invDir, tree.nodes[0].bmin, tree.nodes[0].bmax, best) == FLT_MAX) {
+		return false;
+	}
+	stack[top++] = 0;
+
+	while (top > 0) {
+		const bvh_node &node = tree.nodes[stack[--top]];
+		if (node.count > 0) {
+			for (unsigned int k = 0; k < node.count; k++) {
+				unsigned int p = tree.indices[node.leftOrFirst + k];
+				float t = ray_box(origin, invDir, &tree.bounds[p * 6], &tree.bounds[p * 6 + 3], best);
+				if (t < best) {
+					best = t;
+					*primitive = p;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// push the farther child first so the nearer one is searched first and
+		// shrinks best before the other gets looked at
+		unsigned int l = node.leftOrFirst, r = l + 1;
+		float tl = ray_box(origin, invDir, tree.nodes[l].bmin, tree.nodes[l].bmax, best);
+		float tr = ray_box(origin, invDir, tree.nodes[r].bmin, tree.nodes[r].bmax, best);
+		if (tl > tr) {
+			unsigned int n = l; l = r; r = n;
+			float t = tl; tl = tr; tr = t;
+		}
+		if (tr != FLT_MAX) {
+			stack[top++] = r;
+		}
+		if (tl != FLT_MAX) {
+			stack[top++] = l;
+		}
+	}
+
+	if (hit) {
+		*distance = best;
+	}
+	return hit;
+}
+
+void bvh_bench() {
+	const unsigned int sizes[] = { 100000, 1000000, 10000000 };
+
+	printf("bvh: binned SAH build on %u thread(s)\n", job_system_thread_count());
+	for (int s = 0; s < 3; s++) {
+		unsigned int count = sizes[s];
+
+		// small boxes in a cube that grows with the count so the density stays put
+		float world = 100.0f * cbrtf(count / 100000.0f);
+		unsigned int seed = 99;
+		std::vector<float> bounds(count * 6);
+		for (unsigned int i = 0; i < count; i++) {
+			for (int k = 0; k < 3; k++) {
+				float c = (bench_random_float(&seed) - 0.5f) * world;
+				float e = 0.05f + bench_random_float(&seed) * 0.45f;
+				bounds[i * 6 + k] = c - e;
+				bounds[i * 6 + 3 + k] = c + e;
+			}
+		}
+
+		bvh tree;
+		double start = bench_now_ms();
+		bvh_build(&tree, bounds.data(), count);
+		double buildMs = bench_now_ms() - start;
+
+		// a camera in the middle looking down -z
+		float eye[3] = { 0.0f, 0.0f, 0.0f };
+		float viewProj[16];
+		frustum_view_projection(eye, 60.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, 0.1f, world * 0.25f, viewProj);
+		frustum f = frustum_from_matrix(viewProj);
+		std::vector<unsigned int> visible;
+		start = bench_now_ms();
+		bvh_query_frustum(tree, f, visible);
+		double frustumMs = bench_now_ms() - start;
+
+		const int queries = 10000;
+		unsigned int hits = 0;
+		size_t found = 0;
+		std::vector<unsigned int> inBox;
+		start = bench_now_ms();
+		for (int q = 0; q < queries; q++) {
+			float origin[3], dir[3];
+			for (int k = 0; k < 3; k++) {
+				origin[k] = (bench_random_float(&seed) - 0.5f) * world;
+				dir[k] = bench_random_float(&seed) - 0.5f;
+			}
+			unsigned int prim;
+			float t;
+			hits += bvh_pick(tree, origin, dir, &prim, &t) ? 1 : 0;
+		}
+		double pickMs = bench_now_ms() - start;
+
+		start = bench_now_ms();
+		for (int q = 0; q < queries; q++) {
+			float bmin[3], bmax[3];
+			for (int k = 0; k < 3; k++) {
+				bmin[k] = (bench_random_float(&seed) - 0.5f) * world;
+				bmax[k] = bmin[k] + 2.0f;
+			}
+			bvh_query_box(tree, bmin, bmax, inBox);
+			found += inBox.size();
+		}
+		double boxMs = bench_now_ms() - start;
+
+		// everything drifts a bit each "frame", refit until the heuristic asks for a rebuild
+		int frames = 0;
+		double refitMs = 0.0;
+		while (!bvh_needs_rebuild(tree) && frames < 100) {
+			for (unsigned int i = 0; i < count; i++) {
+				float move[3] = { (bench_random_float(&seed) - 0.5f) * 2.0f, 0.0f, (bench_random_float(&seed) - 0.5f) * 2.0f };
+				float *b = &tree.bounds[i * 6];
+				float moved[6] = { b[0] + move[0], b[1], b[2] + move[2], b[3] + move[0], b[4], b[5] + move[2] };
+				bvh_update(&tree, i, moved);
+			}
+			start = bench_now_ms();
+			bvh_refit(&tree);
+			refitMs += bench_now_ms() - start;
+			frames++;
+		}
+
+		printf("  %u boxes: build %.1f ms (%u nodes, SAH %.1f), refit %.2f ms, rebuild wanted after %d frames of drift\n",
+			count, buildMs, tree.nodeCount, tree.builtCost, frames > 0 ? refitMs / frames : 0.0, frames);
+		printf("    frustum %.3f ms (%zu visible), %.0f picks/s (%u hit), %.0f box queries/s (%.1f found avg)\n",
+			frustumMs, visible.size(), queries / (pickMs / 1000.0), hits, queries / (boxMs / 1000.0), (double) found / queries);
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+
+#include "frustum.h"
+
+// bounding volume hierarchy over axis aligned boxes, built with binned SAH
+// (surface area heuristic) on the job system. moving objects are handled by
+// refitting the boxes in place, which keeps the tree valid but lets its
+// quality slide, so bvh_needs_rebuild says when a fresh build is worth it
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF 4
+
+// interior nodes keep their children next to each other at leftOrFirst,
+// leaves have count > 0 and point at count entries of bvh::indices
+struct bvh_node {
+	float bmin[3];
+	unsigned int leftOrFirst;
+	float bmax[3];
+	unsigned int count;
+};
+
+struct bvh {
+	std::vector<bvh_node> nodes;
+	unsigned int nodeCount;
+	std::vector<unsigned int> indices;
+	std::vector<float> bounds; // min xyz, max xyz per primitive
+	float builtCost; // SAH cost right after the last build
+};
+
+// bounds is 6 floats per primitive, copied into the tree
+void bvh_build(bvh *tree, const float *bounds, unsigned int count);
+
+// change one primitive's box, takes effect at the next refit
+void bvh_update(bvh *tree, unsigned int primitive, const float bounds[6]);
+
+// recompute every node's box bottom up without changing the topology
+void bvh_refit(bvh *tree);
+
+float bvh_sah_cost(const bvh &tree);
+bool bvh_needs_rebuild(const bvh &tree);
+
+// primitives whose boxes aren't completely outside the frustum
+void bvh_query_frustum(const bvh &tree, const frustum &f, std::vector<unsigned int> &out);
+
+// primitives whose boxes overlap [boxMin, boxMax]
+void bvh_query_box(const bvh &tree, const float boxMin[3], const float boxMax[3], std::vector<unsigned int> &out);
+
+// nearest primitive box hit by the ray, false if nothing is
+bool bvh_pick(const bvh &tree, const float origin[3], const float dir[3], unsigned int *primitive, float *distance);
+
+void bvh_bench();
+
+#endif
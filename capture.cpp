@@ -0,0 +1,567 @@
+#include "capture.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu_profiler.h"
+#include "gl_state.h"
+#include "microbench.h"
+
+bool parse_capture_format(const char *name, capture_format *format) {
+	if (strcmp(name, "png") == 0) {
+		*format = CAPTURE_PNG;
+	} else if (strcmp(name, "raw") == 0) {
+		*format = CAPTURE_RAW;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// PNG, written by hand since there's no zlib in the tree. the deflate stream is
+// one block with the fixed Huffman codes, and the only matches it looks for
+// are the previous pixel and the pixel above. that's nowhere near zlib on
+// photos, but what this draws is flat color, where it gets most of the way
+// for a fraction of the time
+
+static uint32_t crcTable[256];
+
+// the fixed literal/length codes, already bit reversed
+static uint16_t symbolCode[288];
+static uint8_t symbolLength[288];
+static std::once_flag tablesOnce;
+
+static uint32_t reverse_bits(uint32_t code, int length) {
+	uint32_t reversed = 0;
+	for (int i = 0; i < length; i++) {
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	return reversed;
+}
+
+static void make_tables() {
+	for (unsigned int symbol = 0; symbol < 288; symbol++) {
+		uint32_t code;
+		int length;
+		if (symbol < 144) {
+			code = 0x30 + symbol;
+			length = 8;
+		} else if (symbol < 256) {
+			code = 0x190 + symbol - 144;
+			length = 9;
+		} else if (symbol < 280) {
+			code = symbol - 256;
+			length = 7;
+		} else {
+			code = 0xc0 + symbol - 280;
+			length = 8;
+		}
+		symbolCode[symbol] = (uint16_t) reverse_bits(code, length);
+		symbolLength[symbol] = (uint8_t) length;
+	}
+
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) {
+			c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		}
+		crcTable[n] = c;
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char *data, size_t size) {
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++) {
+		crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static uint32_t adler32(const unsigned char *data, size_t size) {
+	uint32_t a = 1, b = 0;
+	while (size > 0) {
+		// 5552 is the most bytes before b can overflow 32 bits
+		size_t n = size < 5552 ? size : 5552;
+		for (size_t i = 0; i < n; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return (b << 16) | a;
+}
+
+struct bit_writer {
+	std::vector<unsigned char> *out;
+	uint32_t bits;
+	int count;
+};
+
+// deflate packs from the least significant bit up
+static void put_bits(bit_writer *w, uint32_t value, int count) {
+	w->bits |= value << w->count;
+	w->count += count;
+	while (w->count >= 8) {
+		w->out->push_back((unsigned char) w->bits);
+		w->bits >>= 8;
+		w->count -= 8;
+	}
+}
+
+// ... except Huffman codes, which go most significant bit first (hence the reversed tables)
+static void put_symbol(bit_writer *w, unsigned int symbol) {
+	put_bits(w, symbolCode[symbol], symbolLength[symbol]);
+}
+
+static const uint16_t lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t distanceBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t distanceExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+static void put_match(bit_writer *w, unsigned int length, unsigned int distance) {
+	int l = 28;
+	while (lengthBase[l] > length) {
+		l--;
+	}
+	put_symbol(w, 257 + l);
+	put_bits(w, length - lengthBase[l], lengthExtra[l]);
+
+	int d = 29;
+	while (distanceBase[d] > distance) {
+		d--;
+	}
+	put_bits(w, reverse_bits(d, 5), 5);
+	put_bits(w, distance - distanceBase[d], distanceExtra[d]);
+}
+
+static unsigned int match_length(const unsigned char *data, size_t at, size_t size, size_t distance) {
+	if (distance > at) {
+		return 0;
+	}
+	size_t limit = size - at < 258 ? size - at : 258;
+	size_t n = 0;
+	while (n < limit && data[at + n] == data[at + n - distance]) {
+		n++;
+	}
+	return (unsigned int) n;
+}
+
+static void zlib_compress(const unsigned char *data, size_t size, size_t rowBytes, std::vector<unsigned char> *out) {
+	out->reserve(out->size() + size / 4);
+	out->push_back(0x78); // deflate, 32K window
+	out->push_back(0x01); // no dictionary, check bits
+
+	bit_writer w = { out, 0, 0 };
+	put_bits(&w, 1, 1); // last block
+	put_bits(&w, 1, 2); // fixed Huffman codes
+
+	// previous pixel, and the same pixel a row up (rows carry a filter byte)
+	size_t left = 4, up = rowBytes + 1;
+	if (up > 32768) {
+		up = 0;
+	}
+	size_t i = 0;
+	while (i < size) {
+		unsigned int leftLength = match_length(data, i, size, left);
+		unsigned int upLength = up ? match_length(data, i, size, up) : 0;
+		unsigned int length = leftLength > upLength ? leftLength : upLength;
+		if (length >= 3) {
+			put_match(&w, length, (unsigned int) (leftLength >= upLength ? left : up));
+			i += length;
+		} else {
+			put_symbol(&w, data[i]);
+			i++;
+		}
+	}
+	put_symbol(&w, 256);
+	if (w.count > 0) {
+		put_bits(&w, 0, 8 - w.count);
+	}
+
+	uint32_t check = adler32(data, size);
+	out->push_back((unsigned char) (check >> 24));
+	out->push_back((unsigned char) (check >> 16));
+	out->push_back((unsigned char) (check >> 8));
+	out->push_back((unsigned char) check);
+}
+
+static void put_u32(std::vector<unsigned char> *out, uint32_t v) {
+	out->push_back((unsigned char) (v >> 24));
+	out->push_back((unsigned char) (v >> 16));
+	out->push_back((unsigned char) (v >> 8));
+	out->push_back((unsigned char) v);
+}
+
+static void put_chunk(std::vector<unsigned char> *out, const char *type, const unsigned char *data, size_t size) {
+	put_u32(out, (uint32_t) size);
+	size_t start = out->size();
+	out->insert(out->end(), type, type + 4);
+	out->insert(out->end(), data, data + size);
+	put_u32(out, crc32(0, out->data() + start, size + 4));
+}
+
+void capture_encode_png(const unsigned char *rgba, int width, int height, std::vector<unsigned char> *out) {
+	std::call_once(tablesOnce, make_tables);
+
+	// every row starts with its filter type, 0 is none. flipped to top-down on the way
+	size_t rowBytes = (size_t) width * 4;
+	std::vector<unsigned char> rows((rowBytes + 1) * height);
+	for (int y = 0; y < height; y++) {
+		unsigned char *row = &rows[(rowBytes + 1) * y];
+		row[0] = 0;
+		memcpy(row + 1, rgba + rowBytes * (height - 1 - y), rowBytes);
+	}
+
+	std::vector<unsigned char> compressed;
+	zlib_compress(rows.data(), rows.size(), rowBytes, &compressed);
+
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out->assign(signature, signature + 8);
+
+	unsigned char header[13];
+	for (int i = 0; i < 4; i++) {
+		header[i] = (unsigned char) ((uint32_t) width >> (24 - 8 * i));
+		header[4 + i] = (unsigned char) ((uint32_t) height >> (24 - 8 * i));
+	}
+	header[8] = 8; // bits per channel
+	header[9] = 6; // RGBA
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering (every row says which)
+	header[12] = 0; // not interlaced
+	put_chunk(out, "IHDR", header, sizeof(header));
+	put_chunk(out, "IDAT", compressed.data(), compressed.size());
+	put_chunk(out, "IEND", NULL, 0);
+}
+
+static void encode_job(capture *c, const capture_job &job, std::vector<unsigned char> *png) {
+	size_t rowBytes = (size_t) c->width * 4;
+	const unsigned char *pixels = job.pixels->data();
+
+	if (c->format == CAPTURE_PNG) {
+		capture_encode_png(pixels, c->width, c->height, png);
+		char name[1024];
+		snprintf(name, sizeof(name), c->path, job.frame);
+		FILE *file = fopen(name, "wb");
+		if (!file) {
+			printf("capture: couldn't open %s\n", name);
+			return;
+		}
+		fwrite(png->data(), 1, png->size(), file);
+		fclose(file);
+		std::lock_guard<std::mutex> guard(c->lock);
+		c->stats.bytesWritten += png->size();
+		return;
+	}
+
+	// raw frames go out in order. capture_frame queues them in frame order and
+	// the queue is FIFO, so the frame that's next up was taken before this one
+	// and whoever has it is already working on it
+	std::unique_lock<std::mutex> guard(c->lock);
+	while (c->nextRawFrame != job.frame) {
+		c->done.wait(guard);
+	}
+	guard.unlock();
+	for (int y = c->height - 1; y >= 0; y--) {
+		fwrite(pixels + rowBytes * y, 1, rowBytes, c->rawFile);
+	}
+	guard.lock();
+	c->stats.bytesWritten += rowBytes * c->height;
+	c->nextRawFrame++;
+}
+
+static void worker_main(capture *c) {
+	PROFILE_THREAD_NAME("capture encoder");
+	std::vector<unsigned char> png;
+	std::unique_lock<std::mutex> guard(c->lock);
+	while (true) {
+		while (c->queue.empty() && !c->stopping) {
+			c->wake.wait(guard);
+		}
+		if (c->queue.empty()) {
+			return;
+		}
+		capture_job job = c->queue.front();
+		c->queue.pop_front();
+		guard.unlock();
+
+		double start = bench_now_ms();
+		{
+			PROFILE_ZONE("capture encode");
+			encode_job(c, job, &png);
+		}
+		double ms = bench_now_ms() - start;
+
+		guard.lock();
+		c->stats.encodeMs += ms;
+		c->freeBuffers.push_back(job.pixels);
+		c->inFlight--;
+		c->done.notify_all();
+	}
+}
+
+// the path goes to snprintf as the format, so it may hold exactly one %u
+// (with a width, %05u) and nothing else but %%
+static bool valid_frame_pattern(const char *path) {
+	int conversions = 0;
+	for (const char *p = path; *p; p++) {
+		if (*p != '%') {
+			continue;
+		}
+		p++;
+		if (*p == '%') {
+			continue;
+		}
+		while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+		if (*p != 'u') {
+			return false;
+		}
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+bool capture_init(capture *c, capture_format format, const char *path, int width, int height, unsigned int workers) {
+	if (format == CAPTURE_PNG && !valid_frame_pattern(path)) {
+		printf("capture: PNG output needs exactly one %%u in the path for the frame number (no other %% conversions), like frames/%%05u.png\n");
+		return false;
+	}
+
+	c->format = format;
+	c->path = path;
+	c->width = width;
+	c->height = height;
+	c->head = 0;
+	c->frameNumber = 0;
+	c->inFlight = 0;
+	c->nextRawFrame = 0;
+	c->stopping = false;
+	c->rawFile = NULL;
+	capture_stats empty = { 0, 0, 0, 0.0, 0.0, 0.0, 0 };
+	c->stats = empty;
+
+	if (format == CAPTURE_RAW) {
+		c->rawFile = fopen(path, "wb");
+		if (!c->rawFile) {
+			printf("capture: couldn't open %s\n", path);
+			return false;
+		}
+	}
+
+	// orphaned straight away, the driver only has to keep the storage around
+	GLsizeiptr size = (GLsizeiptr) width * height * 4;
+	for (int i = 0; i < CAPTURE_RING; i++) {
+		capture_slot &s = c->slots[i];
+		glGenBuffers(1, &s.pbo);
+		gls_bind_buffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		s.fence = 0;
+		s.frame = 0;
+		s.pending = false;
+	}
+	gls_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (workers == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		workers = cores > 2 ? cores - 1 : 1;
+		workers = workers > 4 ? 4 : workers;
+	}
+	for (unsigned int i = 0; i < workers; i++) {
+		c->workers.push_back(std::thread(worker_main, c));
+	}
+
+	printf("capture: %dx%d %s to %s, %u encoder thread(s)\n", width, height,
+		format == CAPTURE_PNG ? "PNG" : "raw RGBA", path, workers);
+	return true;
+}
+
+// copies the pixels out of a slot whose read has been issued and queues them.
+// wait says whether to block on the fence, otherwise it's left if not done yet
+static bool harvest(capture *c, capture_slot *s, bool wait) {
+	GLenum status = glClientWaitSync(s->fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		if (!wait) {
+			return false;
+		}
+		c->stats.fenceStalls++;
+		glClientWaitSync(s->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+	}
+	glDeleteSync(s->fence);
+	s->fence = 0;
+	s->pending = false;
+
+	std::vector<unsigned char> *pixels = NULL;
+	{
+		std::unique_lock<std::mutex> guard(c->lock);
+		if (c->inFlight >= CAPTURE_MAX_BACKLOG) {
+			c->stats.backlogStalls++;
+			while (c->inFlight >= CAPTURE_MAX_BACKLOG) {
+				c->done.wait(guard);
+			}
+		}
+		if (!c->freeBuffers.empty()) {
+			pixels = c->freeBuffers.back();
+			c->freeBuffers.pop_back();
+		}
+	}
+	if (!pixels) {
+		pixels = new std::vector<unsigned char>();
+	}
+
+	double start = bench_now_ms();
+	size_t size = (size_t) c->width * c->height * 4;
+	pixels->resize(size);
+	gls_bind_buffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+	void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) size, GL_MAP_READ_BIT);
+	if (mapped) {
+		memcpy(pixels->data(), mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		printf("capture: couldn't map the readback of frame %u\n", s->frame);
+		memset(pixels->data(), 0, size);
+	}
+	gls_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	c->stats.copyMs += bench_now_ms() - start;
+
+	capture_job job = { s->frame, pixels };
+	std::lock_guard<std::mutex> guard(c->lock);
+	c->queue.push_back(job);
+	c->inFlight++;
+	c->stats.frames++;
+	c->wake.notify_one();
+	return true;
+}
+
+void capture_frame(capture *c) {
+	// whatever has finished in the meantime, oldest (head) first and stopping
+	// at the first that hasn't, so frames always reach the encoders in order
+	for (unsigned int i = 0; i < CAPTURE_RING; i++) {
+		capture_slot *s = &c->slots[(c->head + i) % CAPTURE_RING];
+		if (s->pending && !harvest(c, s, false)) {
+			break;
+		}
+	}
+
+	// the slot being reused is the oldest, it has to be emptied whatever
+	// happens. still pending means nothing after it was harvested either
+	capture_slot *s = &c->slots[c->head];
+	if (s->pending) {
+		harvest(c, s, true);
+	}
+
+	double start = bench_now_ms();
+	gls_bind_buffer(GL_PIXEL_PACK_BUFFER, s->pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, c->width, c->height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0);
+	gls_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	s->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	s->frame = c->frameNumber++;
+	s->pending = true;
+	c->head = (c->head + 1) % CAPTURE_RING;
+	c->stats.readMs += bench_now_ms() - start;
+}
+
+void capture_finish(capture *c) {
+	for (unsigned int i = 0; i < CAPTURE_RING; i++) {
+		capture_slot *s = &c->slots[(c->head + i) % CAPTURE_RING];
+		if (s->pending) {
+			harvest(c, s, true);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(c->lock);
+		c->stopping = true;
+		c->wake.notify_all();
+	}
+	for (size_t i = 0; i < c->workers.size(); i++) {
+		c->workers[i].join();
+	}
+	c->workers.clear();
+
+	for (int i = 0; i < CAPTURE_RING; i++) {
+		gls_delete_buffers(1, &c->slots[i].pbo);
+	}
+	for (size_t i = 0; i < c->freeBuffers.size(); i++) {
+		delete c->freeBuffers[i];
+	}
+	c->freeBuffers.clear();
+	if (c->rawFile) {
+		fclose(c->rawFile);
+		c->rawFile = NULL;
+	}
+
+	const capture_stats &s = c->stats;
+	unsigned int frames = s.frames > 0 ? s.frames : 1;
+	printf("capture: %u frames, %.1f MB written\n", s.frames, s.bytesWritten / (1024.0 * 1024.0));
+	printf("  GL thread: %.3f ms per frame issuing reads, %.3f ms mapping + copying, %u fence stalls, %u backlog stalls\n",
+		s.readMs / frames, s.copyMs / frames, s.fenceStalls, s.backlogStalls);
+	printf("  encoders: %.3f ms per frame\n", s.encodeMs / frames);
+	if (c->format == CAPTURE_RAW) {
+		printf("  play with: ffplay -f rawvideo -pixel_format rgba -video_size %dx%d %s\n", c->width, c->height, c->path);
+	}
+}
+
+void capture_bench() {
+	const int width = 1280, height = 720;
+	std::vector<unsigned char> flat((size_t) width * height * 4), noisy(flat.size());
+
+	// what the demo looks like (clear color with flat shapes) vs the worst case
+	unsigned int seed = 1;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned char *p = &flat[((size_t) y * width + x) * 4];
+			bool shape = ((x / 80) + (y / 80)) % 3 == 0;
+			p[0] = shape ? 255 : 51;
+			p[1] = shape ? 255 : 204;
+			p[2] = shape ? 51 : 51;
+			p[3] = 255;
+			unsigned int r = bench_random_u32(&seed);
+			unsigned char *q = &noisy[((size_t) y * width + x) * 4];
+			q[0] = (unsigned char) r;
+			q[1] = (unsigned char) (r >> 8);
+			q[2] = (unsigned char) (r >> 16);
+			q[3] = 255;
+		}
+	}
+
+	printf("capture: PNG encode of a %dx%d frame (%.1f MB raw)\n", width, height, flat.size() / (1024.0 * 1024.0));
+	const char *names[2] = { "flat shapes", "noise" };
+	const std::vector<unsigned char> *frames[2] = { &flat, &noisy };
+	std::vector<unsigned char> png;
+	for (int f = 0; f < 2; f++) {
+		const int runs = 10;
+		double start = bench_now_ms();
+		for (int r = 0; r < runs; r++) {
+			capture_encode_png(frames[f]->data(), width, height, &png);
+		}
+		double ms = (bench_now_ms() - start) / runs;
+		printf("  %-12s %7.2f ms per frame, %8.1f KB (%.1f%% of raw)\n", names[f], ms,
+			png.size() / 1024.0, 100.0 * png.size() / frames[f]->size());
+	}
+
+	// what the GL thread pays per frame once the readback has landed
+	std::vector<unsigned char> copy(flat.size());
+	const int copies = 50;
+	double start = bench_now_ms();
+	for (int r = 0; r < copies; r++) {
+		memcpy(copy.data(), r & 1 ? flat.data() : noisy.data(), copy.size());
+	}
+	printf("  copying a mapped frame out: %.3f ms\n", (bench_now_ms() - start) / copies);
+}
@@ -0,0 +1,101 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glad/glad.h"
+
+// recording the output frames without stalling the loop. every frame the read
+// framebuffer goes into the next GL_PIXEL_PACK_BUFFER of a ring with
+// glReadPixels, which only queues the copy. a fence goes in behind it, and the
+// buffer gets mapped a few frames later once that has signalled, so by then
+// the copy is done and mapping doesn't wait. the pixels are copied out and
+// handed to a few encoder threads of our own (not the job system, a long PNG
+// encode picked up by job_wait on the GL thread would be exactly the hitch
+// this is meant to avoid)
+
+// PBOs in the ring. deeper than the frames the pacer lets the CPU queue so the
+// oldest one has normally finished by the time it comes round again
+#define CAPTURE_RING 4
+
+// frames copied out but not encoded yet. past this the GL thread waits for
+// the encoders rather than letting memory grow without bound
+#define CAPTURE_MAX_BACKLOG 16
+
+enum capture_format {
+	CAPTURE_PNG, // one file per frame, path is a printf pattern with a %u for the frame number
+	CAPTURE_RAW, // every frame appended to one file, top-down RGBA8 (ffmpeg -f rawvideo -pix_fmt rgba)
+};
+
+struct capture_slot {
+	GLuint pbo;
+	GLsync fence;
+	unsigned int frame;
+	bool pending; // read issued, not mapped yet
+};
+
+struct capture_job {
+	unsigned int frame;
+	std::vector<unsigned char> *pixels; // bottom-up, the way GL hands them over
+};
+
+struct capture_stats {
+	unsigned int frames;
+	unsigned int fenceStalls; // the GL thread had to wait for a readback to finish
+	unsigned int backlogStalls; // ... or for the encoders to catch up
+	double readMs; // GL thread time spent issuing reads
+	double copyMs; // GL thread time spent mapping and copying out
+	double encodeMs; // summed over encoder threads
+	unsigned long long bytesWritten;
+};
+
+struct capture {
+	capture_format format;
+	const char *path;
+	int width, height;
+
+	capture_slot slots[CAPTURE_RING];
+	unsigned int head; // next slot to read into
+	unsigned int frameNumber;
+
+	// encoder side, everything below lock is shared with the threads
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake; // work queued, or stopping
+	std::condition_variable done; // a job finished (backlog space, raw write order)
+	std::deque<capture_job> queue;
+	std::vector<std::vector<unsigned char> *> freeBuffers;
+	unsigned int inFlight; // queued + being encoded
+	unsigned int nextRawFrame; // raw frames have to land in the file in order
+	bool stopping;
+	FILE *rawFile;
+
+	capture_stats stats;
+};
+
+bool parse_capture_format(const char *name, capture_format *format);
+
+// needs a current context. the size is fixed from here on, workers 0 picks
+// one per spare core (at least one)
+bool capture_init(capture *c, capture_format format, const char *path, int width, int height, unsigned int workers);
+
+// after the frame has been drawn and before it's swapped. reads the current
+// read framebuffer (the back buffer, or the headless FBO)
+void capture_frame(capture *c);
+
+// waits for every outstanding readback and encode, then prints the stats
+void capture_finish(capture *c);
+
+// the PNG writer on its own, for the microbench / anything else. rgba is
+// bottom-up like glReadPixels returns it
+void capture_encode_png(const unsigned char *rgba, int width, int height, std::vector<unsigned char> *out);
+
+void capture_bench();
+
+#endif
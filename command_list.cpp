@@ -0,0 +1,334 @@
+#include "command_list.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gl_state.h"
+#include "job_system.h"
+#include "microbench.h"
+#include "shader.h"
+
+// one object per draw, so the transform and color are uniforms instead of attributes
+static const char *commandVertexSource = "#version 330 core\n"
+	"layout (location = 0) in vec3 aPos;\n"
+	"uniform vec4 uTransform;\n" // xy offset, z scale, w rotation
+	"uniform vec4 uColor;\n"
+	"out vec4 vColor;\n"
+	"void main() {\n"
+	"	float c = cos(uTransform.w);\n"
+	"	float s = sin(uTransform.w);\n"
+	"	vec2 p = mat2(c, s, -s, c) * (aPos.xy * uTransform.z) + uTransform.xy;\n"
+	"	gl_Position = vec4(p.x, p.y, aPos.z, 1.0f);\n"
+	"	vColor = uColor;\n"
+	"}\n";
+
+static const char *commandFragmentSource = "#version 330 core\n"
+	"in vec4 vColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"	FragColor = vColor;\n"
+	"}\n";
+
+static void command_push(command_list *list, command_type type, void *cmd, size_t size) {
+	command_header *header = (command_header *) cmd;
+	header->type = (uint16_t) type;
+	header->size = (uint16_t) size;
+
+	const unsigned char *bytes = (const unsigned char *) cmd;
+	list->data.insert(list->data.end(), bytes, bytes + size);
+	list->commandCount++;
+}
+
+void command_list_reset(command_list *list) {
+	// keeps the capacity, after the first frame recording doesn't allocate
+	list->data.clear();
+	list->commandCount = 0;
+}
+
+static void push_bind(command_list *list, command_type type, uint32_t handle, uint32_t target, uint32_t unit) {
+	cmd_bind cmd;
+	cmd.handle = handle;
+	cmd.target = target;
+	cmd.unit = unit;
+	command_push(list, type, &cmd, sizeof(cmd));
+}
+
+void cmd_bind_program(command_list *list, uint32_t program) {
+	push_bind(list, CMD_BIND_PROGRAM, program, 0, 0);
+}
+
+void cmd_bind_vao(command_list *list, uint32_t VAO) {
+	push_bind(list, CMD_BIND_VAO, VAO, 0, 0);
+}
+
+void cmd_bind_texture(command_list *list, uint32_t unit, uint32_t target, uint32_t texture) {
+	push_bind(list, CMD_BIND_TEXTURE, texture, target, unit);
+}
+
+// uniforms only store as many floats as they use
+static void push_uniform(command_list *list, command_type type, cmd_uniform *cmd, size_t valueSize) {
+	command_push(list, type, cmd, offsetof(cmd_uniform, value) + valueSize);
+}
+
+void cmd_uniform_1i(command_list *list, int32_t location, int32_t value) {
+	cmd_uniform cmd;
+	cmd.location = location;
+	cmd.value.i = value;
+	push_uniform(list, CMD_UNIFORM_1I, &cmd, sizeof(int32_t));
+}
+
+void cmd_uniform_1f(command_list *list, int32_t location, float value) {
+	cmd_uniform cmd;
+	cmd.location = location;
+	cmd.value.f[0] = value;
+	push_uniform(list, CMD_UNIFORM_1F, &cmd, sizeof(float));
+}
+
+void cmd_uniform_4f(command_list *list, int32_t location, float x, float y, float z, float w) {
+	cmd_uniform cmd;
+	cmd.location = location;
+	cmd.value.f[0] = x;
+	cmd.value.f[1] = y;
+	cmd.value.f[2] = z;
+	cmd.value.f[3] = w;
+	push_uniform(list, CMD_UNIFORM_4F, &cmd, 4 * sizeof(float));
+}
+
+void cmd_uniform_mat4(command_list *list, int32_t location, const float m[16]) {
+	cmd_uniform cmd;
+	cmd.location = location;
+	memcpy(cmd.value.f, m, 16 * sizeof(float));
+	push_uniform(list, CMD_UNIFORM_MAT4, &cmd, 16 * sizeof(float));
+}
+
+void cmd_draw_arrays(command_list *list, uint32_t mode, int32_t first, int32_t count, int32_t instanceCount) {
+	cmd_draw cmd;
+	cmd.mode = mode;
+	cmd.first = first;
+	cmd.count = count;
+	cmd.indexOffset = 0;
+	cmd.instanceCount = instanceCount;
+	command_push(list, CMD_DRAW_ARRAYS, &cmd, sizeof(cmd));
+}
+
+void cmd_draw_elements(command_list *list, uint32_t mode, int32_t count, uint32_t indexOffset, int32_t baseVertex, int32_t instanceCount) {
+	cmd_draw cmd;
+	cmd.mode = mode;
+	cmd.first = baseVertex;
+	cmd.count = count;
+	cmd.indexOffset = indexOffset;
+	cmd.instanceCount = instanceCount;
+	command_push(list, CMD_DRAW_ELEMENTS, &cmd, sizeof(cmd));
+}
+
+static void execute_draw(const cmd_draw &d, bool indexed) {
+	if (!indexed) {
+		if (d.instanceCount == 1) {
+			glDrawArrays(d.mode, d.first, d.count);
+		} else {
+			glDrawArraysInstanced(d.mode, d.first, d.count, d.instanceCount);
+		}
+		return;
+	}
+
+	void *offset = (void *) (d.indexOffset * sizeof(unsigned int));
+	if (d.instanceCount == 1) {
+		glDrawElementsBaseVertex(d.mode, d.count, GL_UNSIGNED_INT, offset, d.first);
+	} else {
+		glDrawElementsInstancedBaseVertex(d.mode, d.count, GL_UNSIGNED_INT, offset, d.instanceCount, d.first);
+	}
+}
+
+void command_list_execute(const command_list *lists, unsigned int count) {
+	for (unsigned int l = 0; l < count; l++) {
+		const unsigned char *at = lists[l].data.data();
+		const unsigned char *end = at + lists[l].data.size();
+
+		while (at < end) {
+			// the buffer is a byte stream so copy out instead of casting in place
+			command_header header;
+			memcpy(&header, at, sizeof(header));
+
+			switch (header.type) {
+			case CMD_BIND_PROGRAM:
+			case CMD_BIND_VAO:
+			case CMD_BIND_TEXTURE: {
+				cmd_bind b;
+				memcpy(&b, at, sizeof(b));
+				if (header.type == CMD_BIND_PROGRAM) {
+					gls_use_program(b.handle);
+				} else if (header.type == CMD_BIND_VAO) {
+					gls_bind_vertex_array(b.handle);
+				} else {
+					gls_active_texture(GL_TEXTURE0 + b.unit);
+					gls_bind_texture(b.target, b.handle);
+				}
+				break;
+			}
+			case CMD_UNIFORM_1I:
+			case CMD_UNIFORM_1F:
+			case CMD_UNIFORM_4F:
+			case CMD_UNIFORM_MAT4: {
+				cmd_uniform u;
+				memcpy(&u, at, header.size);
+				if (header.type == CMD_UNIFORM_1I) {
+					glUniform1i(u.location, u.value.i);
+				} else if (header.type == CMD_UNIFORM_1F) {
+					glUniform1f(u.location, u.value.f[0]);
+				} else if (header.type == CMD_UNIFORM_4F) {
+					glUniform4fv(u.location, 1, u.value.f);
+				} else {
+					glUniformMatrix4fv(u.location, 1, GL_FALSE, u.value.f);
+				}
+				break;
+			}
+			case CMD_DRAW_ARRAYS:
+			case CMD_DRAW_ELEMENTS: {
+				cmd_draw d;
+				memcpy(&d, at, sizeof(d));
+				execute_draw(d, header.type == CMD_DRAW_ELEMENTS);
+				break;
+			}
+			default:
+				printf("command list: unknown command %u, skipping the rest of the list\n", header.type);
+				at = end;
+				continue;
+			}
+
+			at += header.size;
+		}
+	}
+}
+
+struct record_lists {
+	command_list *lists;
+	void (*record)(command_list *list, unsigned int index, void *user);
+	void *user;
+};
+
+static void record_list_range(unsigned int begin, unsigned int end, void *user) {
+	record_lists *r = (record_lists *) user;
+	for (unsigned int i = begin; i < end; i++) {
+		r->record(&r->lists[i], i, r->user);
+	}
+}
+
+void command_list_record_parallel(command_list *lists, unsigned int count,
+	void (*record)(command_list *list, unsigned int index, void *user), void *user) {
+
+	record_lists r = { lists, record, user };
+	parallel_for(count, 1, record_list_range, &r);
+}
+
+bool command_scene_create(command_scene *scene, unsigned int VAO, GLsizei vertexCount,
+	const std::vector<instance_data> &objects, unsigned int threadCount) {
+
+	scene->VAO = VAO;
+	scene->vertexCount = vertexCount;
+	scene->objects = objects;
+	scene->lists.resize(threadCount > 0 ? threadCount : 1);
+	for (size_t i = 0; i < scene->lists.size(); i++) {
+		command_list_reset(&scene->lists[i]);
+	}
+
+	scene->program = shader_program(commandVertexSource, commandFragmentSource, "COMMAND");
+	if (scene->program == 0) {
+		return false;
+	}
+	scene->transformLocation = glGetUniformLocation(scene->program, "uTransform");
+	scene->colorLocation = glGetUniformLocation(scene->program, "uColor");
+	return true;
+}
+
+// each list gets a contiguous slice so replaying lists 0..n keeps the object order
+static void record_scene_slice(command_list *list, unsigned int index, void *user) {
+	command_scene *scene = (command_scene *) user;
+	unsigned int objectCount = (unsigned int) scene->objects.size();
+	unsigned int listCount = (unsigned int) scene->lists.size();
+	unsigned int chunk = (objectCount + listCount - 1) / listCount;
+	unsigned int begin = index * chunk < objectCount ? index * chunk : objectCount;
+	unsigned int end = begin + chunk < objectCount ? begin + chunk : objectCount;
+
+	command_list_reset(list);
+
+	// every list binds for itself, it can't know what the previous one left bound.
+	// the state cache drops the repeats when they're replayed back to back
+	cmd_bind_program(list, scene->program);
+	cmd_bind_vao(list, scene->VAO);
+
+	for (unsigned int i = begin; i < end; i++) {
+		const instance_data &o = scene->objects[i];
+		cmd_uniform_4f(list, scene->transformLocation, o.transform[0], o.transform[1], o.transform[2], o.transform[3]);
+		cmd_uniform_4f(list, scene->colorLocation, o.color[0], o.color[1], o.color[2], o.color[3]);
+		cmd_draw_arrays(list, GL_TRIANGLES, 0, scene->vertexCount, 1);
+	}
+}
+
+void command_scene_draw(command_scene *scene) {
+	command_list_record_parallel(scene->lists.data(), (unsigned int) scene->lists.size(), record_scene_slice, scene);
+	command_list_execute(scene->lists.data(), (unsigned int) scene->lists.size());
+}
+
+void command_scene_destroy(command_scene *scene) {
+	glDeleteProgram(scene->program);
+	scene->program = 0;
+	scene->objects.clear();
+	scene->lists.clear();
+}
+
+struct bench_scene {
+	std::vector<instance_data> *objects;
+	unsigned int listCount;
+};
+
+static void record_bench_slice(command_list *list, unsigned int index, void *user) {
+	bench_scene *b = (bench_scene *) user;
+	unsigned int objectCount = (unsigned int) b->objects->size();
+	unsigned int chunk = (objectCount + b->listCount - 1) / b->listCount;
+	unsigned int begin = index * chunk < objectCount ? index * chunk : objectCount;
+	unsigned int end = begin + chunk < objectCount ? begin + chunk : objectCount;
+
+	command_list_reset(list);
+	cmd_bind_program(list, 1);
+	cmd_bind_vao(list, 1);
+	for (unsigned int i = begin; i < end; i++) {
+		const instance_data &o = (*b->objects)[i];
+		cmd_uniform_4f(list, 0, o.transform[0], o.transform[1], o.transform[2], o.transform[3]);
+		cmd_uniform_4f(list, 1, o.color[0], o.color[1], o.color[2], o.color[3]);
+		cmd_draw_arrays(list, GL_TRIANGLES, 0, 3, 1);
+	}
+}
+
+void command_list_bench() {
+	const unsigned int objectCount = 100000;
+	std::vector<instance_data> objects;
+	instance_make_grid(objects, objectCount, -0.5f, -0.5f, 1.0f);
+
+	unsigned int hw = bench_max_threads();
+
+	printf("command lists: %u objects, 2 uniforms + 1 draw each\n", objectCount);
+	for (unsigned int threads = 1; threads <= hw; threads = bench_next_threads(threads, hw)) {
+		std::vector<command_list> lists(threads);
+		bench_scene b = { &objects, threads };
+
+		// first run sizes the buffers, after that recording shouldn't allocate
+		command_list_record_parallel(lists.data(), threads, record_bench_slice, &b);
+
+		const int runs = 20;
+		double start = bench_now_ms();
+		for (int r = 0; r < runs; r++) {
+			command_list_record_parallel(lists.data(), threads, record_bench_slice, &b);
+		}
+		double ms = (bench_now_ms() - start) / runs;
+
+		size_t bytes = 0;
+		unsigned int commands = 0;
+		for (unsigned int i = 0; i < threads; i++) {
+			bytes += lists[i].data.size();
+			commands += lists[i].commandCount;
+		}
+		printf("  %u thread(s): %.3f ms to record %u commands, %.1f MB\n", threads, ms, commands,
+			bytes / (1024.0 * 1024.0));
+	}
+}
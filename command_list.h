@@ -0,0 +1,103 @@
+#ifndef COMMAND_LIST_H
+#define COMMAND_LIST_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "instancing.h"
+
+// a linear buffer of plain old data commands. recording never touches GL so
+// any thread can fill its own list, the GL thread replays them afterwards in
+// whatever order it's given. handles are just uint32s, for the GL backend
+// they're GL names / uniform locations
+
+enum command_type {
+	CMD_BIND_PROGRAM,
+	CMD_BIND_VAO,
+	CMD_BIND_TEXTURE,
+	CMD_UNIFORM_1I,
+	CMD_UNIFORM_1F,
+	CMD_UNIFORM_4F,
+	CMD_UNIFORM_MAT4,
+	CMD_DRAW_ARRAYS,
+	CMD_DRAW_ELEMENTS,
+};
+
+// every command starts with this, size includes the header so the reader can skip ahead
+struct command_header {
+	uint16_t type;
+	uint16_t size;
+};
+
+struct cmd_bind {
+	command_header header;
+	uint32_t handle;
+	uint32_t target; // target and unit are only used by CMD_BIND_TEXTURE
+	uint32_t unit;
+};
+
+struct cmd_uniform {
+	command_header header;
+	int32_t location;
+	union {
+		int32_t i;
+		float f[16];
+	} value;
+};
+
+struct cmd_draw {
+	command_header header;
+	uint32_t mode;
+	int32_t first; // first vertex, or base vertex for elements
+	int32_t count;
+	uint32_t indexOffset; // in indices
+	int32_t instanceCount;
+};
+
+struct command_list {
+	std::vector<unsigned char> data;
+	unsigned int commandCount;
+};
+
+void command_list_reset(command_list *list);
+
+void cmd_bind_program(command_list *list, uint32_t program);
+void cmd_bind_vao(command_list *list, uint32_t VAO);
+void cmd_bind_texture(command_list *list, uint32_t unit, uint32_t target, uint32_t texture);
+void cmd_uniform_1i(command_list *list, int32_t location, int32_t value);
+void cmd_uniform_1f(command_list *list, int32_t location, float value);
+void cmd_uniform_4f(command_list *list, int32_t location, float x, float y, float z, float w);
+void cmd_uniform_mat4(command_list *list, int32_t location, const float m[16]); // column major
+void cmd_draw_arrays(command_list *list, uint32_t mode, int32_t first, int32_t count, int32_t instanceCount);
+void cmd_draw_elements(command_list *list, uint32_t mode, int32_t count, uint32_t indexOffset, int32_t baseVertex, int32_t instanceCount);
+
+// GL backend, runs on the thread that owns the context. binds go through the
+// state cache so lists recorded independently don't pay for repeated binds
+void command_list_execute(const command_list *lists, unsigned int count);
+
+// fill count lists as jobs on the job system, record(list, index, user) is
+// called once per list
+void command_list_record_parallel(command_list *lists, unsigned int count,
+	void (*record)(command_list *list, unsigned int index, void *user), void *user);
+
+// objectCount separate objects, each one a uniform upload + a draw, recorded
+// into one command list per thread for disjoint slices of the objects
+struct command_scene {
+	unsigned int program;
+	int transformLocation;
+	int colorLocation;
+	unsigned int VAO;
+	GLsizei vertexCount;
+	std::vector<instance_data> objects;
+	std::vector<command_list> lists;
+};
+
+bool command_scene_create(command_scene *scene, unsigned int VAO, GLsizei vertexCount,
+	const std::vector<instance_data> &objects, unsigned int threadCount);
+void command_scene_draw(command_scene *scene);
+void command_scene_destroy(command_scene *scene);
+
+void command_list_bench();
+
+#endif
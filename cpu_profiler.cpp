@@ -0,0 +1,261 @@
+#include "cpu_profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "microbench.h"
+
+// how long the flush thread sleeps between passes over the rings
+#define CPU_PROFILER_FLUSH_MS 5
+
+std::atomic<bool> cpuProfilerActive(false);
+thread_local profile_thread_buffer *cpuProfilerBuffer = NULL;
+
+struct cpu_profiler_state {
+	// every ring ever registered. they're never freed, a thread that has
+	// exited may still have events in its ring that need writing
+	std::mutex lock;
+	std::vector<profile_thread_buffer *> buffers;
+	std::vector<profile_thread_buffer *> draining; // drain's copy of buffers, only ever touched by whoever drains
+
+	std::thread flusher;
+	std::atomic<bool> flushing;
+	FILE *file; // NULL drains without writing
+	bool firstEvent;
+	uint64_t written;
+
+	uint64_t startTicks;
+	double nsPerTick;
+};
+
+static cpu_profiler_state profiler;
+
+profile_thread_buffer *cpu_profiler_register_thread() {
+	profile_thread_buffer *b = new profile_thread_buffer;
+	b->head.store(0);
+	b->tail.store(0);
+	b->dropped.store(0);
+
+	std::lock_guard<std::mutex> guard(profiler.lock);
+	b->id = (unsigned int) profiler.buffers.size() + 1;
+	snprintf(b->name, sizeof(b->name), "thread %u", b->id);
+	profiler.buffers.push_back(b);
+	cpuProfilerBuffer = b;
+	return b;
+}
+
+void cpu_profiler_set_thread_name(const char *name) {
+	profile_thread_buffer *b = cpuProfilerBuffer ? cpuProfilerBuffer : cpu_profiler_register_thread();
+	std::lock_guard<std::mutex> guard(profiler.lock);
+	snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+static double steady_ns() {
+	using namespace std::chrono;
+	return duration<double, std::nano>(steady_clock::now().time_since_epoch()).count();
+}
+
+// ticks -> nanoseconds. rdtsc runs at a fixed rate on anything recent, so
+// timing it against the steady clock for a few milliseconds is enough
+static double measure_ns_per_tick() {
+#ifdef CPU_PROFILER_TSC
+	double startNs = steady_ns();
+	uint64_t startTicks = profile_now();
+	while (steady_ns() - startNs < 10000000.0) {
+	}
+	return (steady_ns() - startNs) / (double) (profile_now() - startTicks);
+#else
+	return 1.0;
+#endif
+}
+
+static void write_event(const profile_thread_buffer *b, const profile_record &r) {
+	profiler.written++;
+	if (!profiler.file) {
+		return;
+	}
+	double ts = (double) (int64_t) (r.begin - profiler.startTicks) * profiler.nsPerTick / 1000.0;
+	double dur = (double) (r.end - r.begin) * profiler.nsPerTick / 1000.0;
+	fprintf(profiler.file, "%s{\"name\":", profiler.firstEvent ? "" : ",\n");
+	json_write_string(profiler.file, r.name);
+	fprintf(profiler.file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}", ts, dur, b->id);
+	profiler.firstEvent = false;
+}
+
+// everything between tail and head is finished (head is only published after
+// the record is written), so it can be read without any further syncing.
+// the lock only covers copying the list, so a thread registering its ring
+// doesn't wait on the file writes. rings are never freed, the copy stays good
+static void drain() {
+	{
+		std::lock_guard<std::mutex> guard(profiler.lock);
+		profiler.draining = profiler.buffers;
+	}
+	for (size_t i = 0; i < profiler.draining.size(); i++) {
+		profile_thread_buffer *b = profiler.draining[i];
+		uint32_t tail = b->tail.load(std::memory_order_relaxed);
+		uint32_t head = b->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			write_event(b, b->records[tail & (CPU_PROFILER_RING - 1)]);
+		}
+		b->tail.store(tail, std::memory_order_release);
+	}
+}
+
+static void flush_main() {
+	PROFILE_THREAD_NAME("profiler flush");
+	while (profiler.flushing.load(std::memory_order_acquire)) {
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(CPU_PROFILER_FLUSH_MS));
+	}
+}
+
+bool cpu_profiler_start(const char *path) {
+	if (profiler.flushing.load()) {
+		return false;
+	}
+
+	profiler.file = NULL;
+	if (path) {
+		profiler.file = fopen(path, "w");
+		if (!profiler.file) {
+			printf("couldn't open %s for the CPU profile\n", path);
+			return false;
+		}
+		fprintf(profiler.file, "{\"traceEvents\":[\n");
+	}
+	profiler.firstEvent = true;
+	profiler.written = 0;
+	profiler.nsPerTick = measure_ns_per_tick();
+
+	// anything left over from an earlier capture
+	{
+		std::lock_guard<std::mutex> guard(profiler.lock);
+		for (size_t i = 0; i < profiler.buffers.size(); i++) {
+			profile_thread_buffer *b = profiler.buffers[i];
+			b->tail.store(b->head.load(std::memory_order_acquire), std::memory_order_release);
+			b->dropped.store(0);
+		}
+	}
+
+	profiler.startTicks = profile_now();
+	profiler.flushing.store(true);
+	profiler.flusher = std::thread(flush_main);
+	cpuProfilerActive.store(true);
+	return true;
+}
+
+struct thread_label {
+	unsigned int id;
+	char name[sizeof(profile_thread_buffer::name)];
+};
+
+void cpu_profiler_stop() {
+	if (!profiler.flushing.load()) {
+		return;
+	}
+	cpuProfilerActive.store(false);
+	profiler.flushing.store(false, std::memory_order_release);
+	profiler.flusher.join();
+	drain();
+
+	// names can still be changed under the lock, copy them out before writing
+	std::vector<thread_label> labels;
+	uint32_t dropped = 0;
+	{
+		std::lock_guard<std::mutex> guard(profiler.lock);
+		for (size_t i = 0; i < profiler.buffers.size(); i++) {
+			const profile_thread_buffer *b = profiler.buffers[i];
+			dropped += b->dropped.load();
+			thread_label label;
+			label.id = b->id;
+			memcpy(label.name, b->name, sizeof(label.name));
+			labels.push_back(label);
+		}
+	}
+	if (profiler.file) {
+		for (size_t i = 0; i < labels.size(); i++) {
+			fprintf(profiler.file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+				profiler.firstEvent ? "" : ",\n", labels[i].id);
+			json_write_string(profiler.file, labels[i].name);
+			fprintf(profiler.file, "}}");
+			profiler.firstEvent = false;
+		}
+		fprintf(profiler.file, "\n]}\n");
+		fclose(profiler.file);
+		profiler.file = NULL;
+		printf("cpu profile: %llu zones written, %u dropped because a ring was full\n",
+			(unsigned long long) profiler.written, dropped);
+	}
+}
+
+static void empty_zone(volatile unsigned int *sink) {
+	PROFILE_ZONE("bench");
+	*sink = *sink + 1;
+}
+
+void cpu_profiler_bench() {
+	const unsigned int zones = 4000000;
+	volatile unsigned int sink = 0;
+
+	printf("cpu profiler: %u empty zones, timestamps from %s\n", zones,
+#ifdef CPU_PROFILER_TSC
+		"rdtsc"
+#else
+		"clock_gettime"
+#endif
+	);
+
+	double start = bench_now_ms();
+	for (unsigned int i = 0; i < zones; i++) {
+		sink = sink + 1;
+	}
+	double baseMs = bench_now_ms() - start;
+
+	start = bench_now_ms();
+	for (unsigned int i = 0; i < zones; i++) {
+		empty_zone(&sink);
+	}
+	double idleMs = bench_now_ms() - start;
+
+	// the timestamp on its own, the capturing zone reads it twice
+	uint64_t ticks = 0;
+	start = bench_now_ms();
+	for (unsigned int i = 0; i < zones; i++) {
+		ticks += profile_now();
+	}
+	double clockMs = bench_now_ms() - start;
+	sink = sink + (unsigned int) (ticks & 1);
+
+	// capturing, but discarding. zones go in batches smaller than the ring and
+	// the flush thread gets to catch up between them (not timed), so every one
+	// takes the full path instead of the cheaper "ring full" one
+	cpu_profiler_start(NULL);
+	double activeMs = 0.0;
+	const unsigned int batch = CPU_PROFILER_RING / 2;
+	for (unsigned int done = 0; done < zones; done += batch) {
+		start = bench_now_ms();
+		for (unsigned int i = 0; i < batch; i++) {
+			empty_zone(&sink);
+		}
+		activeMs += bench_now_ms() - start;
+		profile_thread_buffer *b = cpuProfilerBuffer;
+		while (b && b->tail.load() != b->head.load()) {
+			std::this_thread::yield();
+		}
+	}
+	uint32_t dropped = cpuProfilerBuffer ? cpuProfilerBuffer->dropped.load() : 0;
+	cpu_profiler_stop();
+
+	double toNs = 1000000.0 / zones;
+	printf("  no zone:              %.2f ns per iteration\n", baseMs * toNs);
+	printf("  zone, not capturing:  %.2f ns\n", (idleMs - baseMs) * toNs);
+	printf("  zone, capturing:      %.2f ns (%u dropped), %.2f ns of that is the two timestamps\n",
+		(activeMs - baseMs) * toNs, dropped, 2.0 * clockMs * toNs);
+	printf("  compiled out (-DPROFILER=OFF): the macros are empty, 0 ns\n");
+}
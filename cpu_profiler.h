@@ -0,0 +1,118 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_PROFILER_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#include <time.h>
+#endif
+
+// scoped CPU zones. PROFILE_ZONE("name") at the top of a block times the
+// rest of the block and, if a capture is running, appends one event to a ring
+// buffer owned by the calling thread. the write is a couple of plain stores
+// and one release store, no locks and no syscalls. a background thread drains
+// every thread's ring into a Chrome trace file while the capture runs.
+//
+// build with CPU_PROFILER_DISABLED defined (cmake -DPROFILER=OFF) and the
+// macros expand to nothing
+
+// events per thread, a power of two. if the flush thread falls this far
+// behind, new events get dropped (and counted) rather than blocking
+#define CPU_PROFILER_RING 16384
+
+struct profile_record {
+	const char *name; // not copied, has to stay around (string literals)
+	uint64_t begin, end; // raw ticks, see profile_now
+};
+
+// single producer (the owning thread) single consumer (the flush thread)
+struct profile_thread_buffer {
+	profile_record records[CPU_PROFILER_RING];
+	std::atomic<uint32_t> head; // next write, only the owner moves it
+	std::atomic<uint32_t> tail; // next read, only the flush thread moves it
+	std::atomic<uint32_t> dropped;
+	unsigned int id;
+	char name[32];
+};
+
+extern std::atomic<bool> cpuProfilerActive;
+extern thread_local profile_thread_buffer *cpuProfilerBuffer;
+
+// rdtsc on x86, the monotonic clock in nanoseconds elsewhere. converted to
+// real time when the events get written out
+inline uint64_t profile_now() {
+#ifdef CPU_PROFILER_TSC
+	return __rdtsc();
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// first call on a thread allocates its ring
+profile_thread_buffer *cpu_profiler_register_thread();
+
+inline void cpu_profiler_record(const char *name, uint64_t begin, uint64_t end) {
+	profile_thread_buffer *b = cpuProfilerBuffer;
+	if (!b) {
+		b = cpu_profiler_register_thread();
+	}
+	uint32_t head = b->head.load(std::memory_order_relaxed);
+	if (head - b->tail.load(std::memory_order_acquire) >= CPU_PROFILER_RING) {
+		b->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	profile_record &r = b->records[head & (CPU_PROFILER_RING - 1)];
+	r.name = name;
+	r.begin = begin;
+	r.end = end;
+	b->head.store(head + 1, std::memory_order_release);
+}
+
+struct profile_zone {
+	const char *name;
+	uint64_t begin; // 0 when no capture was running at the start of the zone
+
+	profile_zone(const char *zoneName) : name(zoneName),
+		begin(cpuProfilerActive.load(std::memory_order_relaxed) ? profile_now() : 0) {
+	}
+
+	~profile_zone() {
+		if (begin) {
+			cpu_profiler_record(name, begin, profile_now());
+		}
+	}
+};
+
+// starts the flush thread writing to path, false if the file can't be opened
+bool cpu_profiler_start(const char *path);
+
+// stops recording, writes out what's left and closes the file
+void cpu_profiler_stop();
+
+// shows up as the track name in the trace, copied
+void cpu_profiler_set_thread_name(const char *name);
+
+void cpu_profiler_bench();
+
+#ifndef CPU_PROFILER_DISABLED
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) profile_zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD_NAME(name) cpu_profiler_set_thread_name(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD_NAME(name)
+#endif
+
+#endif
@@ -0,0 +1,319 @@
+#include "cull.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "job_system.h"
+#include "microbench.h"
+#include "vecmath.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang only emit AVX2 inside functions marked for it, so the rest of
+// the file still runs on any x86-64. msvc doesn't need the attribute
+#if defined(CULL_X86) && defined(__GNUC__)
+#define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CULL_TARGET_AVX2
+#endif
+
+// objects per job, big enough that a job is a few microseconds of work
+#define CULL_GRAIN 16384
+
+unsigned int cull_set_add(cull_set *set, const float center[3], const float extent[3]) {
+	set->centerX.push_back(center[0]);
+	set->centerY.push_back(center[1]);
+	set->centerZ.push_back(center[2]);
+	set->radius.push_back(sqrtf(extent[0] * extent[0] + extent[1] * extent[1] + extent[2] * extent[2]));
+	set->extentX.push_back(extent[0]);
+	set->extentY.push_back(extent[1]);
+	set->extentZ.push_back(extent[2]);
+	return set->size() - 1;
+}
+
+void cull_set_clear(cull_set *set) {
+	set->centerX.clear();
+	set->centerY.clear();
+	set->centerZ.clear();
+	set->radius.clear();
+	set->extentX.clear();
+	set->extentY.clear();
+	set->extentZ.clear();
+}
+
+bool cull_isa_supported(cull_isa isa) {
+	static const bool avx2 = math_cpu_has_avx2();
+	switch (isa) {
+	case CULL_SCALAR:
+		return true;
+	case CULL_SSE:
+#ifdef CULL_X86
+		return true; // SSE2 is part of x86-64, and all the kernel needs
+#else
+		return false;
+#endif
+	case CULL_AVX2:
+		return avx2;
+	}
+	return false;
+}
+
+cull_isa cull_best_isa() {
+	if (cull_isa_supported(CULL_AVX2)) {
+		return CULL_AVX2;
+	}
+	if (cull_isa_supported(CULL_SSE)) {
+		return CULL_SSE;
+	}
+	return CULL_SCALAR;
+}
+
+const char *cull_isa_name(cull_isa isa) {
+	const char *names[] = { "scalar", "sse", "avx2" };
+	return names[isa];
+}
+
+// the planes, plus their normals' absolute values for the box test
+struct cull_planes {
+	float p[6][4];
+	float absN[6][3];
+};
+
+// a box is outside a plane if even its corner furthest along the normal is behind
+// it. that corner is |n| . extent past the center, which for a sphere is just r
+static unsigned int cull_scalar(const cull_set &set, const cull_planes &planes, bool boxes,
+	unsigned int begin, unsigned int end, unsigned int *out) {
+
+	unsigned int n = 0;
+	for (unsigned int i = begin; i < end; i++) {
+		float cx = set.centerX[i], cy = set.centerY[i], cz = set.centerZ[i];
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++) {
+			const float *pl = planes.p[p];
+			float reach = boxes
+				? planes.absN[p][0] * set.extentX[i] + planes.absN[p][1] * set.extentY[i] + planes.absN[p][2] * set.extentZ[i]
+				: set.radius[i];
+			// same grouping as the SIMD kernels so every path agrees right on a plane
+			inside = (pl[0] * cx + pl[1] * cy) + (pl[2] * cz + pl[3]) + reach >= 0.0f;
+		}
+		if (inside) {
+			out[n++] = i;
+		}
+	}
+	return n;
+}
+
+// turns a lane mask into indices, lowest lane first so the output stays in order
+static inline unsigned int write_mask(unsigned int mask, unsigned int base, unsigned int *out) {
+	unsigned int n = 0;
+	while (mask) {
+#if defined(__GNUC__)
+		unsigned int lane = (unsigned int) __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+		unsigned long lane;
+		_BitScanForward(&lane, mask);
+#else
+		unsigned int lane = 0;
+		while (!(mask & (1u << lane))) lane++;
+#endif
+		out[n++] = base + lane;
+		mask &= mask - 1;
+	}
+	return n;
+}
+
+#ifdef CULL_X86
+static unsigned int cull_sse(const cull_set &set, const cull_planes &planes, bool boxes,
+	unsigned int begin, unsigned int end, unsigned int *out) {
+
+	unsigned int n = 0;
+	unsigned int i = begin;
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4) {
+		__m128 cx = _mm_loadu_ps(&set.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&set.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&set.centerZ[i]);
+		__m128 r = _mm_loadu_ps(&set.radius[i]);
+		__m128 ex = _mm_setzero_ps(), ey = ex, ez = ex;
+		if (boxes) {
+			ex = _mm_loadu_ps(&set.extentX[i]);
+			ey = _mm_loadu_ps(&set.extentY[i]);
+			ez = _mm_loadu_ps(&set.extentZ[i]);
+		}
+
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; p++) {
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.p[p][0]), cx), _mm_mul_ps(_mm_set1_ps(planes.p[p][1]), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.p[p][2]), cz), _mm_set1_ps(planes.p[p][3])));
+			__m128 reach = r;
+			if (boxes) {
+				reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.absN[p][0]), ex), _mm_mul_ps(_mm_set1_ps(planes.absN[p][1]), ey)),
+					_mm_mul_ps(_mm_set1_ps(planes.absN[p][2]), ez));
+			}
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, reach), zero));
+		}
+
+		n += write_mask((unsigned int) _mm_movemask_ps(inside), i, out + n);
+	}
+
+	return n + cull_scalar(set, planes, boxes, i, end, out + n);
+}
+
+CULL_TARGET_AVX2
+static unsigned int cull_avx2(const cull_set &set, const cull_planes &planes, bool boxes,
+	unsigned int begin, unsigned int end, unsigned int *out) {
+
+	unsigned int n = 0;
+	unsigned int i = begin;
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 cx = _mm256_loadu_ps(&set.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&set.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&set.centerZ[i]);
+		__m256 r = _mm256_loadu_ps(&set.radius[i]);
+		__m256 ex = _mm256_setzero_ps(), ey = ex, ez = ex;
+		if (boxes) {
+			ex = _mm256_loadu_ps(&set.extentX[i]);
+			ey = _mm256_loadu_ps(&set.extentY[i]);
+			ez = _mm256_loadu_ps(&set.extentZ[i]);
+		}
+
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		for (int p = 0; p < 6; p++) {
+			__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.p[p][0]), cx), _mm256_mul_ps(_mm256_set1_ps(planes.p[p][1]), cy)),
+				_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.p[p][2]), cz), _mm256_set1_ps(planes.p[p][3])));
+			__m256 reach = r;
+			if (boxes) {
+				reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.absN[p][0]), ex), _mm256_mul_ps(_mm256_set1_ps(planes.absN[p][1]), ey)),
+					_mm256_mul_ps(_mm256_set1_ps(planes.absN[p][2]), ez));
+			}
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, reach), zero, _CMP_GE_OQ));
+		}
+
+		n += write_mask((unsigned int) _mm256_movemask_ps(inside), i, out + n);
+	}
+
+	return n + cull_scalar(set, planes, boxes, i, end, out + n);
+}
+#endif
+
+typedef unsigned int (*cull_kernel)(const cull_set &set, const cull_planes &planes, bool boxes,
+	unsigned int begin, unsigned int end, unsigned int *out);
+
+struct cull_job {
+	const cull_set *set;
+	cull_planes planes;
+	bool boxes;
+	cull_kernel kernel;
+	unsigned int *out;
+	unsigned int *counts; // one per chunk
+};
+
+// every chunk writes its survivors at its own start in out, compacted afterwards
+static void cull_chunk(unsigned int begin, unsigned int end, void *user) {
+	cull_job *job = (cull_job *) user;
+	job->counts[begin / CULL_GRAIN] = job->kernel(*job->set, job->planes, job->boxes, begin, end, job->out + begin);
+}
+
+unsigned int cull_frustum(const cull_set &set, const frustum &f, cull_shape shape, cull_isa isa,
+	std::vector<unsigned int> &visible) {
+
+	unsigned int count = set.size();
+	visible.resize(count);
+	if (count == 0) {
+		return 0;
+	}
+
+	cull_job job;
+	job.set = &set;
+	job.boxes = shape == CULL_BOXES;
+	job.kernel = cull_scalar;
+#ifdef CULL_X86
+	if (isa == CULL_AVX2 && cull_isa_supported(CULL_AVX2)) {
+		job.kernel = cull_avx2;
+	} else if (isa != CULL_SCALAR) {
+		job.kernel = cull_sse;
+	}
+#endif
+	memcpy(job.planes.p, f.planes, sizeof(job.planes.p));
+	for (int p = 0; p < 6; p++) {
+		for (int k = 0; k < 3; k++) {
+			job.planes.absN[p][k] = fabsf(f.planes[p][k]);
+		}
+	}
+
+	unsigned int chunkCount = (count + CULL_GRAIN - 1) / CULL_GRAIN;
+	std::vector<unsigned int> counts(chunkCount);
+	job.out = visible.data();
+	job.counts = counts.data();
+
+	parallel_for(count, CULL_GRAIN, cull_chunk, &job);
+
+	// chunks only ever move down, so a forward memmove pass is safe
+	unsigned int total = counts[0];
+	for (unsigned int c = 1; c < chunkCount; c++) {
+		memmove(&visible[total], &visible[c * CULL_GRAIN], counts[c] * sizeof(unsigned int));
+		total += counts[c];
+	}
+
+	visible.resize(total);
+	return total;
+}
+
+void cull_bench() {
+	const unsigned int objectCount = 1000000;
+
+	// a big cube of small boxes around a camera looking down -z, about 1/6 of
+	// them end up in view which is roughly what a real scene would look like
+	cull_set set;
+	unsigned int seed = 12345;
+	for (unsigned int i = 0; i < objectCount; i++) {
+		float center[3], extent[3];
+		for (int k = 0; k < 3; k++) {
+			center[k] = (bench_random_float(&seed) - 0.5f) * 200.0f;
+			extent[k] = 0.1f + bench_random_float(&seed) * 0.9f;
+		}
+		cull_set_add(&set, center, extent);
+	}
+
+	float eye[3] = { 0.0f, 0.0f, 0.0f };
+	float viewProj[16];
+	frustum_view_projection(eye, 60.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f, viewProj);
+	frustum f = frustum_from_matrix(viewProj);
+
+	printf("cull: %u objects on %u thread(s), best kernel here is %s\n", objectCount,
+		job_system_thread_count(), cull_isa_name(cull_best_isa()));
+
+	std::vector<unsigned int> reference, visible;
+	for (int shape = CULL_SPHERES; shape <= CULL_BOXES; shape++) {
+		cull_frustum(set, f, (cull_shape) shape, CULL_SCALAR, reference);
+
+		for (int isa = CULL_SCALAR; isa <= CULL_AVX2; isa++) {
+			if (!cull_isa_supported((cull_isa) isa)) {
+				printf("  %-7s %-6s not supported on this CPU\n", shape == CULL_SPHERES ? "spheres" : "boxes", cull_isa_name((cull_isa) isa));
+				continue;
+			}
+
+			cull_frustum(set, f, (cull_shape) shape, (cull_isa) isa, visible); // warm up
+
+			const int runs = 10;
+			double start = bench_now_ms();
+			for (int r = 0; r < runs; r++) {
+				cull_frustum(set, f, (cull_shape) shape, (cull_isa) isa, visible);
+			}
+			double ms = (bench_now_ms() - start) / runs;
+
+			printf("  %-7s %-6s %.3f ms, %zu visible%s\n", shape == CULL_SPHERES ? "spheres" : "boxes",
+				cull_isa_name((cull_isa) isa), ms, visible.size(), visible == reference ? "" : " (MISMATCH vs scalar)");
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef CULL_H
+#define CULL_H
+
+#include <vector>
+
+#include "frustum.h"
+
+// object bounds kept as structure of arrays so the SIMD kernels can load 4 or 8
+// objects' worth of each component at once. every object has both a sphere and
+// an axis aligned box (center + half extents), the caller picks which to test
+struct cull_set {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> radius;
+	std::vector<float> extentX, extentY, extentZ;
+
+	unsigned int size() const { return (unsigned int) centerX.size(); }
+};
+
+enum cull_shape {
+	CULL_SPHERES,
+	CULL_BOXES,
+};
+
+enum cull_isa {
+	CULL_SCALAR,
+	CULL_SSE,
+	CULL_AVX2,
+};
+
+// the sphere is the one around the box. returns the object's index
+unsigned int cull_set_add(cull_set *set, const float center[3], const float extent[3]);
+void cull_set_clear(cull_set *set);
+
+// best kernel this CPU can run, checked once at runtime
+cull_isa cull_best_isa();
+bool cull_isa_supported(cull_isa isa);
+const char *cull_isa_name(cull_isa isa);
+
+// fills visible with the indices of everything not completely outside one of the
+// planes, in index order. split across the job system, returns visible.size()
+unsigned int cull_frustum(const cull_set &set, const frustum &f, cull_shape shape, cull_isa isa,
+	std::vector<unsigned int> &visible);
+
+void cull_bench();
+
+#endif
@@ -0,0 +1,791 @@
+#include "frame_graph.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "cpu_profiler.h"
+#include "gl_state.h"
+#include "microbench.h"
+
+void frame_graph_reset(frame_graph *fg) {
+	fg->resources.clear();
+	fg->passes.clear();
+	fg->order.clear();
+	frame_graph_stats empty = { 0, 0, 0, 0, 0 };
+	fg->stats = empty;
+}
+
+static unsigned int add_resource(frame_graph *fg, const char *name, const fg_resource_desc &desc, bool imported, GLuint glName) {
+	fg_resource r;
+	r.name = name;
+	r.desc = desc;
+	r.imported = imported;
+	r.importedName = glName;
+	r.firstUse = FG_NONE;
+	r.lastUse = FG_NONE;
+	r.physical = FG_NONE;
+	fg->resources.push_back(r);
+	return (unsigned int) fg->resources.size() - 1;
+}
+
+static fg_resource_desc texture_desc(int width, int height, GLenum format) {
+	fg_resource_desc d = { FG_TEXTURE, width, height, format, 0 };
+	return d;
+}
+
+static fg_resource_desc buffer_desc(GLsizeiptr size) {
+	fg_resource_desc d = { FG_BUFFER, 0, 0, GL_NONE, size };
+	return d;
+}
+
+unsigned int fg_create_texture(frame_graph *fg, const char *name, int width, int height, GLenum format) {
+	return add_resource(fg, name, texture_desc(width, height, format), false, 0);
+}
+
+unsigned int fg_create_buffer(frame_graph *fg, const char *name, GLsizeiptr size) {
+	return add_resource(fg, name, buffer_desc(size), false, 0);
+}
+
+unsigned int fg_import_texture(frame_graph *fg, const char *name, GLuint texture, int width, int height, GLenum format) {
+	return add_resource(fg, name, texture_desc(width, height, format), true, texture);
+}
+
+unsigned int fg_import_buffer(frame_graph *fg, const char *name, GLuint buffer, GLsizeiptr size) {
+	return add_resource(fg, name, buffer_desc(size), true, buffer);
+}
+
+unsigned int fg_add_pass(frame_graph *fg, const char *name, fg_execute_fn execute, void *user) {
+	fg_pass p;
+	p.name = name;
+	p.execute = execute;
+	p.user = user;
+	p.sideEffect = false;
+	p.culled = false;
+	p.barrier = 0;
+	fg->passes.push_back(p);
+	return (unsigned int) fg->passes.size() - 1;
+}
+
+void fg_read(frame_graph *fg, unsigned int pass, unsigned int resource, fg_usage usage) {
+	fg_access a = { resource, usage };
+	fg->passes[pass].reads.push_back(a);
+}
+
+void fg_write(frame_graph *fg, unsigned int pass, unsigned int resource, fg_usage usage) {
+	fg_access a = { resource, usage };
+	fg->passes[pass].writes.push_back(a);
+}
+
+void fg_side_effect(frame_graph *fg, unsigned int pass) {
+	fg->passes[pass].sideEffect = true;
+}
+
+// sized internal format -> what glTexImage2D wants alongside it, and the size
+// of a texel for the memory numbers
+struct fg_format_info {
+	GLenum internalFormat;
+	GLenum format, type;
+	unsigned int bytes;
+};
+
+static const fg_format_info formats[] = {
+	{ GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1 },
+	{ GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2 },
+	{ GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+	{ GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+	{ GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 4 },
+	{ GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, 4 },
+	{ GL_R16F, GL_RED, GL_HALF_FLOAT, 2 },
+	{ GL_RG16F, GL_RG, GL_HALF_FLOAT, 4 },
+	{ GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 },
+	{ GL_R32F, GL_RED, GL_FLOAT, 4 },
+	{ GL_RG32F, GL_RG, GL_FLOAT, 8 },
+	{ GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 },
+	{ GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, 4 },
+	{ GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4 },
+	{ GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4 },
+	{ GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4 },
+};
+
+static const fg_format_info *format_info(GLenum internalFormat) {
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		if (formats[i].internalFormat == internalFormat) {
+			return &formats[i];
+		}
+	}
+	return &formats[2]; // treat anything unknown as RGBA8
+}
+
+static size_t desc_bytes(const fg_resource_desc &d) {
+	if (d.kind == FG_BUFFER) {
+		return (size_t) d.size;
+	}
+	return (size_t) d.width * d.height * format_info(d.format)->bytes;
+}
+
+static bool same_texture(const fg_resource_desc &a, const fg_resource_desc &b) {
+	return a.kind == FG_TEXTURE && b.kind == FG_TEXTURE && a.width == b.width && a.height == b.height && a.format == b.format;
+}
+
+static bool is_storage(fg_usage usage) {
+	return usage == FG_STORAGE_IMAGE || usage == FG_STORAGE_BUFFER;
+}
+
+// which glMemoryBarrier bit makes an incoherent write visible to this kind of access
+static GLbitfield barrier_bit(fg_usage usage) {
+	switch (usage) {
+	case FG_RENDER_TARGET: return GL_FRAMEBUFFER_BARRIER_BIT;
+	case FG_SAMPLED: return GL_TEXTURE_FETCH_BARRIER_BIT;
+	case FG_STORAGE_IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	case FG_STORAGE_BUFFER: return GL_SHADER_STORAGE_BARRIER_BIT;
+	case FG_VERTEX_BUFFER: return GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+	case FG_INDEX_BUFFER: return GL_ELEMENT_ARRAY_BARRIER_BIT;
+	case FG_INDIRECT_BUFFER: return GL_COMMAND_BARRIER_BIT;
+	case FG_UNIFORM_BUFFER: return GL_UNIFORM_BARRIER_BIT;
+	case FG_TRANSFER: return GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT;
+	}
+	return GL_ALL_BARRIER_BITS;
+}
+
+struct fg_edge {
+	unsigned int from, to;
+	bool raw; // the reader actually needs what the writer made, the rest only order
+};
+
+struct fg_reader {
+	unsigned int pass;
+	unsigned int next;
+};
+
+// passes run in declaration order as far as what they see goes: a read gets
+// the last write declared before it. that gives read-after-write edges, plus
+// write-after-read and write-after-write edges so a later write can't be
+// moved over an earlier access to the same resource
+static void build_edges(const frame_graph &fg, std::vector<fg_edge> *edges) {
+	std::vector<unsigned int> lastWriter(fg.resources.size(), FG_NONE);
+	std::vector<unsigned int> readersHead(fg.resources.size(), FG_NONE); // readers since the last write
+	std::vector<fg_reader> readers;
+
+	for (unsigned int p = 0; p < fg.passes.size(); p++) {
+		const fg_pass &pass = fg.passes[p];
+		for (size_t i = 0; i < pass.reads.size(); i++) {
+			unsigned int r = pass.reads[i].resource;
+			if (lastWriter[r] != FG_NONE && lastWriter[r] != p) {
+				fg_edge e = { lastWriter[r], p, true };
+				edges->push_back(e);
+			}
+			fg_reader reader = { p, readersHead[r] };
+			readers.push_back(reader);
+			readersHead[r] = (unsigned int) readers.size() - 1;
+		}
+		for (size_t i = 0; i < pass.writes.size(); i++) {
+			unsigned int r = pass.writes[i].resource;
+			for (unsigned int n = readersHead[r]; n != FG_NONE; n = readers[n].next) {
+				if (readers[n].pass != p) {
+					fg_edge e = { readers[n].pass, p, false };
+					edges->push_back(e);
+				}
+			}
+			readersHead[r] = FG_NONE;
+			if (lastWriter[r] != FG_NONE && lastWriter[r] != p) {
+				fg_edge e = { lastWriter[r], p, false };
+				edges->push_back(e);
+			}
+			lastWriter[r] = p;
+		}
+	}
+}
+
+// a pass stays if it has a side effect, writes something imported, or
+// something that stays reads what it wrote
+static void cull_passes(frame_graph *fg, const std::vector<fg_edge> &edges) {
+	size_t passCount = fg->passes.size();
+
+	// read-after-write edges grouped by reader
+	std::vector<unsigned int> firstEdge(passCount + 1, 0);
+	std::vector<unsigned int> producers;
+	for (size_t e = 0; e < edges.size(); e++) {
+		if (edges[e].raw) {
+			firstEdge[edges[e].to + 1]++;
+		}
+	}
+	for (size_t p = 0; p < passCount; p++) {
+		firstEdge[p + 1] += firstEdge[p];
+	}
+	producers.resize(firstEdge[passCount]);
+	std::vector<unsigned int> fill(firstEdge.begin(), firstEdge.end() - 1);
+	for (size_t e = 0; e < edges.size(); e++) {
+		if (edges[e].raw) {
+			producers[fill[edges[e].to]++] = edges[e].from;
+		}
+	}
+
+	std::vector<unsigned int> stack;
+	for (unsigned int p = 0; p < passCount; p++) {
+		fg_pass &pass = fg->passes[p];
+		bool root = pass.sideEffect;
+		for (size_t i = 0; i < pass.writes.size() && !root; i++) {
+			root = fg->resources[pass.writes[i].resource].imported;
+		}
+		pass.culled = !root;
+		if (root) {
+			stack.push_back(p);
+		}
+	}
+	while (!stack.empty()) {
+		unsigned int p = stack.back();
+		stack.pop_back();
+		for (unsigned int e = firstEdge[p]; e < firstEdge[p + 1]; e++) {
+			fg_pass &producer = fg->passes[producers[e]];
+			if (producer.culled) {
+				producer.culled = false;
+				stack.push_back(producers[e]);
+			}
+		}
+	}
+}
+
+static bool consumes(const fg_pass &reader, const fg_pass &writer) {
+	for (size_t i = 0; i < reader.reads.size(); i++) {
+		for (size_t j = 0; j < writer.writes.size(); j++) {
+			if (reader.reads[i].resource == writer.writes[j].resource) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// topological sort over the passes that survived. out of the passes that are
+// ready it takes one that reads what the previous pass just wrote, so chains
+// (blur, bloom, ...) run back to back and their intermediates die sooner,
+// which leaves more to alias. otherwise the earliest declared one
+static void order_passes(frame_graph *fg, const std::vector<fg_edge> &edges) {
+	size_t passCount = fg->passes.size();
+	std::vector<unsigned int> firstEdge(passCount + 1, 0);
+	std::vector<unsigned int> successors;
+	std::vector<unsigned int> waiting(passCount, 0);
+	for (size_t e = 0; e < edges.size(); e++) {
+		if (!fg->passes[edges[e].from].culled && !fg->passes[edges[e].to].culled) {
+			firstEdge[edges[e].from + 1]++;
+			waiting[edges[e].to]++;
+		}
+	}
+	for (size_t p = 0; p < passCount; p++) {
+		firstEdge[p + 1] += firstEdge[p];
+	}
+	successors.resize(firstEdge[passCount]);
+	std::vector<unsigned int> fill(firstEdge.begin(), firstEdge.end() - 1);
+	for (size_t e = 0; e < edges.size(); e++) {
+		if (!fg->passes[edges[e].from].culled && !fg->passes[edges[e].to].culled) {
+			successors[fill[edges[e].from]++] = edges[e].to;
+		}
+	}
+
+	std::vector<unsigned int> ready;
+	for (unsigned int p = 0; p < passCount; p++) {
+		if (!fg->passes[p].culled && waiting[p] == 0) {
+			ready.push_back(p);
+		}
+	}
+
+	fg->order.clear();
+	while (!ready.empty()) {
+		size_t pick = 0;
+		for (size_t i = 1; i < ready.size(); i++) {
+			if (ready[i] < ready[pick]) {
+				pick = i;
+			}
+		}
+		if (!fg->order.empty()) {
+			const fg_pass &previous = fg->passes[fg->order.back()];
+			for (size_t i = 0; i < ready.size(); i++) {
+				if (consumes(fg->passes[ready[i]], previous) && (!consumes(fg->passes[ready[pick]], previous) || ready[i] < ready[pick])) {
+					pick = i;
+				}
+			}
+		}
+
+		unsigned int p = ready[pick];
+		ready[pick] = ready.back();
+		ready.pop_back();
+		fg->order.push_back(p);
+		for (unsigned int e = firstEdge[p]; e < firstEdge[p + 1]; e++) {
+			if (--waiting[successors[e]] == 0) {
+				ready.push_back(successors[e]);
+			}
+		}
+	}
+}
+
+// GL keeps ordinary writes (draws into a framebuffer, copies, buffer updates)
+// visible to whatever comes after by itself. image and SSBO stores it doesn't,
+// those need a glMemoryBarrier with the bits for how the data gets read next.
+// a barrier covers every earlier write, so track per GL object whether there's
+// an unflushed store and which bits have been issued since. per object, not
+// per resource, so it runs after aliasing: a store into one transient still
+// has to be flushed before the next transient living in the same object
+static unsigned int memory_of(const frame_graph &fg, unsigned int resource) {
+	unsigned int physical = fg.resources[resource].physical;
+	return physical != FG_NONE ? physical : (unsigned int) fg.physical.size() + resource;
+}
+
+static void place_barriers(frame_graph *fg) {
+	size_t memoryCount = fg->physical.size() + fg->resources.size();
+	std::vector<bool> incoherent(memoryCount, false);
+	std::vector<GLbitfield> visible(memoryCount, 0);
+
+	for (size_t o = 0; o < fg->order.size(); o++) {
+		fg_pass &pass = fg->passes[fg->order[o]];
+		GLbitfield bits = 0;
+		for (size_t i = 0; i < pass.reads.size(); i++) {
+			unsigned int m = memory_of(*fg, pass.reads[i].resource);
+			GLbitfield bit = barrier_bit(pass.reads[i].usage);
+			if (incoherent[m] && !(visible[m] & bit)) {
+				bits |= bit;
+			}
+		}
+		for (size_t i = 0; i < pass.writes.size(); i++) {
+			unsigned int m = memory_of(*fg, pass.writes[i].resource);
+			GLbitfield bit = barrier_bit(pass.writes[i].usage);
+			if (incoherent[m] && !(visible[m] & bit)) {
+				bits |= bit;
+			}
+		}
+		pass.barrier = bits;
+
+		if (bits) {
+			fg->stats.barriers++;
+			for (size_t m = 0; m < memoryCount; m++) {
+				if (incoherent[m]) {
+					visible[m] |= bits;
+				}
+			}
+		}
+		for (size_t i = 0; i < pass.writes.size(); i++) {
+			unsigned int m = memory_of(*fg, pass.writes[i].resource);
+			incoherent[m] = is_storage(pass.writes[i].usage);
+			visible[m] = 0;
+		}
+	}
+}
+
+static void touch(fg_resource *r, unsigned int position) {
+	if (r->firstUse == FG_NONE) {
+		r->firstUse = position;
+	}
+	r->lastUse = position;
+}
+
+static bool first_use_less(const fg_resource *a, const fg_resource *b) {
+	return a->firstUse < b->firstUse;
+}
+
+// greedy interval packing, in order of first use. a texture only shares with
+// one of the exact same size and format. buffers share with any free buffer,
+// the smallest one that fits, or the biggest one grows if none does
+static void alias_resources(frame_graph *fg) {
+	for (size_t o = 0; o < fg->order.size(); o++) {
+		const fg_pass &pass = fg->passes[fg->order[o]];
+		for (size_t i = 0; i < pass.reads.size(); i++) {
+			touch(&fg->resources[pass.reads[i].resource], (unsigned int) o);
+		}
+		for (size_t i = 0; i < pass.writes.size(); i++) {
+			touch(&fg->resources[pass.writes[i].resource], (unsigned int) o);
+		}
+	}
+
+	// objects that were never created (or got deleted) go, the rest are
+	// candidates again. buffers start from nothing and grow to this frame's need
+	size_t kept = 0;
+	for (size_t i = 0; i < fg->physical.size(); i++) {
+		if (fg->physical[i].name != 0) {
+			fg->physical[kept] = fg->physical[i];
+			fg->physical[kept].used = false;
+			if (fg->physical[kept].desc.kind == FG_BUFFER) {
+				fg->physical[kept].desc.size = 0;
+			}
+			kept++;
+		}
+	}
+	fg->physical.resize(kept);
+	std::vector<unsigned int> freeAfter(kept, 0);
+
+	std::vector<fg_resource *> transient;
+	for (size_t r = 0; r < fg->resources.size(); r++) {
+		if (!fg->resources[r].imported && fg->resources[r].firstUse != FG_NONE) {
+			transient.push_back(&fg->resources[r]);
+		}
+	}
+	std::stable_sort(transient.begin(), transient.end(), first_use_less);
+
+	for (size_t t = 0; t < transient.size(); t++) {
+		fg_resource *r = transient[t];
+		fg->stats.transientBytes += desc_bytes(r->desc);
+
+		unsigned int best = FG_NONE;
+		for (unsigned int s = 0; s < fg->physical.size(); s++) {
+			const fg_physical &slot = fg->physical[s];
+			if (slot.used && freeAfter[s] >= r->firstUse) {
+				continue;
+			}
+			if (r->desc.kind == FG_TEXTURE) {
+				if (same_texture(slot.desc, r->desc)) {
+					best = s;
+					break;
+				}
+				continue;
+			}
+			if (slot.desc.kind != FG_BUFFER) {
+				continue;
+			}
+			if (best == FG_NONE) {
+				best = s;
+				continue;
+			}
+			GLsizeiptr have = fg->physical[best].desc.size;
+			bool fits = slot.desc.size >= r->desc.size, bestFits = have >= r->desc.size;
+			if ((fits && (!bestFits || slot.desc.size < have)) || (!fits && !bestFits && slot.desc.size > have)) {
+				best = s;
+			}
+		}
+
+		if (best == FG_NONE) {
+			fg_physical slot;
+			slot.desc = r->desc;
+			slot.allocated = r->desc;
+			slot.name = 0;
+			slot.used = false;
+			fg->physical.push_back(slot);
+			freeAfter.push_back(0);
+			best = (unsigned int) fg->physical.size() - 1;
+		}
+
+		fg_physical &slot = fg->physical[best];
+		if (r->desc.kind == FG_BUFFER && slot.desc.size < r->desc.size) {
+			slot.desc.size = r->desc.size;
+		}
+		slot.used = true;
+		freeAfter[best] = r->lastUse;
+		r->physical = best;
+	}
+
+	for (size_t s = 0; s < fg->physical.size(); s++) {
+		if (fg->physical[s].used) {
+			fg->stats.physicalBytes += desc_bytes(fg->physical[s].desc);
+		}
+	}
+}
+
+void frame_graph_compile(frame_graph *fg) {
+	frame_graph_stats empty = { 0, 0, 0, 0, 0 };
+	fg->stats = empty;
+	for (size_t r = 0; r < fg->resources.size(); r++) {
+		fg->resources[r].firstUse = FG_NONE;
+		fg->resources[r].lastUse = FG_NONE;
+		fg->resources[r].physical = FG_NONE;
+	}
+
+	std::vector<fg_edge> edges;
+	build_edges(*fg, &edges);
+	cull_passes(fg, edges);
+	order_passes(fg, edges);
+	alias_resources(fg);
+	place_barriers(fg);
+
+	fg->stats.passes = (unsigned int) fg->order.size();
+	fg->stats.culled = (unsigned int) (fg->passes.size() - fg->order.size());
+}
+
+static void create_physical(fg_physical *slot) {
+	if (slot->desc.kind == FG_TEXTURE) {
+		const fg_format_info *f = format_info(slot->desc.format);
+		glGenTextures(1, &slot->name);
+		gls_bind_texture(GL_TEXTURE_2D, slot->name);
+		glTexImage2D(GL_TEXTURE_2D, 0, slot->desc.format, slot->desc.width, slot->desc.height, 0, f->format, f->type, NULL);
+		GLint filter = f->format == GL_DEPTH_COMPONENT || f->format == GL_DEPTH_STENCIL || f->format == GL_RED_INTEGER ? GL_NEAREST : GL_LINEAR;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	} else {
+		glGenBuffers(1, &slot->name);
+		gls_bind_buffer(GL_COPY_WRITE_BUFFER, slot->name);
+		glBufferData(GL_COPY_WRITE_BUFFER, slot->desc.size, NULL, GL_DYNAMIC_COPY);
+	}
+	slot->allocated = slot->desc;
+}
+
+static void delete_physical(fg_physical *slot) {
+	if (slot->allocated.kind == FG_TEXTURE) {
+		gls_delete_textures(1, &slot->name);
+	} else {
+		gls_delete_buffers(1, &slot->name);
+	}
+	slot->name = 0;
+}
+
+void frame_graph_execute(frame_graph *fg) {
+	for (size_t s = 0; s < fg->physical.size(); s++) {
+		fg_physical *slot = &fg->physical[s];
+		bool stale = slot->name != 0 && (!slot->used ||
+			(slot->desc.kind == FG_TEXTURE ? !same_texture(slot->allocated, slot->desc) : slot->allocated.size < slot->desc.size));
+		if (stale) {
+			delete_physical(slot);
+		}
+		if (slot->used && slot->name == 0) {
+			create_physical(slot);
+		}
+	}
+
+	// barriers are a 4.2 thing. below that nothing can do image or SSBO
+	// stores either, so there's never one to issue
+	for (size_t o = 0; o < fg->order.size(); o++) {
+		const fg_pass &pass = fg->passes[fg->order[o]];
+		PROFILE_ZONE(pass.name);
+		if (pass.barrier && GLAD_GL_VERSION_4_2) {
+			glMemoryBarrier(pass.barrier);
+		}
+		if (pass.execute) {
+			pass.execute(*fg, pass.user);
+		}
+	}
+}
+
+GLuint fg_gl_name(const frame_graph &fg, unsigned int resource) {
+	const fg_resource &r = fg.resources[resource];
+	if (r.imported) {
+		return r.importedName;
+	}
+	return r.physical == FG_NONE ? 0 : fg.physical[r.physical].name;
+}
+
+void frame_graph_destroy(frame_graph *fg) {
+	for (size_t s = 0; s < fg->physical.size(); s++) {
+		if (fg->physical[s].name != 0) {
+			delete_physical(&fg->physical[s]);
+		}
+	}
+	fg->physical.clear();
+	frame_graph_reset(fg);
+}
+
+static void print_barrier_bits(GLbitfield bits) {
+	static const struct {
+		GLbitfield bit;
+		const char *name;
+	} names[] = {
+		{ GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT, "vertex" },
+		{ GL_ELEMENT_ARRAY_BARRIER_BIT, "index" },
+		{ GL_UNIFORM_BARRIER_BIT, "uniform" },
+		{ GL_TEXTURE_FETCH_BARRIER_BIT, "texture fetch" },
+		{ GL_SHADER_IMAGE_ACCESS_BARRIER_BIT, "image" },
+		{ GL_COMMAND_BARRIER_BIT, "command" },
+		{ GL_PIXEL_BUFFER_BARRIER_BIT, "pixel buffer" },
+		{ GL_TEXTURE_UPDATE_BARRIER_BIT, "texture update" },
+		{ GL_BUFFER_UPDATE_BARRIER_BIT, "buffer update" },
+		{ GL_FRAMEBUFFER_BARRIER_BIT, "framebuffer" },
+		{ GL_SHADER_STORAGE_BARRIER_BIT, "storage" },
+	};
+	bool first = true;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (bits & names[i].bit) {
+			printf("%s%s", first ? "" : " | ", names[i].name);
+			first = false;
+		}
+	}
+}
+
+void frame_graph_print(const frame_graph &fg) {
+	printf("  %u passes, %u culled, %u barriers\n", fg.stats.passes, fg.stats.culled, fg.stats.barriers);
+	for (size_t o = 0; o < fg.order.size(); o++) {
+		const fg_pass &pass = fg.passes[fg.order[o]];
+		if (pass.barrier) {
+			printf("    %2u  -- barrier: ", (unsigned int) o);
+			print_barrier_bits(pass.barrier);
+			printf("\n");
+		}
+		printf("    %2u  %s\n", (unsigned int) o, pass.name);
+	}
+	for (size_t p = 0; p < fg.passes.size(); p++) {
+		if (fg.passes[p].culled) {
+			printf("    --  %s (culled)\n", fg.passes[p].name);
+		}
+	}
+
+	printf("  transient memory: %.2f MB separately, %.2f MB aliased into %u objects\n",
+		fg.stats.transientBytes / (1024.0 * 1024.0), fg.stats.physicalBytes / (1024.0 * 1024.0), (unsigned int) fg.physical.size());
+	for (size_t s = 0; s < fg.physical.size(); s++) {
+		unsigned int sharing = 0;
+		for (size_t r = 0; r < fg.resources.size(); r++) {
+			sharing += fg.resources[r].physical == s;
+		}
+		if (sharing < 2) {
+			continue;
+		}
+		printf("    shared:");
+		for (size_t r = 0; r < fg.resources.size(); r++) {
+			if (fg.resources[r].physical == s) {
+				printf(" %s [%u-%u]", fg.resources[r].name, fg.resources[r].firstUse, fg.resources[r].lastUse);
+			}
+		}
+		printf("\n");
+	}
+}
+
+// a deferred frame: shadows, gbuffer, compute SSAO and light culling,
+// lighting, a bloom chain, auto exposure, tonemap, AA. the debug view has nothing
+// reading it and should get culled
+static void declare_sample_frame(frame_graph *fg) {
+	const int w = 1920, h = 1080;
+	unsigned int backbuffer = fg_import_texture(fg, "backbuffer", 0, w, h, GL_RGBA8);
+
+	unsigned int shadowMap = fg_create_texture(fg, "shadow map", 2048, 2048, GL_DEPTH_COMPONENT32F);
+	unsigned int albedo = fg_create_texture(fg, "albedo", w, h, GL_RGBA8);
+	unsigned int normal = fg_create_texture(fg, "normal", w, h, GL_RGBA16F);
+	unsigned int depth = fg_create_texture(fg, "depth", w, h, GL_DEPTH24_STENCIL8);
+	unsigned int ssaoRaw = fg_create_texture(fg, "ssao raw", w / 2, h / 2, GL_R8);
+	unsigned int ssao = fg_create_texture(fg, "ssao", w / 2, h / 2, GL_R8);
+	unsigned int lightList = fg_create_buffer(fg, "light list", (w / 16) * (h / 16 + 1) * 256);
+	unsigned int hdr = fg_create_texture(fg, "hdr", w, h, GL_RGBA16F);
+	unsigned int bright = fg_create_texture(fg, "bloom 1/2", w / 2, h / 2, GL_R11F_G11F_B10F);
+	unsigned int down1 = fg_create_texture(fg, "bloom 1/4", w / 4, h / 4, GL_R11F_G11F_B10F);
+	unsigned int down2 = fg_create_texture(fg, "bloom 1/8", w / 8, h / 8, GL_R11F_G11F_B10F);
+	unsigned int up1 = fg_create_texture(fg, "bloom up 1/4", w / 4, h / 4, GL_R11F_G11F_B10F);
+	unsigned int up0 = fg_create_texture(fg, "bloom up 1/2", w / 2, h / 2, GL_R11F_G11F_B10F);
+	unsigned int histogram = fg_create_buffer(fg, "histogram", 256 * 4);
+	unsigned int exposure = fg_create_buffer(fg, "exposure", 16);
+	unsigned int ldr = fg_create_texture(fg, "ldr", w, h, GL_RGBA8);
+	unsigned int debugView = fg_create_texture(fg, "debug view", w, h, GL_RGBA8);
+
+	unsigned int p = fg_add_pass(fg, "shadow map", NULL, NULL);
+	fg_write(fg, p, shadowMap, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "gbuffer", NULL, NULL);
+	fg_write(fg, p, albedo, FG_RENDER_TARGET);
+	fg_write(fg, p, normal, FG_RENDER_TARGET);
+	fg_write(fg, p, depth, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "debug overdraw", NULL, NULL);
+	fg_read(fg, p, depth, FG_SAMPLED);
+	fg_write(fg, p, debugView, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "ssao", NULL, NULL);
+	fg_read(fg, p, depth, FG_SAMPLED);
+	fg_read(fg, p, normal, FG_SAMPLED);
+	fg_write(fg, p, ssaoRaw, FG_STORAGE_IMAGE);
+
+	p = fg_add_pass(fg, "light culling", NULL, NULL);
+	fg_read(fg, p, depth, FG_SAMPLED);
+	fg_write(fg, p, lightList, FG_STORAGE_BUFFER);
+
+	p = fg_add_pass(fg, "ssao blur", NULL, NULL);
+	fg_read(fg, p, ssaoRaw, FG_SAMPLED);
+	fg_write(fg, p, ssao, FG_STORAGE_IMAGE);
+
+	p = fg_add_pass(fg, "lighting", NULL, NULL);
+	fg_read(fg, p, albedo, FG_SAMPLED);
+	fg_read(fg, p, normal, FG_SAMPLED);
+	fg_read(fg, p, depth, FG_SAMPLED);
+	fg_read(fg, p, ssao, FG_SAMPLED);
+	fg_read(fg, p, shadowMap, FG_SAMPLED);
+	fg_read(fg, p, lightList, FG_STORAGE_BUFFER);
+	fg_write(fg, p, hdr, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "luminance histogram", NULL, NULL);
+	fg_read(fg, p, hdr, FG_SAMPLED);
+	fg_write(fg, p, histogram, FG_STORAGE_BUFFER);
+
+	p = fg_add_pass(fg, "bloom bright", NULL, NULL);
+	fg_read(fg, p, hdr, FG_SAMPLED);
+	fg_write(fg, p, bright, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "exposure", NULL, NULL);
+	fg_read(fg, p, histogram, FG_STORAGE_BUFFER);
+	fg_write(fg, p, exposure, FG_STORAGE_BUFFER);
+
+	p = fg_add_pass(fg, "bloom down 1/4", NULL, NULL);
+	fg_read(fg, p, bright, FG_SAMPLED);
+	fg_write(fg, p, down1, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "bloom down 1/8", NULL, NULL);
+	fg_read(fg, p, down1, FG_SAMPLED);
+	fg_write(fg, p, down2, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "bloom up 1/4", NULL, NULL);
+	fg_read(fg, p, down2, FG_SAMPLED);
+	fg_write(fg, p, up1, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "bloom up 1/2", NULL, NULL);
+	fg_read(fg, p, up1, FG_SAMPLED);
+	fg_read(fg, p, bright, FG_SAMPLED);
+	fg_write(fg, p, up0, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "tonemap", NULL, NULL);
+	fg_read(fg, p, hdr, FG_SAMPLED);
+	fg_read(fg, p, up0, FG_SAMPLED);
+	fg_read(fg, p, exposure, FG_UNIFORM_BUFFER);
+	fg_write(fg, p, ldr, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "fxaa", NULL, NULL);
+	fg_read(fg, p, ldr, FG_SAMPLED);
+	fg_write(fg, p, backbuffer, FG_RENDER_TARGET);
+
+	p = fg_add_pass(fg, "ui", NULL, NULL);
+	fg_read(fg, p, backbuffer, FG_RENDER_TARGET);
+	fg_write(fg, p, backbuffer, FG_RENDER_TARGET);
+}
+
+// lots of small passes, each writing one transient and reading a few recent
+// ones, for the cost of compiling per frame
+static void declare_big_frame(frame_graph *fg, unsigned int passes) {
+	static const GLenum targetFormats[] = { GL_RGBA8, GL_RGBA16F, GL_R8 };
+	unsigned int seed = 12345;
+	unsigned int backbuffer = fg_import_texture(fg, "backbuffer", 0, 1920, 1080, GL_RGBA8);
+	std::vector<unsigned int> made;
+	for (unsigned int i = 0; i < passes; i++) {
+		unsigned int p = fg_add_pass(fg, "pass", NULL, NULL);
+		unsigned int inputs = made.empty() ? 0 : 1 + bench_random_u32(&seed) % 3;
+		for (unsigned int k = 0; k < inputs; k++) {
+			unsigned int back = 1 + bench_random_u32(&seed) % (made.size() < 8 ? (unsigned int) made.size() : 8);
+			fg_read(fg, p, made[made.size() - back], FG_SAMPLED);
+		}
+		if (i + 1 == passes) {
+			fg_write(fg, p, backbuffer, FG_RENDER_TARGET);
+			break;
+		}
+		unsigned int size = 256 << (bench_random_u32(&seed) % 3);
+		bool compute = bench_random_u32(&seed) % 4 == 0;
+		unsigned int r = compute ? fg_create_buffer(fg, "buffer", size * 64) :
+			fg_create_texture(fg, "target", size, size, targetFormats[bench_random_u32(&seed) % 3]);
+		fg_write(fg, p, r, compute ? FG_STORAGE_BUFFER : FG_RENDER_TARGET);
+		made.push_back(r);
+	}
+}
+
+void frame_graph_bench() {
+	frame_graph fg;
+	printf("frame graph: sample deferred frame, compiled on the CPU\n");
+	declare_sample_frame(&fg);
+	frame_graph_compile(&fg);
+	frame_graph_print(fg);
+
+	const unsigned int sizes[] = { 100, 1000 };
+	for (int s = 0; s < 2; s++) {
+		const int frames = sizes[s] == 100 ? 2000 : 200;
+		double declareMs = 0.0, compileMs = 0.0;
+		for (int f = 0; f < frames; f++) {
+			double start = bench_now_ms();
+			frame_graph_reset(&fg);
+			declare_big_frame(&fg, sizes[s]);
+			double declared = bench_now_ms();
+			frame_graph_compile(&fg);
+			compileMs += bench_now_ms() - declared;
+			declareMs += declared - start;
+		}
+		printf("  %4u passes: declare %.3f ms, compile %.3f ms per frame (%u kept, %u barriers, %.1f MB -> %.1f MB)\n",
+			sizes[s], declareMs / frames, compileMs / frames, fg.stats.passes, fg.stats.barriers,
+			fg.stats.transientBytes / (1024.0 * 1024.0), fg.stats.physicalBytes / (1024.0 * 1024.0));
+	}
+}
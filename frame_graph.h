@@ -0,0 +1,144 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "glad/glad.h"
+
+// frame graph. every frame the passes get declared along with what they read
+// and write, then frame_graph_compile works out the rest on the CPU only:
+//   - culls passes nothing visible depends on
+//   - orders the rest so every read comes after the write it needs
+//   - figures out where glMemoryBarrier is needed (after image / SSBO
+//     stores, which GL doesn't track for you) and with which bits
+//   - gives transient resources whose lifetimes don't overlap the same GL
+//     object, which is as close to memory aliasing as plain GL gets
+// frame_graph_execute then makes / reuses the GL objects and runs the passes.
+// compile never touches GL, so the graph can be checked without a context
+// (frame_graph_print, and the microbench does exactly that)
+
+#define FG_NONE 0xffffffffu
+
+enum fg_kind {
+	FG_TEXTURE, // 2D, single sample
+	FG_BUFFER,
+};
+
+struct fg_resource_desc {
+	fg_kind kind;
+	int width, height; // textures
+	GLenum format; // sized internal format, textures
+	GLsizeiptr size; // bytes, buffers
+};
+
+// how a pass touches a resource. decides the barrier bits, and the storage
+// ones are the writes GL doesn't synchronize on its own
+enum fg_usage {
+	FG_RENDER_TARGET,
+	FG_SAMPLED,
+	FG_STORAGE_IMAGE,
+	FG_STORAGE_BUFFER,
+	FG_VERTEX_BUFFER,
+	FG_INDEX_BUFFER,
+	FG_INDIRECT_BUFFER,
+	FG_UNIFORM_BUFFER,
+	FG_TRANSFER, // glReadPixels / glCopy* / glBufferSubData and friends
+};
+
+struct fg_access {
+	unsigned int resource;
+	fg_usage usage;
+};
+
+struct frame_graph;
+typedef void (*fg_execute_fn)(const frame_graph &fg, void *user);
+
+struct fg_pass {
+	const char *name;
+	fg_execute_fn execute;
+	void *user;
+	std::vector<fg_access> reads;
+	std::vector<fg_access> writes;
+	bool sideEffect; // never culled
+
+	// filled in by compile
+	bool culled;
+	GLbitfield barrier; // glMemoryBarrier before the pass, 0 for none
+};
+
+struct fg_resource {
+	const char *name;
+	fg_resource_desc desc;
+	bool imported; // lives outside the graph, writing it counts as a side effect
+	GLuint importedName;
+
+	// filled in by compile, positions in frame_graph::order
+	unsigned int firstUse, lastUse;
+	unsigned int physical; // index into frame_graph::physical, FG_NONE if unused or imported
+};
+
+// a real GL object, shared by every transient resource mapped onto it
+struct fg_physical {
+	fg_resource_desc desc; // what this frame needs, buffers grow to the biggest user
+	fg_resource_desc allocated; // what the GL object was made with
+	GLuint name; // 0 until execute creates it
+	bool used; // anything mapped onto it this frame
+};
+
+struct frame_graph_stats {
+	unsigned int passes;
+	unsigned int culled;
+	unsigned int barriers;
+	size_t transientBytes; // every live transient resource with its own memory
+	size_t physicalBytes; // what the aliased objects actually take
+};
+
+struct frame_graph {
+	std::vector<fg_resource> resources;
+	std::vector<fg_pass> passes;
+	std::vector<unsigned int> order; // pass indices to run, after compile
+
+	// kept between frames, so the GL objects get reused when the graph doesn't change shape
+	std::vector<fg_physical> physical;
+
+	frame_graph_stats stats;
+};
+
+// drops the passes and resources, keeps the physical objects around
+void frame_graph_reset(frame_graph *fg);
+
+unsigned int fg_create_texture(frame_graph *fg, const char *name, int width, int height, GLenum format);
+unsigned int fg_create_buffer(frame_graph *fg, const char *name, GLsizeiptr size);
+
+// the default framebuffer is texture 0
+unsigned int fg_import_texture(frame_graph *fg, const char *name, GLuint texture, int width, int height, GLenum format);
+unsigned int fg_import_buffer(frame_graph *fg, const char *name, GLuint buffer, GLsizeiptr size);
+
+// names have to stay around until the graph is reset (string literals)
+unsigned int fg_add_pass(frame_graph *fg, const char *name, fg_execute_fn execute, void *user);
+void fg_read(frame_graph *fg, unsigned int pass, unsigned int resource, fg_usage usage);
+void fg_write(frame_graph *fg, unsigned int pass, unsigned int resource, fg_usage usage);
+
+// for passes whose output leaves the graph some other way (readbacks, queries)
+void fg_side_effect(frame_graph *fg, unsigned int pass);
+
+// CPU only
+void frame_graph_compile(frame_graph *fg);
+
+// needs a context. (re)creates physical objects whose description changed,
+// then runs the passes in order with their barriers
+void frame_graph_execute(frame_graph *fg);
+
+// the GL texture / buffer behind a resource, valid inside execute callbacks
+GLuint fg_gl_name(const frame_graph &fg, unsigned int resource);
+
+void frame_graph_destroy(frame_graph *fg);
+
+// order, barriers, culled passes and which resources share memory
+void frame_graph_print(const frame_graph &fg);
+
+void frame_graph_bench();
+
+#endif
@@ -0,0 +1,169 @@
+#include "frame_pacing.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "glfw/include/GLFW/glfw3.h"
+
+#include "microbench.h"
+
+// sleep_for can overshoot by a scheduler tick or so, sleep until this far
+// before the deadline and spin the rest
+static const double spinMarginMs = 2.0;
+
+bool parse_vsync_mode(const char *name, vsync_mode *mode) {
+	if (strcmp(name, "off") == 0) {
+		*mode = VSYNC_OFF;
+	} else if (strcmp(name, "on") == 0) {
+		*mode = VSYNC_ON;
+	} else if (strcmp(name, "adaptive") == 0) {
+		*mode = VSYNC_ADAPTIVE;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static void reset_stats(frame_pacer *pacer) {
+	pacer->swapLatencySum = 0.0;
+	pacer->gpuLatencySum = 0.0;
+	pacer->gpuLatencyMax = 0.0;
+	pacer->swapSamples = 0;
+	pacer->gpuSamples = 0;
+	pacer->waitMs = 0.0;
+}
+
+vsync_mode frame_pacer_init(frame_pacer *pacer, vsync_mode vsync, double targetFps, unsigned int maxInFlight) {
+	// headless renders through its own EGL / OSMesa context, glfw has no
+	// current context then (and there's nothing to swap), so leave it alone
+	if (glfwGetCurrentContext()) {
+		if (vsync == VSYNC_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+			&& !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+			printf("frame pacing: no swap_control_tear, using vsync on instead of adaptive\n");
+			vsync = VSYNC_ON;
+		}
+
+		// negative intervals are how swap_control_tear spells adaptive
+		glfwSwapInterval(vsync == VSYNC_OFF ? 0 : vsync == VSYNC_ON ? 1 : -1);
+	}
+
+	if (maxInFlight < 1) {
+		maxInFlight = 1;
+	}
+	if (maxInFlight > FRAME_PACER_MAX_IN_FLIGHT) {
+		maxInFlight = FRAME_PACER_MAX_IN_FLIGHT;
+	}
+
+	pacer->vsync = vsync;
+	pacer->targetFrameMs = targetFps > 0.0 ? 1000.0 / targetFps : 0.0;
+	pacer->maxInFlight = maxInFlight;
+	pacer->head = 0;
+	pacer->inFlight = 0;
+	pacer->nextFrameMs = bench_now_ms();
+	pacer->inputMs = pacer->nextFrameMs;
+	reset_stats(pacer);
+	return vsync;
+}
+
+// the oldest fence is at head - inFlight
+static unsigned int oldest_fence(const frame_pacer *pacer) {
+	return (pacer->head + FRAME_PACER_MAX_IN_FLIGHT - pacer->inFlight) % FRAME_PACER_MAX_IN_FLIGHT;
+}
+
+static void retire_oldest(frame_pacer *pacer) {
+	unsigned int i = oldest_fence(pacer);
+	double latency = bench_now_ms() - pacer->fenceInputMs[i];
+	pacer->gpuLatencySum += latency;
+	if (latency > pacer->gpuLatencyMax) {
+		pacer->gpuLatencyMax = latency;
+	}
+	pacer->gpuSamples++;
+
+	glDeleteSync(pacer->fences[i]);
+	pacer->fences[i] = 0;
+	pacer->inFlight--;
+}
+
+void frame_pacer_begin_frame(frame_pacer *pacer) {
+	double start = bench_now_ms();
+
+	// retire whatever already finished without waiting, so the latency is
+	// measured close to when the GPU got there and not when we next blocked
+	while (pacer->inFlight > 0) {
+		GLenum status = glClientWaitSync(pacer->fences[oldest_fence(pacer)], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			break;
+		}
+		retire_oldest(pacer);
+	}
+
+	while (pacer->inFlight >= pacer->maxInFlight) {
+		// flush so the fence is guaranteed to get to the GPU, otherwise this could wait forever
+		GLenum status = glClientWaitSync(pacer->fences[oldest_fence(pacer)], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		if (status == GL_WAIT_FAILED) {
+			printf("frame pacing: glClientWaitSync failed\n");
+		}
+		retire_oldest(pacer);
+	}
+
+	pacer->waitMs += bench_now_ms() - start;
+	pacer->inputMs = bench_now_ms();
+}
+
+static void sleep_until(double deadlineMs) {
+	double now = bench_now_ms();
+	if (deadlineMs - now > spinMarginMs) {
+		std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(deadlineMs - now - spinMarginMs));
+	}
+	while (bench_now_ms() < deadlineMs) {
+		std::this_thread::yield();
+	}
+}
+
+void frame_pacer_end_frame(frame_pacer *pacer) {
+	double now = bench_now_ms();
+	pacer->swapLatencySum += now - pacer->inputMs;
+	pacer->swapSamples++;
+
+	pacer->fences[pacer->head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pacer->fenceInputMs[pacer->head] = pacer->inputMs;
+	pacer->head = (pacer->head + 1) % FRAME_PACER_MAX_IN_FLIGHT;
+	pacer->inFlight++;
+
+	if (pacer->targetFrameMs <= 0.0) {
+		return;
+	}
+
+	// fixed deadlines instead of "now + frame time" so the error doesn't add up,
+	// but don't try to catch up after a hitch, just start counting again
+	pacer->nextFrameMs += pacer->targetFrameMs;
+	if (pacer->nextFrameMs < now - pacer->targetFrameMs) {
+		pacer->nextFrameMs = now;
+		return;
+	}
+
+	sleep_until(pacer->nextFrameMs);
+	pacer->waitMs += bench_now_ms() - now;
+}
+
+void frame_pacer_report(frame_pacer *pacer, unsigned int frames) {
+	const char *modes[] = { "off", "on", "adaptive" };
+	printf("frame pacing (vsync %s, %u in flight): input->swap %.2f ms, input->GPU done %.2f ms (max %.2f), waited %.2f ms/frame\n",
+		modes[pacer->vsync], pacer->maxInFlight,
+		pacer->swapSamples > 0 ? pacer->swapLatencySum / pacer->swapSamples : 0.0,
+		pacer->gpuSamples > 0 ? pacer->gpuLatencySum / pacer->gpuSamples : 0.0,
+		pacer->gpuLatencyMax, frames > 0 ? pacer->waitMs / frames : 0.0);
+	reset_stats(pacer);
+}
+
+void frame_pacer_destroy(frame_pacer *pacer) {
+	while (pacer->inFlight > 0) {
+		unsigned int i = oldest_fence(pacer);
+		glDeleteSync(pacer->fences[i]);
+		pacer->fences[i] = 0;
+		pacer->inFlight--;
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include "glad/glad.h"
+
+#define FRAME_PACER_MAX_IN_FLIGHT 8
+
+enum vsync_mode {
+	VSYNC_OFF,
+	VSYNC_ON,
+	VSYNC_ADAPTIVE, // tears instead of waiting a whole extra interval when a frame is late
+};
+
+struct frame_pacer {
+	vsync_mode vsync;
+	double targetFrameMs; // 0 means no limiter
+	unsigned int maxInFlight;
+
+	// one fence per frame still on the GPU, oldest at tail
+	GLsync fences[FRAME_PACER_MAX_IN_FLIGHT];
+	double fenceInputMs[FRAME_PACER_MAX_IN_FLIGHT];
+	unsigned int head;
+	unsigned int inFlight;
+
+	double nextFrameMs;
+	double inputMs; // when this frame's input was sampled
+
+	// latency from sampling input to swap returning, and to the GPU finishing the frame
+	double swapLatencySum;
+	double gpuLatencySum;
+	double gpuLatencyMax;
+	unsigned int swapSamples;
+	unsigned int gpuSamples;
+	double waitMs; // time spent blocked on fences + the limiter
+};
+
+bool parse_vsync_mode(const char *name, vsync_mode *mode);
+
+// needs a current context. returns the mode that was actually applied,
+// adaptive falls back to on when the swap_control_tear extension is missing
+vsync_mode frame_pacer_init(frame_pacer *pacer, vsync_mode vsync, double targetFps, unsigned int maxInFlight);
+
+// call right before sampling input. blocks while maxInFlight frames are still
+// queued on the GPU so the CPU can't run further ahead than that
+void frame_pacer_begin_frame(frame_pacer *pacer);
+
+// call right after glfwSwapBuffers. fences the frame, then sleeps + spins
+// until the next target frame time
+void frame_pacer_end_frame(frame_pacer *pacer);
+
+// prints averages since the last report and resets them
+void frame_pacer_report(frame_pacer *pacer, unsigned int frames);
+
+void frame_pacer_destroy(frame_pacer *pacer);
+
+#endif
@@ -0,0 +1,49 @@
+#include "frustum.h"
+
+#include <math.h>
+
+#include "vecmath.h"
+
+frustum frustum_from_matrix(const float m[16]) {
+	frustum f;
+
+	// row i of a column major matrix is m[i], m[i + 4], m[i + 8], m[i + 12]
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < 4; k++) {
+			f.planes[i * 2 + 0][k] = m[k * 4 + 3] + m[k * 4 + i];
+			f.planes[i * 2 + 1][k] = m[k * 4 + 3] - m[k * 4 + i];
+		}
+	}
+
+	for (int p = 0; p < 6; p++) {
+		float len = sqrtf(f.planes[p][0] * f.planes[p][0] + f.planes[p][1] * f.planes[p][1] + f.planes[p][2] * f.planes[p][2]);
+		if (len > 0.0f) {
+			f.planes[p][0] /= len;
+			f.planes[p][1] /= len;
+			f.planes[p][2] /= len;
+			f.planes[p][3] /= len;
+		}
+	}
+
+	return f;
+}
+
+bool frustum_test_sphere(const frustum &f, const float center[3], float radius) {
+	for (int p = 0; p < 6; p++) {
+		const float *pl = f.planes[p];
+		if (pl[0] * center[0] + pl[1] * center[1] + pl[2] * center[2] + pl[3] < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void frustum_view_projection(const float eye[3], float fovY, float aspect, float zNear, float zFar, float out[16]) {
+	float proj[16], view[16];
+	mat4_perspective(fovY, aspect, zNear, zFar, proj);
+	mat4_identity(view);
+	view[12] = -eye[0];
+	view[13] = -eye[1];
+	view[14] = -eye[2];
+	mat4_mul(proj, view, out);
+}
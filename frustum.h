@@ -0,0 +1,21 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+// six planes (left, right, bottom, top, near, far) as a, b, c, d with the
+// normals pointing into the frustum, so inside means a*x + b*y + c*z + d >= 0
+struct frustum {
+	float planes[6][4];
+};
+
+// pull the planes out of a column major (OpenGL style) view-projection matrix
+// (Gribb & Hartmann), planes come out normalized
+frustum frustum_from_matrix(const float m[16]);
+
+// false only if the sphere is completely outside one of the planes
+bool frustum_test_sphere(const frustum &f, const float center[3], float radius);
+
+// column major perspective * translate(-eye), camera looking down -z.
+// enough of a camera for the benchmarks
+void frustum_view_projection(const float eye[3], float fovY, float aspect, float zNear, float zFar, float out[16]);
+
+#endif
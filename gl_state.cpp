@@ -0,0 +1,313 @@
+#include "gl_state.h"
+
+#include <string.h>
+
+// "we don't know what's bound", never equal to a real GL name or enum
+#define GLS_UNKNOWN 0xffffffffu
+
+#define GLS_TEXTURE_UNITS 32
+#define GLS_INDEXED_SLOTS 16
+
+static const GLenum bufferTargets[] = {
+	GL_ARRAY_BUFFER,
+	GL_ELEMENT_ARRAY_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER,
+	GL_SHADER_STORAGE_BUFFER,
+	GL_UNIFORM_BUFFER,
+	GL_PIXEL_PACK_BUFFER,
+	GL_PIXEL_UNPACK_BUFFER,
+	GL_COPY_READ_BUFFER,
+	GL_COPY_WRITE_BUFFER,
+};
+#define GLS_BUFFER_TARGETS (sizeof(bufferTargets) / sizeof(bufferTargets[0]))
+
+static const GLenum textureTargets[] = {
+	GL_TEXTURE_2D,
+	GL_TEXTURE_2D_ARRAY,
+	GL_TEXTURE_2D_MULTISAMPLE,
+	GL_TEXTURE_CUBE_MAP,
+	GL_TEXTURE_3D,
+};
+#define GLS_TEXTURE_TARGETS (sizeof(textureTargets) / sizeof(textureTargets[0]))
+
+static const GLenum trackedCapabilities[] = {
+	GL_BLEND,
+	GL_DEPTH_TEST,
+	GL_CULL_FACE,
+	GL_SCISSOR_TEST,
+	GL_STENCIL_TEST,
+};
+#define GLS_CAPABILITIES (sizeof(trackedCapabilities) / sizeof(trackedCapabilities[0]))
+
+struct gl_state_shadow {
+	unsigned int program;
+	unsigned int VAO;
+	unsigned int buffers[GLS_BUFFER_TARGETS];
+	unsigned int storageSlots[GLS_INDEXED_SLOTS];
+	unsigned int uniformSlots[GLS_INDEXED_SLOTS];
+	unsigned int activeTexture;
+	unsigned int textures[GLS_TEXTURE_UNITS][GLS_TEXTURE_TARGETS];
+	unsigned int capabilities[GLS_CAPABILITIES]; // 0, 1 or unknown
+	unsigned int blendSrc, blendDst;
+	unsigned int depthFunc;
+	unsigned int depthMask;
+	int viewport[4];
+	bool viewportKnown;
+	float clearColor[4];
+	bool clearColorKnown;
+};
+
+static gl_state_shadow shadow;
+static gl_state_stats stats;
+
+void gl_state_invalidate() {
+	// every field is an unsigned name / enum so all 0xff bytes = all unknown
+	memset(&shadow, 0xff, sizeof(shadow));
+	shadow.viewportKnown = false;
+	shadow.clearColorKnown = false;
+}
+
+gl_state_stats gl_state_end_frame() {
+	gl_state_stats s = stats;
+	memset(&stats, 0, sizeof(stats));
+	return s;
+}
+
+// true = go to the driver. a failed compare means the value changed
+static bool gls_update(unsigned int *cached, unsigned int value, gl_state_kind kind) {
+	if (*cached == value) {
+		stats.filtered++;
+		stats.filteredByKind[kind]++;
+		return false;
+	}
+	*cached = value;
+	stats.forwarded++;
+	return true;
+}
+
+static int buffer_slot(GLenum target) {
+	for (unsigned int i = 0; i < GLS_BUFFER_TARGETS; i++) {
+		if (bufferTargets[i] == target) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+static int texture_slot(GLenum target) {
+	for (unsigned int i = 0; i < GLS_TEXTURE_TARGETS; i++) {
+		if (textureTargets[i] == target) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+static int capability_slot(GLenum cap) {
+	for (unsigned int i = 0; i < GLS_CAPABILITIES; i++) {
+		if (trackedCapabilities[i] == cap) {
+			return (int) i;
+		}
+	}
+	return -1;
+}
+
+void gls_use_program(unsigned int program) {
+	if (gls_update(&shadow.program, program, GLS_PROGRAM)) {
+		glUseProgram(program);
+	}
+}
+
+void gls_bind_vertex_array(unsigned int VAO) {
+	if (gls_update(&shadow.VAO, VAO, GLS_VAO)) {
+		glBindVertexArray(VAO);
+		// every VAO remembers its own element buffer
+		shadow.buffers[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = GLS_UNKNOWN;
+	}
+}
+
+void gls_bind_buffer(GLenum target, unsigned int buffer) {
+	int slot = buffer_slot(target);
+	if (slot < 0) {
+		stats.forwarded++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (gls_update(&shadow.buffers[slot], buffer, GLS_BUFFER)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void gls_bind_buffer_base(GLenum target, unsigned int index, unsigned int buffer) {
+	unsigned int *slots = NULL;
+	if (target == GL_SHADER_STORAGE_BUFFER) {
+		slots = shadow.storageSlots;
+	} else if (target == GL_UNIFORM_BUFFER) {
+		slots = shadow.uniformSlots;
+	}
+
+	if (slots == NULL || index >= GLS_INDEXED_SLOTS) {
+		stats.forwarded++;
+		glBindBufferBase(target, index, buffer);
+		int slot = buffer_slot(target);
+		if (slot >= 0) {
+			shadow.buffers[slot] = buffer;
+		}
+		return;
+	}
+
+	if (gls_update(&slots[index], buffer, GLS_BUFFER)) {
+		glBindBufferBase(target, index, buffer);
+		// binding to an indexed point binds the generic point too
+		shadow.buffers[buffer_slot(target)] = buffer;
+	}
+}
+
+void gls_active_texture(GLenum unit) {
+	if (gls_update(&shadow.activeTexture, unit, GLS_TEXTURE)) {
+		glActiveTexture(unit);
+	}
+}
+
+void gls_bind_texture(GLenum target, unsigned int texture) {
+	int slot = texture_slot(target);
+	unsigned int unit = shadow.activeTexture - GL_TEXTURE0;
+
+	// unknown unit or target, can't track it
+	if (slot < 0 || shadow.activeTexture == GLS_UNKNOWN || unit >= GLS_TEXTURE_UNITS) {
+		stats.forwarded++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (gls_update(&shadow.textures[unit][slot], texture, GLS_TEXTURE)) {
+		glBindTexture(target, texture);
+	}
+}
+
+static void gls_set_capability(GLenum cap, unsigned int on) {
+	int slot = capability_slot(cap);
+	if (slot >= 0 && !gls_update(&shadow.capabilities[slot], on, GLS_CAPABILITY)) {
+		return;
+	}
+	if (slot < 0) {
+		stats.forwarded++;
+	}
+	if (on) {
+		glEnable(cap);
+	} else {
+		glDisable(cap);
+	}
+}
+
+void gls_enable(GLenum cap) {
+	gls_set_capability(cap, 1);
+}
+
+void gls_disable(GLenum cap) {
+	gls_set_capability(cap, 0);
+}
+
+void gls_blend_func(GLenum src, GLenum dst) {
+	if (shadow.blendSrc == src && shadow.blendDst == dst) {
+		stats.filtered++;
+		stats.filteredByKind[GLS_BLEND_DEPTH]++;
+		return;
+	}
+	shadow.blendSrc = src;
+	shadow.blendDst = dst;
+	stats.forwarded++;
+	glBlendFunc(src, dst);
+}
+
+void gls_depth_func(GLenum func) {
+	if (gls_update(&shadow.depthFunc, func, GLS_BLEND_DEPTH)) {
+		glDepthFunc(func);
+	}
+}
+
+void gls_depth_mask(bool write) {
+	if (gls_update(&shadow.depthMask, write ? 1 : 0, GLS_BLEND_DEPTH)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void gls_viewport(int x, int y, int width, int height) {
+	if (shadow.viewportKnown && shadow.viewport[0] == x && shadow.viewport[1] == y
+		&& shadow.viewport[2] == width && shadow.viewport[3] == height) {
+		stats.filtered++;
+		stats.filteredByKind[GLS_VIEWPORT]++;
+		return;
+	}
+	shadow.viewport[0] = x;
+	shadow.viewport[1] = y;
+	shadow.viewport[2] = width;
+	shadow.viewport[3] = height;
+	shadow.viewportKnown = true;
+	stats.forwarded++;
+	glViewport(x, y, width, height);
+}
+
+void gls_clear_color(float r, float g, float b, float a) {
+	if (shadow.clearColorKnown && shadow.clearColor[0] == r && shadow.clearColor[1] == g
+		&& shadow.clearColor[2] == b && shadow.clearColor[3] == a) {
+		stats.filtered++;
+		stats.filteredByKind[GLS_CLEAR_COLOR]++;
+		return;
+	}
+	shadow.clearColor[0] = r;
+	shadow.clearColor[1] = g;
+	shadow.clearColor[2] = b;
+	shadow.clearColor[3] = a;
+	shadow.clearColorKnown = true;
+	stats.forwarded++;
+	glClearColor(r, g, b, a);
+}
+
+void gls_delete_vertex_arrays(int count, const unsigned int *VAOs) {
+	for (int i = 0; i < count; i++) {
+		if (VAOs[i] != 0 && shadow.VAO == VAOs[i]) {
+			shadow.VAO = 0;
+			shadow.buffers[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = GLS_UNKNOWN;
+		}
+	}
+	glDeleteVertexArrays(count, VAOs);
+}
+
+void gls_delete_buffers(int count, const unsigned int *buffers) {
+	for (int i = 0; i < count; i++) {
+		if (buffers[i] == 0) {
+			continue;
+		}
+		for (unsigned int t = 0; t < GLS_BUFFER_TARGETS; t++) {
+			if (shadow.buffers[t] == buffers[i]) {
+				shadow.buffers[t] = 0;
+			}
+		}
+		// indexed bindings keep pointing at the dead name in some drivers, just forget them
+		for (unsigned int s = 0; s < GLS_INDEXED_SLOTS; s++) {
+			if (shadow.storageSlots[s] == buffers[i]) {
+				shadow.storageSlots[s] = GLS_UNKNOWN;
+			}
+			if (shadow.uniformSlots[s] == buffers[i]) {
+				shadow.uniformSlots[s] = GLS_UNKNOWN;
+			}
+		}
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void gls_delete_textures(int count, const unsigned int *textures) {
+	for (int i = 0; i < count; i++) {
+		if (textures[i] == 0) {
+			continue;
+		}
+		for (unsigned int u = 0; u < GLS_TEXTURE_UNITS; u++) {
+			for (unsigned int t = 0; t < GLS_TEXTURE_TARGETS; t++) {
+				if (shadow.textures[u][t] == textures[i]) {
+					shadow.textures[u][t] = 0;
+				}
+			}
+		}
+	}
+	glDeleteTextures(count, textures);
+}
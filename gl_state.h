@@ -0,0 +1,60 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "glad/glad.h"
+
+// shadow copy of the GL state we touch every frame. the gls_* calls compare
+// against it and only go to the driver when the value actually changes.
+// everything that binds / enables the tracked state has to go through here,
+// a direct glBindVertexArray behind its back leaves the shadow copy wrong
+// (call gl_state_invalidate() after code like that)
+
+enum gl_state_kind {
+	GLS_PROGRAM,
+	GLS_VAO,
+	GLS_BUFFER,
+	GLS_TEXTURE,
+	GLS_CAPABILITY, // glEnable / glDisable
+	GLS_BLEND_DEPTH, // blend func, depth func, depth mask
+	GLS_VIEWPORT,
+	GLS_CLEAR_COLOR,
+	GLS_KIND_COUNT
+};
+
+struct gl_state_stats {
+	unsigned int forwarded; // calls that reached the driver
+	unsigned int filtered; // calls we dropped because nothing would have changed
+	unsigned int filteredByKind[GLS_KIND_COUNT];
+};
+
+// forget everything, the next call of every kind goes through. needed once
+// after the context is created and whenever something bypassed the cache
+void gl_state_invalidate();
+
+// counters since the last call, then reset them. call once per frame
+gl_state_stats gl_state_end_frame();
+
+void gls_use_program(unsigned int program);
+void gls_bind_vertex_array(unsigned int VAO);
+
+// GL_ELEMENT_ARRAY_BUFFER is part of the VAO so it's forgotten whenever the VAO changes
+void gls_bind_buffer(GLenum target, unsigned int buffer);
+void gls_bind_buffer_base(GLenum target, unsigned int index, unsigned int buffer);
+
+void gls_active_texture(GLenum unit); // GL_TEXTURE0 + n
+void gls_bind_texture(GLenum target, unsigned int texture); // on the active unit
+
+void gls_enable(GLenum cap);
+void gls_disable(GLenum cap);
+void gls_blend_func(GLenum src, GLenum dst);
+void gls_depth_func(GLenum func);
+void gls_depth_mask(bool write);
+void gls_viewport(int x, int y, int width, int height);
+void gls_clear_color(float r, float g, float b, float a);
+
+// deleting a bound object silently unbinds it in GL, these keep the shadow in sync
+void gls_delete_vertex_arrays(int count, const unsigned int *VAOs);
+void gls_delete_buffers(int count, const unsigned int *buffers);
+void gls_delete_textures(int count, const unsigned int *textures);
+
+#endif
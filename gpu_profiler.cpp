@@ -0,0 +1,244 @@
+#include "gpu_profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "microbench.h"
+
+// the GPU and CPU clocks drift apart a little, line them up again this often
+#define GPU_PROFILER_CALIBRATE_FRAMES 120
+
+// glGetInteger64v(GL_TIMESTAMP) is the GPU's "now" without waiting on anything
+static void calibrate(gpu_profiler *p) {
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	p->gpuToCpuMs = bench_now_ms() - gpuNow / 1000000.0;
+}
+
+void gpu_profiler_init(gpu_profiler *p, unsigned int maxEvents) {
+	memset(p->frames, 0, sizeof(p->frames));
+	for (int i = 0; i < GPU_PROFILER_FRAMES; i++) {
+		glGenQueries(GPU_PROFILER_MAX_SCOPES * 2, p->frames[i].queries);
+	}
+	p->current = 0;
+	p->frameNumber = 0;
+	p->recording = false;
+	p->depth = 0;
+	p->skippedDepth = 0;
+	p->events.clear();
+	p->maxEvents = maxEvents;
+	p->reportedFrame = 0;
+	p->droppedFrames = 0;
+	calibrate(p);
+}
+
+static void add_event(gpu_profiler *p, const char *name, unsigned int frame, unsigned int depth,
+	bool gpu, double beginMs, double endMs) {
+	profile_event e = { name, frame, depth, gpu, beginMs, endMs };
+	p->events.push_back(e);
+}
+
+// queries finish in order, so once the last one issued is there they all are.
+// that's the frame's own end, written after every scope inside it, not the end
+// of whichever scope happened to get the highest index
+static bool try_resolve(gpu_profiler *p, gpu_profiler_frame *f) {
+	if (f->scopeCount == 0) {
+		f->pending = false;
+		return true;
+	}
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(f->queries[f->lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+
+	for (unsigned int i = 0; i < f->scopeCount; i++) {
+		const gpu_profiler_scope &s = f->scopes[i];
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(f->queries[i * 2], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(f->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+		add_event(p, s.name, f->frameNumber, s.depth, false, s.cpuBeginMs, s.cpuEndMs);
+		add_event(p, s.name, f->frameNumber, s.depth, true,
+			begin / 1000000.0 + p->gpuToCpuMs, end / 1000000.0 + p->gpuToCpuMs);
+	}
+	f->pending = false;
+
+	// drop the oldest half at once rather than shifting on every frame
+	if (p->events.size() > p->maxEvents) {
+		p->events.erase(p->events.begin(), p->events.begin() + p->events.size() / 2);
+	}
+	return true;
+}
+
+void gpu_profiler_begin_frame(gpu_profiler *p) {
+	// oldest first so the timeline stays in order. current is the next slot to
+	// write, so if it is still pending it is the oldest one out
+	for (int i = 0; i < GPU_PROFILER_FRAMES; i++) {
+		gpu_profiler_frame *f = &p->frames[(p->current + i) % GPU_PROFILER_FRAMES];
+		if (f->pending && !try_resolve(p, f)) {
+			break;
+		}
+	}
+
+	if (p->frameNumber % GPU_PROFILER_CALIBRATE_FRAMES == 0) {
+		calibrate(p);
+	}
+
+	gpu_profiler_frame *f = &p->frames[p->current];
+	p->recording = !f->pending;
+	if (p->recording) {
+		f->scopeCount = 0;
+		f->lastQuery = 0;
+		f->frameNumber = p->frameNumber;
+	} else {
+		// the slot still belongs to a frame waiting on the GPU, leave it alone
+		p->droppedFrames++;
+	}
+	p->depth = 0;
+	p->skippedDepth = 0;
+
+	gpu_profiler_push(p, "frame");
+}
+
+void gpu_profiler_push(gpu_profiler *p, const char *name) {
+	if (p->depth == GPU_PROFILER_MAX_DEPTH) {
+		p->skippedDepth++;
+		return;
+	}
+
+	gpu_profiler_frame *f = &p->frames[p->current];
+	if (!p->recording || f->scopeCount == GPU_PROFILER_MAX_SCOPES) {
+		p->stack[p->depth++] = GPU_PROFILER_MAX_SCOPES;
+		return;
+	}
+
+	unsigned int i = f->scopeCount++;
+	f->scopes[i].name = name;
+	f->scopes[i].depth = p->depth;
+	f->scopes[i].cpuBeginMs = bench_now_ms();
+	glQueryCounter(f->queries[i * 2], GL_TIMESTAMP);
+	p->stack[p->depth++] = i;
+}
+
+void gpu_profiler_pop(gpu_profiler *p) {
+	if (p->skippedDepth > 0) {
+		p->skippedDepth--;
+		return;
+	}
+	if (p->depth == 0) {
+		return;
+	}
+
+	unsigned int i = p->stack[--p->depth];
+	if (i == GPU_PROFILER_MAX_SCOPES) {
+		return;
+	}
+	gpu_profiler_frame *f = &p->frames[p->current];
+	glQueryCounter(f->queries[i * 2 + 1], GL_TIMESTAMP);
+	f->lastQuery = i * 2 + 1;
+	f->scopes[i].cpuEndMs = bench_now_ms();
+}
+
+void gpu_profiler_end_frame(gpu_profiler *p) {
+	// anything left open gets closed along with the frame
+	while (p->depth > 0 || p->skippedDepth > 0) {
+		gpu_profiler_pop(p);
+	}
+
+	if (p->recording) {
+		p->frames[p->current].pending = true;
+		p->current = (p->current + 1) % GPU_PROFILER_FRAMES;
+	}
+	p->frameNumber++;
+}
+
+struct scope_total {
+	const char *name;
+	unsigned int depth;
+	double gpuMs, cpuMs;
+};
+
+void gpu_profiler_report(gpu_profiler *p) {
+	scope_total totals[GPU_PROFILER_MAX_SCOPES];
+	unsigned int totalCount = 0;
+	unsigned int frames = 0, lastFrame = p->reportedFrame;
+
+	for (size_t e = 0; e < p->events.size(); e++) {
+		const profile_event &ev = p->events[e];
+		if (ev.frame < p->reportedFrame) {
+			continue;
+		}
+		if (!ev.gpu && ev.depth == 0) {
+			frames++;
+		}
+		lastFrame = ev.frame + 1 > lastFrame ? ev.frame + 1 : lastFrame;
+
+		unsigned int t = 0;
+		while (t < totalCount && totals[t].name != ev.name) {
+			t++;
+		}
+		if (t == totalCount) {
+			if (totalCount == GPU_PROFILER_MAX_SCOPES) {
+				continue;
+			}
+			scope_total empty = { ev.name, ev.depth, 0.0, 0.0 };
+			totals[totalCount++] = empty;
+		}
+		if (ev.gpu) {
+			totals[t].gpuMs += ev.endMs - ev.beginMs;
+		} else {
+			totals[t].cpuMs += ev.endMs - ev.beginMs;
+		}
+	}
+	p->reportedFrame = lastFrame;
+	if (frames == 0) {
+		printf("gpu profile: no frames resolved yet\n");
+		return;
+	}
+
+	printf("gpu profile over %u frame(s), %u unmeasured because the query ring was full:\n", frames, p->droppedFrames);
+	for (unsigned int t = 0; t < totalCount; t++) {
+		printf("  %*s%-*s gpu %7.3f ms  cpu %7.3f ms\n", totals[t].depth * 2, "", 20 - totals[t].depth * 2, totals[t].name,
+			totals[t].gpuMs / frames, totals[t].cpuMs / frames);
+	}
+	p->droppedFrames = 0;
+}
+
+bool gpu_profiler_write_trace(const gpu_profiler *p, const char *path) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		printf("couldn't open %s for the trace\n", path);
+		return false;
+	}
+
+	// timestamps are microseconds, relative to the first event to keep them short
+	double originMs = p->events.empty() ? 0.0 : p->events[0].beginMs;
+	for (size_t e = 0; e < p->events.size(); e++) {
+		originMs = p->events[e].beginMs < originMs ? p->events[e].beginMs : originMs;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+	for (size_t e = 0; e < p->events.size(); e++) {
+		const profile_event &ev = p->events[e];
+		fprintf(file, ",\n{\"name\":");
+		json_write_string(file, ev.name);
+		fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"frame\":%u}}",
+			ev.gpu ? "gpu" : "cpu", (ev.beginMs - originMs) * 1000.0, (ev.endMs - ev.beginMs) * 1000.0,
+			ev.gpu ? 2 : 1, ev.frame);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("wrote %u profile events to %s\n", (unsigned int) p->events.size(), path);
+	return true;
+}
+
+void gpu_profiler_destroy(gpu_profiler *p) {
+	for (int i = 0; i < GPU_PROFILER_FRAMES; i++) {
+		glDeleteQueries(GPU_PROFILER_MAX_SCOPES * 2, p->frames[i].queries);
+	}
+	p->events.clear();
+}
@@ -0,0 +1,84 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vector>
+
+#include "glad/glad.h"
+
+// GPU timing per pass with timestamp queries (GL 3.3). every scope drops a
+// glQueryCounter(GL_TIMESTAMP) at its start and end, and each frame's queries
+// live in their own slot of a ring GPU_PROFILER_FRAMES deep. results are only
+// read once the GPU says they're there, a few frames later, so measuring never
+// stalls the pipeline. if the whole ring is still waiting the frame just goes
+// unmeasured. the CPU time of every scope is recorded next to it and both end
+// up on one timeline that can be written out for chrome://tracing / Perfetto
+
+#define GPU_PROFILER_FRAMES 4
+#define GPU_PROFILER_MAX_SCOPES 64
+#define GPU_PROFILER_MAX_DEPTH 8
+
+struct gpu_profiler_scope {
+	const char *name; // not copied, has to stay around (string literals)
+	unsigned int depth;
+	double cpuBeginMs, cpuEndMs;
+};
+
+struct gpu_profiler_frame {
+	GLuint queries[GPU_PROFILER_MAX_SCOPES * 2]; // begin, end per scope
+	gpu_profiler_scope scopes[GPU_PROFILER_MAX_SCOPES];
+	unsigned int scopeCount;
+	unsigned int lastQuery; // index of the last glQueryCounter issued this frame
+	unsigned int frameNumber;
+	bool pending; // queries issued, results not read back yet
+};
+
+// one scope on the combined timeline, GPU times already moved onto the CPU clock
+struct profile_event {
+	const char *name;
+	unsigned int frame;
+	unsigned int depth;
+	bool gpu;
+	double beginMs, endMs;
+};
+
+struct gpu_profiler {
+	gpu_profiler_frame frames[GPU_PROFILER_FRAMES];
+	unsigned int current;
+	unsigned int frameNumber;
+	bool recording; // false when the ring was full at the start of the frame
+
+	// scope index per open push, or GPU_PROFILER_MAX_SCOPES for ones that didn't get a slot
+	unsigned int stack[GPU_PROFILER_MAX_DEPTH];
+	unsigned int depth;
+	unsigned int skippedDepth; // pushes past GPU_PROFILER_MAX_DEPTH
+
+	double gpuToCpuMs; // GPU timestamp in ms + this = CPU clock (bench_now_ms)
+
+	std::vector<profile_event> events; // resolved, oldest first
+	unsigned int maxEvents;
+	unsigned int reportedFrame; // events up to this frame have been reported
+	unsigned int droppedFrames;
+};
+
+// needs a current context. keeps roughly the last maxEvents scopes (CPU + GPU)
+void gpu_profiler_init(gpu_profiler *p, unsigned int maxEvents);
+
+// reads back whatever earlier frames have finished and opens a "frame" scope
+void gpu_profiler_begin_frame(gpu_profiler *p);
+
+// name has to outlive the profiler. scopes nest, up to GPU_PROFILER_MAX_DEPTH deep
+void gpu_profiler_push(gpu_profiler *p, const char *name);
+void gpu_profiler_pop(gpu_profiler *p);
+
+// closes the "frame" scope, call before swapping
+void gpu_profiler_end_frame(gpu_profiler *p);
+
+// average GPU and CPU time per scope name over the frames resolved since the last report
+void gpu_profiler_report(gpu_profiler *p);
+
+// Chrome trace event JSON, CPU scopes on one track and GPU scopes on another
+bool gpu_profiler_write_trace(const gpu_profiler *p, const char *path);
+
+void gpu_profiler_destroy(gpu_profiler *p);
+
+#endif
@@ -0,0 +1,187 @@
+#include "headless.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HEADLESS_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "glfw/include/GLFW/glfw3.h"
+
+// only ever one headless context in the process
+static headless_api currentApi = HEADLESS_OSMESA;
+
+#ifdef HEADLESS_HAS_EGL
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+bool parse_headless_api(const char *name, headless_api *api) {
+	if (strcmp(name, "egl") == 0) {
+		*api = HEADLESS_EGL;
+	} else if (strcmp(name, "osmesa") == 0) {
+		*api = HEADLESS_OSMESA;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char *headless_api_name(headless_api api) {
+	return api == HEADLESS_EGL ? "egl" : "osmesa";
+}
+
+void headless_init_hints() {
+	glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+}
+
+#ifdef HEADLESS_HAS_EGL
+// surfaceless display, any config that can do desktop GL, context current with no surface at all
+static bool create_egl_context(int major, int minor) {
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!clientExtensions || !strstr(clientExtensions, "EGL_MESA_platform_surfaceless") || !getPlatformDisplay) {
+		printf("headless: EGL has no surfaceless platform\n");
+		return false;
+	}
+
+	eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	EGLint eglMajor = 0, eglMinor = 0;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &eglMajor, &eglMinor)) {
+		printf("headless: couldn't initialize the EGL display (0x%x)\n", eglGetError());
+		eglDisplay = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0) {
+		printf("headless: no EGL config for desktop GL\n");
+		headless_destroy_context();
+		return false;
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE,
+	};
+	eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		printf("headless: couldn't make a GL %d.%d core context (0x%x)\n", major, minor, eglGetError());
+		headless_destroy_context();
+		return false;
+	}
+	return true;
+}
+#endif
+
+GLFWwindow *headless_create_window(headless_api *api, bool fallback, int width, int height, int major, int minor) {
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	if (*api == HEADLESS_EGL) {
+#ifdef HEADLESS_HAS_EGL
+		if (create_egl_context(major, minor)) {
+			// the window is only there for GLFW's input and should-close state
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+			GLFWwindow *window = glfwCreateWindow(width, height, "Testing", NULL, NULL);
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+			if (window) {
+				currentApi = HEADLESS_EGL;
+				return window;
+			}
+			headless_destroy_context();
+		}
+#else
+		printf("headless: built without EGL\n");
+#endif
+		if (!fallback) {
+			return NULL;
+		}
+		*api = HEADLESS_OSMESA;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	GLFWwindow *window = glfwCreateWindow(width, height, "Testing", NULL, NULL);
+	if (!window) {
+		const char *description = NULL;
+		glfwGetError(&description);
+		printf("headless: no OSMesa context (%s)\n", description ? description : "unknown error");
+		return NULL;
+	}
+	glfwMakeContextCurrent(window);
+	currentApi = HEADLESS_OSMESA;
+	return window;
+}
+
+void *headless_get_proc_address(const char *name) {
+#ifdef HEADLESS_HAS_EGL
+	if (currentApi == HEADLESS_EGL) {
+		return (void *) eglGetProcAddress(name);
+	}
+#endif
+	return (void *) glfwGetProcAddress(name);
+}
+
+void headless_destroy_context() {
+#ifdef HEADLESS_HAS_EGL
+	if (eglDisplay != EGL_NO_DISPLAY) {
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (eglContext != EGL_NO_CONTEXT) {
+			eglDestroyContext(eglDisplay, eglContext);
+		}
+		eglTerminate(eglDisplay);
+	}
+	eglDisplay = EGL_NO_DISPLAY;
+	eglContext = EGL_NO_CONTEXT;
+#endif
+}
+
+bool headless_target_create(headless_target *target, int width, int height) {
+	target->width = width;
+	target->height = height;
+
+	glGenRenderbuffers(1, &target->color);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &target->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("headless: framebuffer incomplete (0x%x)\n", status);
+		headless_target_destroy(target);
+		return false;
+	}
+	return true;
+}
+
+void headless_target_destroy(headless_target *target) {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &target->fbo);
+	glDeleteRenderbuffers(1, &target->color);
+	glDeleteRenderbuffers(1, &target->depth);
+	target->fbo = 0;
+	target->color = 0;
+	target->depth = 0;
+}
@@ -0,0 +1,50 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "glad/glad.h"
+
+// rendering without a display, for benchmark runs on machines with no X or
+// Wayland (Mesa llvmpipe on the render farm). GLFW 3.4's null platform makes
+// a "window" that doesn't exist anywhere, which keeps the input / should-close
+// calls in the loop working. the context comes from:
+//   - EGL on Mesa's surfaceless platform, created here directly. GLFW's own
+//     EGL path asks for a window-capable config, which surfaceless doesn't have
+//   - OSMesa through GLFW, the fallback when there's no EGL
+// there's no default framebuffer worth drawing into either way, so everything
+// goes into an FBO and nothing gets swapped
+
+struct GLFWwindow;
+
+enum headless_api {
+	HEADLESS_EGL,
+	HEADLESS_OSMESA,
+};
+
+bool parse_headless_api(const char *name, headless_api *api);
+const char *headless_api_name(headless_api api);
+
+// before glfwInit
+void headless_init_hints();
+
+// a null platform window with a GL context current on this thread, NULL if no
+// context could be made. with fallback set, EGL failing moves on to OSMesa and
+// api says which one it ended up being
+GLFWwindow *headless_create_window(headless_api *api, bool fallback, int width, int height, int major, int minor);
+
+// for gladLoadGLLoader, whichever API headless_create_window went with
+void *headless_get_proc_address(const char *name);
+
+void headless_destroy_context();
+
+struct headless_target {
+	GLuint fbo;
+	GLuint color; // RGBA8 renderbuffer
+	GLuint depth; // 24/8 renderbuffer
+	int width, height;
+};
+
+// creates the FBO and leaves it bound for drawing, false if it isn't complete
+bool headless_target_create(headless_target *target, int width, int height);
+void headless_target_destroy(headless_target *target);
+
+#endif
@@ -0,0 +1,244 @@
+#include "indirect.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "gl_state.h"
+#include "job_system.h"
+#include "microbench.h"
+#include "shader.h"
+
+// per-draw data comes out of the SSBO instead of vertex attributes.
+// DRAW_ID is gl_DrawID on 4.6, and on 4.3 it's an attribute with divisor 1
+// that gets offset by each command's baseInstance (which is the draw index)
+static const char *indirectVertexBody =
+	"layout (location = 0) in vec3 aPos;\n"
+	"struct draw_data {\n"
+	"	vec4 transform;\n" // xy offset, z scale, w rotation
+	"	vec4 color;\n"
+	"};\n"
+	"layout (std430, binding = 0) readonly buffer DrawData {\n"
+	"	draw_data draws[];\n"
+	"};\n"
+	"out vec4 vColor;\n"
+	"void main() {\n"
+	"	draw_data d = draws[DRAW_ID];\n"
+	"	float c = cos(d.transform.w);\n"
+	"	float s = sin(d.transform.w);\n"
+	"	vec2 p = mat2(c, s, -s, c) * (aPos.xy * d.transform.z) + d.transform.xy;\n"
+	"	gl_Position = vec4(p.x, p.y, aPos.z, 1.0f);\n"
+	"	vColor = d.color;\n"
+	"}\n";
+
+static const char *indirectFragmentSource = "#version 430 core\n"
+	"in vec4 vColor;\n"
+	"out vec4 FragColor;\n"
+	"void main() {\n"
+	"	FragColor = vColor;\n"
+	"}\n";
+
+bool indirect_supported() {
+	return GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool indirect_has_draw_id() {
+	return GLAD_GL_VERSION_4_6 != 0;
+}
+
+indirect_buffer indirect_buffer_create() {
+	indirect_buffer ib;
+	glGenBuffers(1, &ib.buffer);
+	ib.capacity = 0;
+	ib.drawCount = 0;
+	ib.indexed = false;
+	return ib;
+}
+
+void indirect_buffer_destroy(indirect_buffer *ib) {
+	gls_delete_buffers(1, &ib->buffer);
+	ib->buffer = 0;
+	ib->capacity = 0;
+	ib->drawCount = 0;
+}
+
+static void indirect_upload(indirect_buffer *ib, const void *commands, size_t size) {
+	gls_bind_buffer(GL_DRAW_INDIRECT_BUFFER, ib->buffer);
+
+	// orphan every frame so the driver can hand us fresh storage while the GPU
+	// is still reading last frame's commands
+	if (size > ib->capacity) {
+		ib->capacity = size;
+	}
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr) ib->capacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, (GLsizeiptr) size, commands);
+}
+
+void indirect_upload_arrays(indirect_buffer *ib, const draw_arrays_indirect_command *commands, unsigned int count) {
+	indirect_upload(ib, commands, count * sizeof(draw_arrays_indirect_command));
+	ib->drawCount = count;
+	ib->indexed = false;
+}
+
+void indirect_upload_elements(indirect_buffer *ib, const draw_elements_indirect_command *commands, unsigned int count) {
+	indirect_upload(ib, commands, count * sizeof(draw_elements_indirect_command));
+	ib->drawCount = count;
+	ib->indexed = true;
+}
+
+void indirect_submit(const indirect_buffer &ib, GLenum mode) {
+	gls_bind_buffer(GL_DRAW_INDIRECT_BUFFER, ib.buffer);
+	if (ib.indexed) {
+		glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, (void *) 0, (GLsizei) ib.drawCount, 0);
+	} else {
+		glMultiDrawArraysIndirect(mode, (void *) 0, (GLsizei) ib.drawCount, 0);
+	}
+}
+
+void indirect_record_parallel(unsigned int drawCount, unsigned int threadCount,
+	void (*record)(unsigned int begin, unsigned int end, void *user), void *user) {
+
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+	if (threadCount > drawCount) {
+		threadCount = drawCount > 0 ? drawCount : 1;
+	}
+
+	unsigned int chunk = (drawCount + threadCount - 1) / threadCount;
+	parallel_for(drawCount, chunk, record, user);
+}
+
+bool indirect_scene_create(indirect_scene *scene, unsigned int shapeVBO, GLsizei vertexCount,
+	const std::vector<instance_data> &objects) {
+
+	scene->program = 0;
+	scene->VAO = 0;
+	scene->SSBO = 0;
+	scene->drawIdVBO = 0;
+	scene->vertexCount = vertexCount;
+	scene->commands = indirect_buffer_create();
+
+	if (!indirect_supported()) {
+		printf("indirect: needs OpenGL 4.3 for glMultiDrawArraysIndirect + SSBOs\n");
+		indirect_scene_destroy(scene);
+		return false;
+	}
+
+	std::string vertexSource;
+	if (indirect_has_draw_id()) {
+		vertexSource = "#version 460 core\n#define DRAW_ID gl_DrawID\n";
+	} else {
+		vertexSource = "#version 430 core\nlayout (location = 3) in uint aDrawId;\n#define DRAW_ID aDrawId\n";
+	}
+	vertexSource += indirectVertexBody;
+
+	scene->program = shader_program(vertexSource.c_str(), indirectFragmentSource, "INDIRECT");
+	if (scene->program == 0) {
+		indirect_scene_destroy(scene);
+		return false;
+	}
+
+	glGenVertexArrays(1, &scene->VAO);
+	gls_bind_vertex_array(scene->VAO);
+
+	gls_bind_buffer(GL_ARRAY_BUFFER, shapeVBO);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+	glEnableVertexAttribArray(0);
+
+	if (!indirect_has_draw_id()) {
+		// 0, 1, 2, ... read once per instance starting at baseInstance
+		std::vector<GLuint> ids(objects.size());
+		for (size_t i = 0; i < ids.size(); i++) {
+			ids[i] = (GLuint) i;
+		}
+		glGenBuffers(1, &scene->drawIdVBO);
+		gls_bind_buffer(GL_ARRAY_BUFFER, scene->drawIdVBO);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void *) 0);
+		glEnableVertexAttribArray(3);
+		glVertexAttribDivisor(3, 1);
+	}
+
+	gls_bind_vertex_array(0);
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	// std430 lays out vec4 + vec4 exactly like instance_data
+	glGenBuffers(1, &scene->SSBO);
+	gls_bind_buffer(GL_SHADER_STORAGE_BUFFER, scene->SSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(instance_data), objects.data(), GL_STATIC_DRAW);
+	gls_bind_buffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	scene->cpuCommands.resize(objects.size());
+	return true;
+}
+
+static void record_scene_commands(unsigned int begin, unsigned int end, void *user) {
+	indirect_scene *scene = (indirect_scene *) user;
+	for (unsigned int i = begin; i < end; i++) {
+		draw_arrays_indirect_command &cmd = scene->cpuCommands[i];
+		cmd.count = (GLuint) scene->vertexCount;
+		cmd.instanceCount = 1;
+		cmd.first = 0;
+		cmd.baseInstance = i; // feeds DRAW_ID on the pre 4.6 path
+	}
+}
+
+void indirect_scene_draw(indirect_scene *scene, unsigned int threadCount) {
+	unsigned int drawCount = (unsigned int) scene->cpuCommands.size();
+	indirect_record_parallel(drawCount, threadCount, record_scene_commands, scene);
+	indirect_upload_arrays(&scene->commands, scene->cpuCommands.data(), drawCount);
+
+	gls_use_program(scene->program);
+	gls_bind_vertex_array(scene->VAO);
+	gls_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 0, scene->SSBO);
+	indirect_submit(scene->commands, GL_TRIANGLES);
+}
+
+void indirect_scene_destroy(indirect_scene *scene) {
+	indirect_buffer_destroy(&scene->commands);
+	gls_delete_buffers(1, &scene->SSBO);
+	gls_delete_buffers(1, &scene->drawIdVBO);
+	gls_delete_vertex_arrays(1, &scene->VAO);
+	glDeleteProgram(scene->program);
+	scene->cpuCommands.clear();
+}
+
+struct bench_meshes {
+	std::vector<draw_elements_indirect_command> *commands;
+	unsigned int meshCount;
+};
+
+// pretend every draw picks one of a few meshes packed into one big VBO/EBO
+static void record_bench_commands(unsigned int begin, unsigned int end, void *user) {
+	bench_meshes *b = (bench_meshes *) user;
+	for (unsigned int i = begin; i < end; i++) {
+		unsigned int mesh = (i * 2654435761u) % b->meshCount;
+		draw_elements_indirect_command &cmd = (*b->commands)[i];
+		cmd.count = 36 + mesh * 6;
+		cmd.instanceCount = 1;
+		cmd.firstIndex = mesh * 1024;
+		cmd.baseVertex = (GLint) (mesh * 256);
+		cmd.baseInstance = i;
+	}
+}
+
+void indirect_bench() {
+	const unsigned int drawCount = 100000;
+	std::vector<draw_elements_indirect_command> commands(drawCount);
+	bench_meshes b = { &commands, 16 };
+
+	unsigned int hw = bench_max_threads();
+
+	printf("indirect: %u draws -> 1 glMultiDrawElementsIndirect per pass\n", drawCount);
+	for (unsigned int threads = 1; threads <= hw; threads = bench_next_threads(threads, hw)) {
+		const int runs = 20;
+		double start = bench_now_ms();
+		for (int r = 0; r < runs; r++) {
+			indirect_record_parallel(drawCount, threads, record_bench_commands, &b);
+		}
+		double ms = (bench_now_ms() - start) / runs;
+		printf("  %u thread(s): %.3f ms to record, %.1f MB of commands\n", threads, ms,
+			drawCount * sizeof(draw_elements_indirect_command) / (1024.0 * 1024.0));
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "glad/glad.h"
+#include "instancing.h"
+
+// layouts are fixed by the GL spec (4.3, section 10.4)
+struct draw_arrays_indirect_command {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
+};
+
+struct draw_elements_indirect_command {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// a GL_DRAW_INDIRECT_BUFFER holding one pass worth of commands
+struct indirect_buffer {
+	unsigned int buffer;
+	size_t capacity; // bytes
+	unsigned int drawCount;
+	bool indexed;
+};
+
+// glMultiDraw*Indirect and SSBOs are GL 4.3, gl_DrawID is 4.6
+bool indirect_supported();
+bool indirect_has_draw_id();
+
+indirect_buffer indirect_buffer_create();
+void indirect_buffer_destroy(indirect_buffer *ib);
+
+void indirect_upload_arrays(indirect_buffer *ib, const draw_arrays_indirect_command *commands, unsigned int count);
+void indirect_upload_elements(indirect_buffer *ib, const draw_elements_indirect_command *commands, unsigned int count);
+
+// the whole pass in one call, the VAO (and the EBO for indexed passes) has to be bound
+void indirect_submit(const indirect_buffer &ib, GLenum mode);
+
+// split [0, drawCount) into threadCount ranges and call record() for each as a job
+// (see job_system.h). every range writes to its own part of the caller's command
+// array so nothing needs locking and the order is deterministic
+void indirect_record_parallel(unsigned int drawCount, unsigned int threadCount,
+	void (*record)(unsigned int begin, unsigned int end, void *user), void *user);
+
+// count separate objects sharing one shape VBO. every object is its own draw
+// command; its transform and color sit in an SSBO that the vertex shader
+// indexes with gl_DrawID (or with baseInstance fed through an attribute
+// before 4.6)
+struct indirect_scene {
+	unsigned int program;
+	unsigned int VAO;
+	unsigned int SSBO;
+	unsigned int drawIdVBO;
+	indirect_buffer commands;
+	std::vector<draw_arrays_indirect_command> cpuCommands;
+	GLsizei vertexCount;
+};
+
+bool indirect_scene_create(indirect_scene *scene, unsigned int shapeVBO, GLsizei vertexCount,
+	const std::vector<instance_data> &objects);
+
+// rebuild the command list on threadCount threads, upload it and draw everything with one call
+void indirect_scene_draw(indirect_scene *scene, unsigned int threadCount);
+
+void indirect_scene_destroy(indirect_scene *scene);
+
+void indirect_bench();
+
+#endif
@@ -0,0 +1,171 @@
+#include "input.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <thread>
+
+#include "glfw/include/GLFW/glfw3.h"
+
+#include "microbench.h"
+
+// glfw callbacks don't carry a user pointer of their own, and main already
+// owns the window one. there's only ever one window
+static input_queue *queue = NULL;
+
+static bool push(input_queue *q, const input_event &event) {
+	unsigned int head = q->head.load(std::memory_order_relaxed);
+	unsigned int tail = q->tail.load(std::memory_order_acquire);
+	if (head - tail == INPUT_QUEUE_SIZE) {
+		q->dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	q->events[head & (INPUT_QUEUE_SIZE - 1)] = event;
+	q->head.store(head + 1, std::memory_order_release); // the consumer sees the event once it sees head
+	return true;
+}
+
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+	input_queue *q = queue;
+	if (action != GLFW_REPEAT) {
+		for (unsigned int i = 0; i < q->bindingCount; i++) {
+			if (q->bindingKeys[i] != key) {
+				continue;
+			}
+			unsigned int keys = q->keys.load(std::memory_order_relaxed);
+			keys = action == GLFW_PRESS ? keys | q->bindingBits[i] : keys & ~q->bindingBits[i];
+			q->keys.store(keys, std::memory_order_relaxed);
+			if (action == GLFW_PRESS) {
+				q->pressed.fetch_or(q->bindingBits[i], std::memory_order_relaxed);
+			}
+			input_event event = { bench_now_ms(), keys };
+			push(q, event);
+		}
+	}
+
+	if (q->previous) {
+		q->previous(window, key, scancode, action, mods);
+	}
+}
+
+static void reset(input_queue *q) {
+	q->head.store(0);
+	q->tail.store(0);
+	q->keys.store(0);
+	q->pressed.store(0);
+	q->dropped.store(0);
+	q->bindingCount = 0;
+	q->previous = NULL;
+}
+
+void input_init(input_queue *q, GLFWwindow *window) {
+	reset(q);
+	queue = q;
+	q->previous = glfwSetKeyCallback(window, key_callback);
+}
+
+void input_bind(input_queue *q, int key, unsigned int bit) {
+	if (q->bindingCount < INPUT_MAX_BINDINGS) {
+		q->bindingKeys[q->bindingCount] = key;
+		q->bindingBits[q->bindingCount] = bit;
+		q->bindingCount++;
+	}
+}
+
+bool input_peek(input_queue *q, input_event *event) {
+	unsigned int tail = q->tail.load(std::memory_order_relaxed);
+	if (tail == q->head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	*event = q->events[tail & (INPUT_QUEUE_SIZE - 1)];
+	return true;
+}
+
+void input_pop(input_queue *q) {
+	// release so the producer doesn't reuse the slot before we're done reading it
+	q->tail.store(q->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+unsigned int input_keys(const input_queue *q) {
+	return q->keys.load(std::memory_order_relaxed);
+}
+
+unsigned int input_pressed(input_queue *q) {
+	return q->pressed.exchange(0, std::memory_order_relaxed);
+}
+
+bool input_pending(const input_queue *q) {
+	return q->tail.load(std::memory_order_acquire) != q->head.load(std::memory_order_acquire);
+}
+
+unsigned int input_latch(input_queue *q) {
+	glfwPollEvents();
+	return input_keys(q);
+}
+
+static void bench_consumer(input_queue *q, unsigned int count, unsigned int *checksum) {
+	unsigned int sum = 0;
+	input_event event;
+	for (unsigned int n = 0; n < count; n++) {
+		while (!input_peek(q, &event)) {
+			std::this_thread::yield();
+		}
+		sum += event.keys;
+		input_pop(q);
+	}
+	*checksum = sum;
+}
+
+void input_bench() {
+	// one thread pushing, another popping, the way the GL thread and the simulation use it
+	input_queue q;
+	reset(&q);
+	const unsigned int count = 1000000;
+	unsigned int checksum = 0, expected = 0;
+	double start = bench_now_ms();
+	std::thread consumer(bench_consumer, &q, count, &checksum);
+	for (unsigned int n = 0; n < count; n++) {
+		input_event event = { 0.0, n };
+		while (!push(&q, event)) {
+			std::this_thread::yield();
+		}
+		expected += n;
+	}
+	consumer.join();
+	double ms = bench_now_ms() - start;
+	printf("input: %u events across threads in %.1f ms, %.1f ns per event%s\n",
+		count, ms, ms * 1e6 / count, checksum == expected ? "" : " (CHECKSUM MISMATCH)");
+
+	// how long the simulation thinks a key was held, with 60 fps frames and
+	// 50 Hz ticks. polled, a tick only sees the keys as of the last frame
+	// before it ran and applies them for the whole tick. queued, the press and
+	// release land where they were delivered (the poll after they happened)
+	const double frameMs = 1000.0 / 60.0, tickMs = 1000.0 / 50.0;
+	const int presses = 10000;
+	unsigned int seed = 1;
+	double polledError = 0.0, queuedError = 0.0, polledWorst = 0.0, queuedWorst = 0.0;
+	for (int p = 0; p < presses; p++) {
+		double down = 1000.0 + (bench_random_u32(&seed) % 100000) / 100.0;
+		double up = down + 10.0 + (bench_random_u32(&seed) % 19000) / 100.0;
+		double downPoll = ceil(down / frameMs) * frameMs;
+		double upPoll = ceil(up / frameMs) * frameMs;
+
+		double polled = 0.0;
+		for (double tickEnd = floor(down / tickMs) * tickMs; tickEnd < up + 2.0 * tickMs + frameMs; tickEnd += tickMs) {
+			double lastPoll = floor(tickEnd / frameMs) * frameMs;
+			if (lastPoll >= downPoll && lastPoll < upPoll) {
+				polled += tickMs;
+			}
+		}
+		double queued = upPoll - downPoll;
+
+		double held = up - down;
+		polledError += fabs(polled - held);
+		queuedError += fabs(queued - held);
+		polledWorst = fabs(polled - held) > polledWorst ? fabs(polled - held) : polledWorst;
+		queuedWorst = fabs(queued - held) > queuedWorst ? fabs(queued - held) : queuedWorst;
+	}
+	printf("  key held 10..200 ms, error in how long the simulation applied it (%d presses):\n", presses);
+	printf("    polled once a frame: %6.2f ms mean, %6.2f ms worst\n", polledError / presses, polledWorst);
+	printf("    timestamped events:  %6.2f ms mean, %6.2f ms worst\n", queuedError / presses, queuedWorst);
+}
@@ -0,0 +1,72 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <atomic>
+
+// keyboard input as timestamped events instead of glfwGetKey once a frame.
+// the key callback stamps every press / release with bench_now_ms() and
+// pushes it into a single producer / single consumer ring, the GL thread
+// being the producer (glfw only calls back from there) and the simulation
+// the consumer, which can then apply each one where it happened inside its
+// tick rather than whenever the next frame got round to looking.
+//
+// keys are bound to bits first and every event carries the whole bitmask as
+// of that event, so a consumer only ever has to take the latest one it's up
+// to, and a dropped event can't leave a key stuck.
+//
+// the stamp is when glfw delivered the event, which is as good as the poll
+// rate. input_latch polls again for a fresher look right before submission
+
+struct GLFWwindow;
+
+// power of two. at 2 events per keystroke this is a lot of typing between ticks
+#define INPUT_QUEUE_SIZE 256
+
+#define INPUT_MAX_BINDINGS 16
+
+struct input_event {
+	double timeMs;
+	unsigned int keys; // every bound bit as of this event
+};
+
+struct input_queue {
+	input_event events[INPUT_QUEUE_SIZE];
+	std::atomic<unsigned int> head; // next to write, only the producer stores it
+	std::atomic<unsigned int> tail; // next to read, only the consumer stores it
+	std::atomic<unsigned int> keys; // latest state, readable from anywhere
+	std::atomic<unsigned int> pressed; // bits pressed since input_pressed last looked
+	std::atomic<unsigned int> dropped; // ring was full
+
+	int bindingKeys[INPUT_MAX_BINDINGS];
+	unsigned int bindingBits[INPUT_MAX_BINDINGS];
+	unsigned int bindingCount;
+
+	void (*previous)(GLFWwindow *, int, int, int, int); // key callback that was there before, still called
+};
+
+// installs the key callback, chaining to whatever was installed before
+void input_init(input_queue *q, GLFWwindow *window);
+
+// GLFW_KEY_* -> bit. keys that aren't bound don't make events
+void input_bind(input_queue *q, int key, unsigned int bit);
+
+// consumer side. peek the oldest event, pop it once it's been dealt with
+bool input_peek(input_queue *q, input_event *event);
+void input_pop(input_queue *q);
+
+unsigned int input_keys(const input_queue *q);
+
+// bits pressed since the last call, so a tap that's over before anyone
+// looks at the keys still counts. for one off actions like quitting
+unsigned int input_pressed(input_queue *q);
+
+// anything pushed that the consumer hasn't popped yet. from any thread
+bool input_pending(const input_queue *q);
+
+// GL thread. polls glfw one more time and returns the freshest keys, for
+// the last moment before the frame is submitted
+unsigned int input_latch(input_queue *q);
+
+void input_bench();
+
+#endif
@@ -0,0 +1,88 @@
+#include "instancing.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#include "gl_state.h"
+
+instance_buffer instance_buffer_create(unsigned int VAO, unsigned int firstAttrib) {
+	instance_buffer ib;
+	ib.capacity = 0;
+	ib.count = 0;
+
+	glGenBuffers(1, &ib.VBO);
+
+	gls_bind_vertex_array(VAO);
+	gls_bind_buffer(GL_ARRAY_BUFFER, ib.VBO);
+
+	glVertexAttribPointer(firstAttrib, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (void *) offsetof(instance_data, transform));
+	glEnableVertexAttribArray(firstAttrib);
+	glVertexAttribDivisor(firstAttrib, 1);
+
+	glVertexAttribPointer(firstAttrib + 1, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (void *) offsetof(instance_data, color));
+	glEnableVertexAttribArray(firstAttrib + 1);
+	glVertexAttribDivisor(firstAttrib + 1, 1);
+
+	gls_bind_vertex_array(0);
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	return ib;
+}
+
+void instance_buffer_upload(instance_buffer *ib, const instance_data *data, unsigned int count) {
+	gls_bind_buffer(GL_ARRAY_BUFFER, ib->VBO);
+
+	// the attribute pointers reference the buffer object not its storage,
+	// so reallocating here doesn't need the VAO to be touched
+	if (count > ib->capacity) {
+		ib->capacity = count;
+	}
+	glBufferData(GL_ARRAY_BUFFER, ib->capacity * sizeof(instance_data), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(instance_data), data);
+
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+	ib->count = count;
+}
+
+void instance_buffer_destroy(instance_buffer *ib) {
+	gls_delete_buffers(1, &ib->VBO);
+	ib->VBO = 0;
+	ib->capacity = 0;
+	ib->count = 0;
+}
+
+void instance_draw_arrays(const instance_buffer &ib, GLenum mode, GLint first, GLsizei count) {
+	glDrawArraysInstanced(mode, first, count, (GLsizei) ib.count);
+}
+
+void instance_draw_elements(const instance_buffer &ib, GLenum mode, GLsizei count, unsigned int indexOffset) {
+	glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, (void *) (indexOffset * sizeof(unsigned int)), (GLsizei) ib.count);
+}
+
+void instance_make_grid(std::vector<instance_data> &out, unsigned int count, float minX, float minY, float size) {
+	out.resize(count);
+
+	unsigned int side = (unsigned int) ceil(sqrt((double) count));
+	if (side == 0) {
+		return;
+	}
+	float cell = 2.0f / side;
+	float scale = cell / size * 0.9f;
+
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int x = i % side;
+		unsigned int y = i / side;
+
+		// move the shape's bounds to the cell's corner, leaving a small gap
+		instance_data &d = out[i];
+		d.transform[0] = -1.0f + x * cell - minX * scale + cell * 0.05f;
+		d.transform[1] = -1.0f + y * cell - minY * scale + cell * 0.05f;
+		d.transform[2] = scale;
+		d.transform[3] = 0.0f;
+
+		d.color[0] = (float) x / side;
+		d.color[1] = (float) y / side;
+		d.color[2] = 0.6f;
+		d.color[3] = 1.0f;
+	}
+}
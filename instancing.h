@@ -0,0 +1,38 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <vector>
+
+#include "glad/glad.h"
+
+// what every instance gets, matches the per-instance attributes in main.cpp's vertex shader
+struct instance_data {
+	float transform[4]; // xy offset, z scale, w rotation (radians)
+	float color[4];
+};
+
+// a per-instance attribute stream attached to an existing VAO
+struct instance_buffer {
+	unsigned int VBO;
+	unsigned int capacity; // in instances
+	unsigned int count;
+};
+
+// hook transform to attribute firstAttrib and color to firstAttrib + 1, both
+// advancing once per instance (glVertexAttribDivisor(.., 1))
+instance_buffer instance_buffer_create(unsigned int VAO, unsigned int firstAttrib);
+
+// replace the contents, grows the buffer if needed and orphans it otherwise
+void instance_buffer_upload(instance_buffer *ib, const instance_data *data, unsigned int count);
+
+void instance_buffer_destroy(instance_buffer *ib);
+
+// draw every instance in the buffer, the VAO has to be bound
+void instance_draw_arrays(const instance_buffer &ib, GLenum mode, GLint first, GLsizei count);
+void instance_draw_elements(const instance_buffer &ib, GLenum mode, GLsizei count, unsigned int indexOffset);
+
+// fill the screen with count small copies of a shape whose bounds are
+// [minX, minX + size] x [minY, minY + size], used for the stress scene
+void instance_make_grid(std::vector<instance_data> &out, unsigned int count, float minX, float minY, float size);
+
+#endif
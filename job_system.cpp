@@ -0,0 +1,473 @@
+#include "job_system.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#include "cpu_profiler.h"
+#include "microbench.h"
+
+// per worker, has to be a power of two. a full deque runs the job inline instead
+#define JOB_DEQUE_SIZE 4096
+
+// jobs are stored by value so pushing never allocates. the fields are atomic
+// because a thief reads a slot before it knows whether it won the race for it
+struct job_slot {
+	std::atomic<job_fn> fn;
+	std::atomic<void *> data;
+	std::atomic<job_counter *> counter;
+};
+
+struct job_deque {
+	std::atomic<int64_t> top;
+	std::atomic<int64_t> bottom;
+	job_slot slots[JOB_DEQUE_SIZE];
+};
+
+struct job_system {
+	unsigned int threadCount;
+	std::vector<job_deque *> deques;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running;
+
+	// submissions from threads that don't own a deque
+	std::mutex sharedLock;
+	std::deque<job> shared;
+	std::atomic<int> sharedCount;
+
+	// idle workers park here instead of spinning forever
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	int sleeping; // under sleepLock
+	unsigned int pushes; // bumped under sleepLock after every push, so a worker can tell one landed after it last looked
+};
+
+static job_system *jobs = NULL;
+static thread_local int workerIndex = -1;
+
+static void slot_store(job_slot *slot, const job &j) {
+	slot->fn.store(j.fn, std::memory_order_relaxed);
+	slot->data.store(j.data, std::memory_order_relaxed);
+	slot->counter.store(j.counter, std::memory_order_relaxed);
+}
+
+static void slot_load(const job_slot *slot, job *j) {
+	j->fn = slot->fn.load(std::memory_order_relaxed);
+	j->data = slot->data.load(std::memory_order_relaxed);
+	j->counter = slot->counter.load(std::memory_order_relaxed);
+}
+
+static bool deque_push(job_deque *d, const job &j) {
+	int64_t b = d->bottom.load(std::memory_order_relaxed);
+	int64_t t = d->top.load(std::memory_order_acquire);
+	if (b - t >= JOB_DEQUE_SIZE) {
+		return false;
+	}
+	slot_store(&d->slots[b & (JOB_DEQUE_SIZE - 1)], j);
+	d->bottom.store(b + 1, std::memory_order_release); // thieves see the slot once they see bottom
+	return true;
+}
+
+// owner only
+static bool deque_pop(job_deque *d, job *j) {
+	int64_t b = d->bottom.load(std::memory_order_relaxed) - 1;
+	d->bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = d->top.load(std::memory_order_relaxed);
+
+	if (t > b) {
+		// it was empty
+		d->bottom.store(b + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	slot_load(&d->slots[b & (JOB_DEQUE_SIZE - 1)], j);
+	bool got = true;
+	if (t == b) {
+		// last one, race any thief for it
+		got = d->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		d->bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return got;
+}
+
+static bool deque_steal(job_deque *d, job *j) {
+	int64_t t = d->top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = d->bottom.load(std::memory_order_acquire);
+	if (t >= b) {
+		return false;
+	}
+
+	// the owner can't overwrite slot t until top moves past it, so if the
+	// exchange below succeeds what was read here is still the right job
+	slot_load(&d->slots[t & (JOB_DEQUE_SIZE - 1)], j);
+	return d->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static void job_finish(job_counter *counter);
+
+static void execute(const job &j) {
+	PROFILE_ZONE("job");
+	j.fn(j.data);
+	if (j.counter) {
+		job_finish(j.counter);
+	}
+}
+
+static void notify_workers() {
+	std::lock_guard<std::mutex> guard(jobs->sleepLock);
+	jobs->pushes++;
+	if (jobs->sleeping > 0) {
+		jobs->wake.notify_one();
+	}
+}
+
+static void push_job(const job &j) {
+	if (workerIndex < 0) {
+		std::lock_guard<std::mutex> guard(jobs->sharedLock);
+		jobs->shared.push_back(j);
+		jobs->sharedCount.fetch_add(1, std::memory_order_release);
+	} else {
+		if (!deque_push(jobs->deques[workerIndex], j)) {
+			execute(j);
+			return;
+		}
+	}
+	notify_workers();
+}
+
+static void job_finish(job_counter *counter) {
+	// decrement under the lock so job_wait can't return (and the counter go out
+	// of scope) while this is still touching it
+	std::vector<job> ready;
+	{
+		std::lock_guard<std::mutex> guard(counter->lock);
+		if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			// that was the last one, let anything waiting on it go
+			ready.swap(counter->continuations);
+		}
+	}
+	for (size_t i = 0; i < ready.size(); i++) {
+		if (jobs) {
+			push_job(ready[i]);
+		} else {
+			execute(ready[i]);
+		}
+	}
+}
+
+// own deque first (newest job, still in cache), then the shared queue, then steal
+static bool try_run_one(unsigned int *victim) {
+	job j;
+	bool found = false;
+
+	if (workerIndex >= 0) {
+		found = deque_pop(jobs->deques[workerIndex], &j);
+	}
+
+	if (!found && jobs->sharedCount.load(std::memory_order_acquire) > 0) {
+		std::lock_guard<std::mutex> guard(jobs->sharedLock);
+		if (!jobs->shared.empty()) {
+			j = jobs->shared.front();
+			jobs->shared.pop_front();
+			jobs->sharedCount.fetch_sub(1, std::memory_order_relaxed);
+			found = true;
+		}
+	}
+
+	for (unsigned int i = 0; !found && i < jobs->threadCount; i++) {
+		unsigned int v = (*victim + i) % jobs->threadCount;
+		if ((int) v != workerIndex && deque_steal(jobs->deques[v], &j)) {
+			*victim = v; // it had work, try it first next time
+			found = true;
+		}
+	}
+
+	if (!found) {
+		return false;
+	}
+	execute(j);
+	return true;
+}
+
+static void worker_main(unsigned int index) {
+	workerIndex = (int) index;
+	char name[32];
+	snprintf(name, sizeof(name), "job worker %u", index);
+	PROFILE_THREAD_NAME(name);
+	unsigned int victim = index + 1;
+	int idle = 0;
+
+	while (jobs->running.load(std::memory_order_relaxed)) {
+		if (try_run_one(&victim)) {
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < 64) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		// note how many pushes there have been, look one last time, and only
+		// sleep if nothing was pushed since. a push that lands between the look
+		// and the wait has bumped the count by then, so it can't be missed
+		unsigned int seen;
+		{
+			std::lock_guard<std::mutex> guard(jobs->sleepLock);
+			seen = jobs->pushes;
+		}
+		if (try_run_one(&victim)) {
+			idle = 0;
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(jobs->sleepLock);
+		jobs->sleeping++;
+		while (jobs->pushes == seen && jobs->running.load(std::memory_order_relaxed)) {
+			jobs->wake.wait(guard);
+		}
+		jobs->sleeping--;
+		idle = 0;
+	}
+}
+
+void job_system_init(unsigned int threadCount) {
+	if (jobs) {
+		return;
+	}
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+	}
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+
+	jobs = new job_system;
+	jobs->threadCount = threadCount;
+	jobs->running.store(true);
+	jobs->sharedCount.store(0);
+	jobs->sleeping = 0;
+	jobs->pushes = 0;
+
+	for (unsigned int i = 0; i < threadCount; i++) {
+		job_deque *d = new job_deque;
+		d->top.store(0);
+		d->bottom.store(0);
+		jobs->deques.push_back(d);
+	}
+
+	workerIndex = 0;
+	for (unsigned int i = 1; i < threadCount; i++) {
+		jobs->threads.push_back(std::thread(worker_main, i));
+	}
+}
+
+void job_system_shutdown() {
+	if (!jobs) {
+		return;
+	}
+
+	// drain whatever's left so no counter is left waiting
+	unsigned int victim = 1;
+	while (try_run_one(&victim)) {
+	}
+
+	jobs->running.store(false);
+	{
+		std::lock_guard<std::mutex> guard(jobs->sleepLock);
+		jobs->wake.notify_all();
+	}
+	for (size_t i = 0; i < jobs->threads.size(); i++) {
+		jobs->threads[i].join();
+	}
+	for (size_t i = 0; i < jobs->deques.size(); i++) {
+		delete jobs->deques[i];
+	}
+
+	delete jobs;
+	jobs = NULL;
+	workerIndex = -1;
+}
+
+unsigned int job_system_thread_count() {
+	return jobs ? jobs->threadCount : 1;
+}
+
+void job_run(job_fn fn, void *data, job_counter *counter) {
+	job j = { fn, data, counter };
+	if (counter) {
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (!jobs) {
+		execute(j);
+		return;
+	}
+	push_job(j);
+}
+
+void job_run_after(job_counter *dependency, job_fn fn, void *data, job_counter *counter) {
+	job j = { fn, data, counter };
+	if (counter) {
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	{
+		// job_finish drops the count and takes the list under the same lock,
+		// so either it sees this job or this sees the zero
+		std::lock_guard<std::mutex> guard(dependency->lock);
+		if (dependency->pending.load(std::memory_order_acquire) > 0) {
+			dependency->continuations.push_back(j);
+			return;
+		}
+	}
+
+	if (!jobs) {
+		execute(j);
+	} else {
+		push_job(j);
+	}
+}
+
+void job_wait(job_counter *counter) {
+	unsigned int victim = workerIndex >= 0 ? workerIndex + 1 : 0;
+	while (counter->pending.load(std::memory_order_acquire) > 0) {
+		if (!jobs || !try_run_one(&victim)) {
+			std::this_thread::yield();
+		}
+	}
+
+	// the last job_finish may not have let go of the lock yet
+	std::lock_guard<std::mutex> guard(counter->lock);
+}
+
+struct parallel_for_chunk {
+	void (*fn)(unsigned int begin, unsigned int end, void *user);
+	void *user;
+	unsigned int begin;
+	unsigned int end;
+};
+
+static void run_chunk(void *data) {
+	parallel_for_chunk *c = (parallel_for_chunk *) data;
+	c->fn(c->begin, c->end, c->user);
+}
+
+void parallel_for(unsigned int count, unsigned int grain,
+	void (*fn)(unsigned int begin, unsigned int end, void *user), void *user) {
+
+	if (count == 0) {
+		return;
+	}
+
+	unsigned int threads = job_system_thread_count();
+	if (grain == 0) {
+		// ~4 chunks per thread is enough for stealing to even out uneven chunks
+		// without paying for thousands of tiny jobs
+		grain = count / (threads * 4);
+		if (grain < 1) {
+			grain = 1;
+		}
+	}
+
+	if (threads == 1 || grain >= count) {
+		fn(0, count, user);
+		return;
+	}
+
+	unsigned int chunkCount = (count + grain - 1) / grain;
+	std::vector<parallel_for_chunk> chunks(chunkCount);
+	job_counter counter;
+
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		parallel_for_chunk &c = chunks[i];
+		c.fn = fn;
+		c.user = user;
+		c.begin = i * grain;
+		c.end = c.begin + grain < count ? c.begin + grain : count;
+		job_run(run_chunk, &c, &counter);
+	}
+
+	job_wait(&counter);
+}
+
+static void empty_job(void *) {
+}
+
+struct bench_work {
+	const float *values;
+	double *partial; // one per chunk so nothing is shared
+	unsigned int grain;
+};
+
+static void bench_sum(unsigned int begin, unsigned int end, void *user) {
+	bench_work *w = (bench_work *) user;
+	double sum = 0.0;
+	for (unsigned int i = begin; i < end; i++) {
+		sum += sqrt(w->values[i]) * sin(w->values[i]);
+	}
+	w->partial[begin / w->grain] = sum;
+}
+
+void job_bench() {
+	unsigned int hw = bench_max_threads();
+
+	const unsigned int count = 1 << 22;
+	std::vector<float> values(count);
+	for (unsigned int i = 0; i < count; i++) {
+		values[i] = (float) (i % 1000) * 0.01f;
+	}
+
+	// whoever called us might already have a job system running
+	bool wasRunning = jobs != NULL;
+	unsigned int previousThreads = job_system_thread_count();
+	job_system_shutdown();
+
+	double singleMs = 0.0;
+	printf("job system: spawn overhead and parallel_for scaling over %u elements\n", count);
+	for (unsigned int threads = 1; threads <= hw; threads = bench_next_threads(threads, hw)) {
+		job_system_init(threads);
+
+		// spawn + run + wait for a pile of empty jobs, in batches that fit the deque
+		const unsigned int spawnCount = 100000;
+		const unsigned int batch = 1024;
+		job_counter counter;
+		double start = bench_now_ms();
+		for (unsigned int i = 0; i < spawnCount; i += batch) {
+			for (unsigned int k = 0; k < batch && i + k < spawnCount; k++) {
+				job_run(empty_job, NULL, &counter);
+			}
+			job_wait(&counter);
+		}
+		double spawnMs = bench_now_ms() - start;
+
+		unsigned int grain = count / (threads * 4);
+		std::vector<double> partial(count / grain + 1);
+		bench_work w = { values.data(), partial.data(), grain };
+		parallel_for(count, grain, bench_sum, &w); // warm up
+
+		const int runs = 5;
+		start = bench_now_ms();
+		for (int r = 0; r < runs; r++) {
+			parallel_for(count, grain, bench_sum, &w);
+		}
+		double ms = (bench_now_ms() - start) / runs;
+		if (threads == 1) {
+			singleMs = ms;
+		}
+
+		printf("  %u thread(s): %.0f ns per empty job, parallel_for %.3f ms (%.0f%% efficiency)\n",
+			threads, spawnMs * 1e6 / spawnCount, ms, singleMs / (ms * threads) * 100.0);
+
+		job_system_shutdown();
+	}
+
+	if (wasRunning) {
+		job_system_init(previousThreads);
+	}
+}
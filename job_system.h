@@ -0,0 +1,52 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// one worker per core (the thread calling job_system_init counts as worker 0),
+// each with a Chase-Lev deque. a worker pushes and pops its own jobs at the
+// bottom, idle workers steal from the top of someone else's. threads that
+// aren't workers (the simulation thread, say) go through a shared queue
+
+typedef void (*job_fn)(void *data);
+
+struct job_counter;
+
+struct job {
+	job_fn fn;
+	void *data;
+	job_counter *counter; // decremented when fn returns, can be NULL
+};
+
+// how many jobs are still outstanding. waiting on one is how dependencies work,
+// and job_run_after hangs a job off one so it only starts once it hits zero
+struct job_counter {
+	std::atomic<int> pending;
+	std::mutex lock;
+	std::vector<job> continuations;
+
+	job_counter() : pending(0) {}
+};
+
+// 0 picks hardware_concurrency. until this is called (and after shutdown)
+// everything below runs inline on the calling thread
+void job_system_init(unsigned int threadCount);
+void job_system_shutdown();
+unsigned int job_system_thread_count();
+
+void job_run(job_fn fn, void *data, job_counter *counter);
+void job_run_after(job_counter *dependency, job_fn fn, void *data, job_counter *counter);
+
+// runs other jobs while it waits so it's safe to call from inside a job
+void job_wait(job_counter *counter);
+
+// calls fn(begin, end, user) over [0, count) in chunks of grain and waits for
+// all of them. grain 0 picks one that gives every thread a few chunks to steal
+void parallel_for(unsigned int count, unsigned int grain,
+	void (*fn)(unsigned int begin, unsigned int end, void *user), void *user);
+
+void job_bench();
+
+#endif
@@ -0,0 +1,449 @@
+#include "lod.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+#include "glad/glad.h"
+#include "microbench.h"
+
+// symmetric 4x4 error quadric, only the upper triangle is stored.
+// w is the total plane weight so cost / w gives back a squared distance
+struct quadric {
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+	double w;
+};
+
+static void quadric_add_plane(quadric &q, double a, double b, double c, double d, double w) {
+	q.a00 += w * a * a; q.a01 += w * a * b; q.a02 += w * a * c; q.a03 += w * a * d;
+	q.a11 += w * b * b; q.a12 += w * b * c; q.a13 += w * b * d;
+	q.a22 += w * c * c; q.a23 += w * c * d;
+	q.a33 += w * d * d;
+	q.w += w;
+}
+
+static void quadric_add(quadric &q, const quadric &o) {
+	q.a00 += o.a00; q.a01 += o.a01; q.a02 += o.a02; q.a03 += o.a03;
+	q.a11 += o.a11; q.a12 += o.a12; q.a13 += o.a13;
+	q.a22 += o.a22; q.a23 += o.a23;
+	q.a33 += o.a33;
+	q.w += o.w;
+}
+
+// squared distance of p to the planes in q (area weighted average)
+static double quadric_error(const quadric &a, const quadric &b, const float *p) {
+	double x = p[0], y = p[1], z = p[2];
+	double a00 = a.a00 + b.a00, a01 = a.a01 + b.a01, a02 = a.a02 + b.a02, a03 = a.a03 + b.a03;
+	double a11 = a.a11 + b.a11, a12 = a.a12 + b.a12, a13 = a.a13 + b.a13;
+	double a22 = a.a22 + b.a22, a23 = a.a23 + b.a23;
+	double a33 = a.a33 + b.a33;
+	double w = a.w + b.w;
+
+	double e = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+		+ a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+		+ a22 * z * z + 2.0 * a23 * z
+		+ a33;
+
+	if (e < 0.0 || w <= 0.0) {
+		return 0.0; // rounding
+	}
+	return e / w;
+}
+
+static void triangle_normal(const float *p0, const float *p1, const float *p2, double n[3]) {
+	double ux = p1[0] - p0[0], uy = p1[1] - p0[1], uz = p1[2] - p0[2];
+	double vx = p2[0] - p0[0], vy = p2[1] - p0[1], vz = p2[2] - p0[2];
+	n[0] = uy * vz - uz * vy;
+	n[1] = uz * vx - ux * vz;
+	n[2] = ux * vy - uy * vx;
+}
+
+static uint64_t edge_key(unsigned int a, unsigned int b) {
+	if (a > b) {
+		std::swap(a, b);
+	}
+	return ((uint64_t) a << 32) | b;
+}
+
+struct collapse {
+	double cost;
+	unsigned int from, to;
+	unsigned int stampFrom, stampTo;
+
+	bool operator>(const collapse &o) const { return cost > o.cost; }
+};
+
+std::vector<unsigned int> lod_simplify(const mesh &m, const std::vector<unsigned int> &indices,
+	unsigned int targetIndexCount, float *error) {
+
+	const float *pos = m.positions.data();
+	unsigned int vertexCount = m.vertex_count();
+	unsigned int triCount = (unsigned int) (indices.size() / 3);
+
+	std::vector<unsigned int> tris(indices);
+	std::vector<char> triDead(triCount, 0);
+	std::vector<char> vertDead(vertexCount, 0);
+	std::vector<unsigned int> stamp(vertexCount, 0);
+	std::vector<quadric> quadrics(vertexCount);
+	std::vector<std::vector<unsigned int> > vertTris(vertexCount);
+
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		quadric zero = {};
+		quadrics[v] = zero;
+	}
+
+	// how many triangles use each edge, 1 means it's on the border
+	std::unordered_map<uint64_t, int> edgeUse;
+	edgeUse.reserve(indices.size());
+
+	for (unsigned int t = 0; t < triCount; t++) {
+		const unsigned int *tri = &tris[t * 3];
+		for (int k = 0; k < 3; k++) {
+			vertTris[tri[k]].push_back(t);
+			edgeUse[edge_key(tri[k], tri[(k + 1) % 3])]++;
+		}
+
+		double n[3];
+		triangle_normal(pos + tri[0] * 3, pos + tri[1] * 3, pos + tri[2] * 3, n);
+		double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0) {
+			continue;
+		}
+		n[0] /= len; n[1] /= len; n[2] /= len;
+
+		const float *p0 = pos + tri[0] * 3;
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		double area = len * 0.5;
+
+		for (int k = 0; k < 3; k++) {
+			quadric_add_plane(quadrics[tri[k]], n[0], n[1], n[2], d, area);
+		}
+	}
+
+	// border edges get an extra plane perpendicular to the face so the
+	// outline of open meshes (like the grid) doesn't get eaten away
+	const double borderWeight = 10.0;
+	for (unsigned int t = 0; t < triCount; t++) {
+		const unsigned int *tri = &tris[t * 3];
+		for (int k = 0; k < 3; k++) {
+			unsigned int a = tri[k], b = tri[(k + 1) % 3];
+			if (edgeUse[edge_key(a, b)] != 1) {
+				continue;
+			}
+
+			double n[3];
+			triangle_normal(pos + tri[0] * 3, pos + tri[1] * 3, pos + tri[2] * 3, n);
+			double ex = pos[b * 3 + 0] - pos[a * 3 + 0];
+			double ey = pos[b * 3 + 1] - pos[a * 3 + 1];
+			double ez = pos[b * 3 + 2] - pos[a * 3 + 2];
+
+			double px = ey * n[2] - ez * n[1];
+			double py = ez * n[0] - ex * n[2];
+			double pz = ex * n[1] - ey * n[0];
+			double len = sqrt(px * px + py * py + pz * pz);
+			if (len == 0.0) {
+				continue;
+			}
+			px /= len; py /= len; pz /= len;
+
+			double d = -(px * pos[a * 3 + 0] + py * pos[a * 3 + 1] + pz * pos[a * 3 + 2]);
+			double w = (ex * ex + ey * ey + ez * ez) * borderWeight;
+			quadric_add_plane(quadrics[a], px, py, pz, d, w);
+			quadric_add_plane(quadrics[b], px, py, pz, d, w);
+		}
+	}
+
+	std::priority_queue<collapse, std::vector<collapse>, std::greater<collapse> > heap;
+
+	// only push the cheaper direction, a vertex always collapses onto the other end
+	// of the edge (never to a new position) so the vertex buffer can be shared
+	auto push_edge = [&](unsigned int a, unsigned int b) {
+		double ab = quadric_error(quadrics[a], quadrics[b], pos + b * 3);
+		double ba = quadric_error(quadrics[a], quadrics[b], pos + a * 3);
+		collapse c;
+		if (ab <= ba) {
+			c.cost = ab; c.from = a; c.to = b;
+		} else {
+			c.cost = ba; c.from = b; c.to = a;
+		}
+		c.stampFrom = stamp[c.from];
+		c.stampTo = stamp[c.to];
+		heap.push(c);
+	};
+
+	for (std::unordered_map<uint64_t, int>::const_iterator it = edgeUse.begin(); it != edgeUse.end(); ++it) {
+		push_edge((unsigned int) (it->first >> 32), (unsigned int) (it->first & 0xffffffffu));
+	}
+
+	unsigned int liveTris = triCount;
+	double maxError = 0.0;
+	std::vector<unsigned int> neighboursFrom, neighboursTo;
+
+	while (liveTris * 3 > targetIndexCount && !heap.empty()) {
+		collapse c = heap.top();
+		heap.pop();
+
+		if (vertDead[c.from] || vertDead[c.to] || stamp[c.from] != c.stampFrom || stamp[c.to] != c.stampTo) {
+			continue; // stale entry
+		}
+
+		// link condition: the two ends may only share the vertices opposite the
+		// edge, otherwise the collapse pinches the surface into a non-manifold
+		neighboursFrom.clear();
+		neighboursTo.clear();
+		int sharedTris = 0;
+		for (size_t i = 0; i < vertTris[c.from].size(); i++) {
+			unsigned int t = vertTris[c.from][i];
+			if (triDead[t]) {
+				continue;
+			}
+			bool hasTo = false;
+			for (int k = 0; k < 3; k++) {
+				hasTo |= tris[t * 3 + k] == c.to;
+				if (tris[t * 3 + k] != c.from) {
+					neighboursFrom.push_back(tris[t * 3 + k]);
+				}
+			}
+			sharedTris += hasTo;
+		}
+		for (size_t i = 0; i < vertTris[c.to].size(); i++) {
+			unsigned int t = vertTris[c.to][i];
+			if (triDead[t]) {
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (tris[t * 3 + k] != c.to) {
+					neighboursTo.push_back(tris[t * 3 + k]);
+				}
+			}
+		}
+		std::sort(neighboursFrom.begin(), neighboursFrom.end());
+		neighboursFrom.erase(std::unique(neighboursFrom.begin(), neighboursFrom.end()), neighboursFrom.end());
+		std::sort(neighboursTo.begin(), neighboursTo.end());
+		neighboursTo.erase(std::unique(neighboursTo.begin(), neighboursTo.end()), neighboursTo.end());
+
+		int sharedVerts = 0;
+		for (size_t i = 0, j = 0; i < neighboursFrom.size() && j < neighboursTo.size();) {
+			if (neighboursFrom[i] < neighboursTo[j]) {
+				i++;
+			} else if (neighboursFrom[i] > neighboursTo[j]) {
+				j++;
+			} else {
+				if (neighboursFrom[i] != c.to && neighboursFrom[i] != c.from) {
+					sharedVerts++;
+				}
+				i++;
+				j++;
+			}
+		}
+		if (sharedTris == 0 || sharedVerts > sharedTris) {
+			continue;
+		}
+
+		// don't let any surviving triangle flip over (or get close to it)
+		bool flips = false;
+		for (size_t i = 0; i < vertTris[c.from].size() && !flips; i++) {
+			unsigned int t = vertTris[c.from][i];
+			unsigned int *tri = &tris[t * 3];
+			if (triDead[t] || tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+				continue;
+			}
+
+			const float *p[3], *q[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = pos + tri[k] * 3;
+				q[k] = tri[k] == c.from ? pos + c.to * 3 : p[k];
+			}
+			double n0[3], n1[3];
+			triangle_normal(p[0], p[1], p[2], n0);
+			triangle_normal(q[0], q[1], q[2], n1);
+			double dot = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+			double len0 = sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+			double len1 = sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+			flips = dot <= 0.25 * len0 * len1;
+		}
+		if (flips) {
+			continue;
+		}
+
+		// do the collapse
+		quadric_add(quadrics[c.to], quadrics[c.from]);
+		vertDead[c.from] = 1;
+		stamp[c.to]++;
+		maxError = std::max(maxError, c.cost);
+
+		for (size_t i = 0; i < vertTris[c.from].size(); i++) {
+			unsigned int t = vertTris[c.from][i];
+			if (triDead[t]) {
+				continue;
+			}
+			unsigned int *tri = &tris[t * 3];
+			if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+				triDead[t] = 1;
+				liveTris--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == c.from) {
+					tri[k] = c.to;
+				}
+			}
+			vertTris[c.to].push_back(t);
+		}
+		vertTris[c.from].clear();
+
+		// drop dead triangles from the survivor and requeue all of its edges
+		std::vector<unsigned int> &around = vertTris[c.to];
+		size_t live = 0;
+		for (size_t i = 0; i < around.size(); i++) {
+			if (!triDead[around[i]]) {
+				around[live++] = around[i];
+			}
+		}
+		around.resize(live);
+
+		for (size_t i = 0; i < around.size(); i++) {
+			const unsigned int *tri = &tris[around[i] * 3];
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] != c.to) {
+					push_edge(c.to, tri[k]); // duplicates are fine, the loser goes stale
+				}
+			}
+		}
+	}
+
+	std::vector<unsigned int> result;
+	result.reserve(liveTris * 3);
+	for (unsigned int t = 0; t < triCount; t++) {
+		if (!triDead[t]) {
+			result.push_back(tris[t * 3 + 0]);
+			result.push_back(tris[t * 3 + 1]);
+			result.push_back(tris[t * 3 + 2]);
+		}
+	}
+
+	if (error) {
+		*error = (float) sqrt(maxError);
+	}
+	return result;
+}
+
+lod_chain lod_build_chain(const mesh &m, int maxLevels, unsigned int minTriangles) {
+	lod_chain chain;
+	mesh_bounds(m, chain.center, &chain.radius);
+
+	chain.indices = m.indices;
+	lod_level base = { 0, (unsigned int) m.indices.size(), 0.0f };
+	chain.levels.push_back(base);
+
+	std::vector<unsigned int> current = m.indices;
+	float error = 0.0f;
+
+	for (int level = 1; level < maxLevels; level++) {
+		unsigned int target = (unsigned int) (current.size() / 3 / 2) * 3;
+		if (target / 3 < minTriangles) {
+			break;
+		}
+
+		float levelError = 0.0f;
+		std::vector<unsigned int> next = lod_simplify(m, current, target, &levelError);
+
+		// simplifier got stuck (everything left is a border or would flip), no point keeping it
+		if (next.empty() || next.size() * 10 > current.size() * 9) {
+			break;
+		}
+
+		// each level is simplified from the previous one so errors stack up
+		error += levelError;
+
+		lod_level l = { (unsigned int) chain.indices.size(), (unsigned int) next.size(), error };
+		chain.indices.insert(chain.indices.end(), next.begin(), next.end());
+		chain.levels.push_back(l);
+
+		current.swap(next);
+	}
+
+	return chain;
+}
+
+int lod_select(const lod_chain &chain, float distance, float fovY, int viewportHeight, float pixelThreshold) {
+	if (distance <= chain.radius) {
+		return 0; // we're inside it
+	}
+
+	// how many pixels one object space unit covers at this distance
+	return lod_select_scale(chain, viewportHeight / (2.0f * tanf(fovY * 0.5f) * distance), pixelThreshold);
+}
+
+int lod_select_scale(const lod_chain &chain, float pixelsPerUnit, float pixelThreshold) {
+	for (int i = (int) chain.levels.size() - 1; i > 0; i--) {
+		if (chain.levels[i].error * pixelsPerUnit <= pixelThreshold) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+void lod_draw(const lod_chain &chain, int level) {
+	const lod_level &l = chain.levels[level];
+	glDrawElements(GL_TRIANGLES, l.indexCount, GL_UNSIGNED_INT, (void *) (l.indexOffset * sizeof(unsigned int)));
+}
+
+void lod_draw_instanced(const lod_chain &chain, int level, int instanceCount) {
+	const lod_level &l = chain.levels[level];
+	glDrawElementsInstanced(GL_TRIANGLES, l.indexCount, GL_UNSIGNED_INT,
+		(void *) (l.indexOffset * sizeof(unsigned int)), instanceCount);
+}
+
+void lod_bench() {
+	mesh sphere = mesh_make_sphere(128, 256, 1.0f);
+
+	double start = bench_now_ms();
+	lod_chain chain = lod_build_chain(sphere, 8, 64);
+	double buildMs = bench_now_ms() - start;
+
+	printf("lod: sphere with %u triangles, chain built in %.2f ms\n", sphere.triangle_count(), buildMs);
+	for (size_t i = 0; i < chain.levels.size(); i++) {
+		printf("  level %zu: %7u triangles, error %.5f\n", i, chain.levels[i].indexCount / 3, chain.levels[i].error);
+	}
+
+	// a field of objects spread from right in front of the camera out to 50 units
+	const int objectCount = 1000;
+	const float fovY = 60.0f * 3.14159265f / 180.0f;
+	const int viewportHeight = 600;
+	std::vector<float> distances(objectCount);
+	unsigned int seed = 12345;
+	for (int i = 0; i < objectCount; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		distances[i] = 1.5f + 48.5f * (float) (seed >> 8) / (float) (1 << 24);
+	}
+
+	unsigned long long withoutLod = 0, withLod = 0;
+	int histogram[16] = {};
+
+	start = bench_now_ms();
+	for (int i = 0; i < objectCount; i++) {
+		int level = lod_select(chain, distances[i], fovY, viewportHeight, 1.0f);
+		withLod += chain.levels[level].indexCount / 3;
+		histogram[level]++;
+	}
+	double selectMs = bench_now_ms() - start;
+
+	withoutLod = (unsigned long long) objectCount * sphere.triangle_count();
+
+	printf("lod: %d objects at 1.5..50 units, 600px viewport, 1px error budget\n", objectCount);
+	printf("  triangles submitted per frame without LOD: %llu\n", withoutLod);
+	printf("  triangles submitted per frame with LOD:    %llu (%.1f%%)\n", withLod, 100.0 * withLod / withoutLod);
+	printf("  selection cost: %.3f ms per frame\n", selectMs);
+	for (size_t i = 0; i < chain.levels.size(); i++) {
+		printf("  objects at level %zu: %d\n", i, histogram[i]);
+	}
+}
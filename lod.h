@@ -0,0 +1,52 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+
+#include "mesh.h"
+
+// one level of detail, a range inside lod_chain::indices
+struct lod_level {
+	unsigned int indexOffset; // in indices, not bytes
+	unsigned int indexCount;
+	float error; // object space distance the simplified surface can be off by
+};
+
+// all the levels share the original vertex buffer, the simplifier only ever
+// collapses a vertex onto one of its neighbours so no new vertices show up.
+// that way one VBO + one EBO holds the whole chain and picking a LOD is just
+// a different offset/count to glDrawElements
+struct lod_chain {
+	std::vector<unsigned int> indices;
+	std::vector<lod_level> levels;
+	float center[3];
+	float radius;
+};
+
+// quadric error metric edge collapse (Garland & Heckbert) down to targetIndexCount.
+// returns the simplified index list and writes the largest collapse error to *error
+std::vector<unsigned int> lod_simplify(const mesh &m, const std::vector<unsigned int> &indices,
+	unsigned int targetIndexCount, float *error);
+
+// level 0 is the original mesh, every level after that has half the triangles
+// of the one before it (50%, 25%, 12.5% ...). stops at maxLevels or once the
+// simplifier can't make meaningful progress anymore
+lod_chain lod_build_chain(const mesh &m, int maxLevels, unsigned int minTriangles);
+
+// pick the coarsest level whose error projected on screen stays below
+// pixelThreshold. distance is from the eye to the bounding sphere center,
+// fovY in radians, viewportHeight in pixels
+int lod_select(const lod_chain &chain, float distance, float fovY, int viewportHeight, float pixelThreshold);
+
+// the same pick when the size on screen doesn't depend on distance (orthographic,
+// or a 2D scale like --bench sphere). pixelsPerUnit is how many pixels one
+// object space unit covers
+int lod_select_scale(const lod_chain &chain, float pixelsPerUnit, float pixelThreshold);
+
+// draw one level, the mesh's VAO (see mesh_upload_indices(m, chain.indices)) has to be bound
+void lod_draw(const lod_chain &chain, int level);
+void lod_draw_instanced(const lod_chain &chain, int level, int instanceCount);
+
+void lod_bench();
+
+#endif
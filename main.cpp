@@ -1,21 +1,57 @@
+#include <ctype.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
 
 #include "glad/glad.h"
 #include "glfw/include/GLFW/glfw3.h"
 
+#include "benchmark.h"
+#include "capture.h"
+#include "command_list.h"
+#include "cpu_profiler.h"
+#include "frame_pacing.h"
+#include "gl_state.h"
+#include "gpu_profiler.h"
+#include "headless.h"
+#include "indirect.h"
+#include "input.h"
+#include "instancing.h"
+#include "job_system.h"
+#include "microbench.h"
+#include "redraw.h"
+#include "render_queue.h"
+#include "render_target.h"
+#include "scene.h"
+#include "simulation.h"
+
 
 // really simple vertex shader
+// aTransform and aColor come from the instance buffer (one per instance)
+// uOffset is where the simulation has moved everything to
 const char *vertexShaderSource = "#version 330 core\n"
 	"layout (location = 0) in vec3 aPos;\n"
+	"layout (location = 1) in vec4 aTransform;\n" // xy offset, z scale, w rotation
+	"layout (location = 2) in vec4 aColor;\n"
+	"uniform vec2 uOffset;\n"
+	"out vec4 vColor;\n"
 	"void main() {\n"
-	"	gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0f);\n"
+	"	float c = cos(aTransform.w);\n"
+	"	float s = sin(aTransform.w);\n"
+	"	vec2 p = mat2(c, s, -s, c) * (aPos.xy * aTransform.z) + aTransform.xy + uOffset;\n"
+	"	gl_Position = vec4(p.x, p.y, aPos.z, 1.0f);\n"
+	"	vColor = aColor;\n"
 	"}\0";
 
 // really simple fragment shader
 const char *fragmentShaderSource = "#version 330 core\n"
+	"in vec4 vColor;\n"
 	"out vec4 FragColor;\n"
 	"void main() {\n" 
-	"	FragColor = vec4(1.0f, 1.0f, 0.2f, 1.0f);\n"
+	"	FragColor = vColor;\n"
 	"}";
 
 const char *fragmentShaderSourceYellow = "#version 330 core\n"
@@ -26,32 +62,193 @@ const char *fragmentShaderSourceYellow = "#version 330 core\n"
 
 // declare all the function prototypes (I apologize for the bad coding practice)
 
+// what the window callbacks need to get at, hung off the window's user pointer
+struct window_user {
+	render_surface *surface;
+	redraw_state *redraw;
+};
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-	glViewport(0, 0, width, height);
+	window_user *user = (window_user *) glfwGetWindowUserPointer(window);
+	if (user->redraw) {
+		redraw_mark(user->redraw, REDRAW_WINDOW);
+	}
+
+	// drawing offscreen, the targets only follow once the size stops changing
+	if (user->surface) {
+		render_surface_resize(user->surface, width, height, bench_now_ms());
+	} else {
+		gls_viewport(0, 0, width, height);
+	}
 }
 
-void processInput(GLFWwindow *window) {
+// not a simulation key, main acts on it itself
+#define KEY_QUIT (1u << 8)
+
+void processInput(GLFWwindow *window, input_queue *input) {
 
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE)) {
+	if (input_pressed(input) & KEY_QUIT) {
 		glfwSetWindowShouldClose(window, true);
 	}
 
 }
 
-int main() {
+int main(int argc, char **argv) {
+
+	// CPU only benchmarks, no window needed
+	if (argc > 1 && strcmp(argv[1], "--microbench") == 0) {
+		return run_microbench(argc > 2 ? argv[2] : "all");
+	}
+
+	// stress scenes: draw this many instances / separate draws instead of the triforce
+	unsigned int stressInstances = 0;
+	unsigned int indirectDraws = 0;
+	unsigned int commandDraws = 0;
+
+	// frame pacing, defaults to vsync with at most 2 frames queued on the GPU
+	vsync_mode vsync = VSYNC_ON;
+	double targetFps = 0.0;
+	unsigned int framesInFlight = 2;
+	bool reportPacing = false;
+
+	double tickRate = 50.0;
+
+	// GPU/CPU timeline per pass, written out as a Chrome trace when the window closes
+	const char *profilePath = NULL;
+	const char *cpuProfilePath = NULL;
+
+	// every frame read back and written out by encoder threads
+	const char *capturePath = NULL;
+	capture_format captureFormat = CAPTURE_PNG;
+
+	// draw into pooled offscreen targets (optionally multisampled) and blit them to the window
+	bool offscreen = false;
+	int offscreenSamples = 1;
+
+	// only draw when something changed, sleeping in glfwWaitEvents otherwise
+	bool onDemand = false;
+
+	// read the keys again right before submitting and draw the triforce where they put it
+	bool lateLatch = false;
+
+	// no display: render this many frames into an FBO and exit
+	bool headless = false;
+	unsigned int headlessFrames = 600;
+	headless_api headlessApi = HEADLESS_EGL;
+	bool headlessApiGiven = false;
+
+	// parametric benchmark scenes instead of the normal loop
+	bool benchmark = false;
+	benchmark_options bench;
+	bench.shape = BENCH_TRIFORCE;
+	parse_object_counts("1000,10000,100000", &bench.objectCounts);
+	bench.frames = 600;
+	bench.warmupFrames = 60;
+	bench.batch = 0;
+	bench.outPath = "bench.json";
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			stressInstances = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--indirect") == 0 && i + 1 < argc) {
+			indirectDraws = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--commands") == 0 && i + 1 < argc) {
+			commandDraws = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+			if (!parse_vsync_mode(argv[++i], &vsync)) {
+				printf("--vsync takes on, off or adaptive\n");
+				return 1;
+			}
+			reportPacing = true;
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			targetFps = strtod(argv[++i], NULL);
+			reportPacing = true;
+		} else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+			framesInFlight = (unsigned int) strtoul(argv[++i], NULL, 10);
+			reportPacing = true;
+		} else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+			tickRate = strtod(argv[++i], NULL);
+		} else if (strcmp(argv[i], "--gpu-profile") == 0 && i + 1 < argc) {
+			profilePath = argv[++i];
+		} else if (strcmp(argv[i], "--cpu-profile") == 0 && i + 1 < argc) {
+			cpuProfilePath = argv[++i];
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+			if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+				headlessFrames = (unsigned int) strtoul(argv[++i], NULL, 10);
+			}
+		} else if (strcmp(argv[i], "--context") == 0 && i + 1 < argc) {
+			if (!parse_headless_api(argv[++i], &headlessApi)) {
+				printf("--context takes egl or osmesa\n");
+				return 1;
+			}
+			headlessApiGiven = true;
+		} else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			if (!parse_benchmark_shape(argv[++i], &bench.shape)) {
+				printf("--bench takes triangle, rect, triforce or sphere\n");
+				return 1;
+			}
+			benchmark = true;
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			bench.frames = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+			bench.warmupFrames = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+			if (!parse_object_counts(argv[++i], &bench.objectCounts)) {
+				printf("--objects takes a comma separated list of counts, like 1000,10000,100000\n");
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+			bench.batch = (unsigned int) strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+			bench.outPath = argv[++i];
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capturePath = argv[++i];
+		} else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+			if (!parse_capture_format(argv[++i], &captureFormat)) {
+				printf("--capture-format takes png or raw\n");
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--late-latch") == 0) {
+			lateLatch = true;
+		} else if (strcmp(argv[i], "--on-demand") == 0) {
+			onDemand = true;
+		} else if (strcmp(argv[i], "--offscreen") == 0) {
+			offscreen = true;
+			if (i + 1 < argc && isdigit((unsigned char) argv[i + 1][0])) {
+				offscreenSamples = atoi(argv[++i]);
+			}
+		}
+	}
+
+	if (headless) {
+		headless_init_hints();
+		// nothing to sync to
+		vsync = VSYNC_OFF;
+		// and no events to wait for, the frame count is what ends the run
+		if (onDemand) {
+			printf("--on-demand does nothing with --headless\n");
+			onDemand = false;
+		}
+	}
 
 	if (!glfwInit()) {
 		printf("GLFW failed to initalize\n");
 		return 1; //error something went wrong!
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	// multi draw indirect needs 4.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, indirectDraws > 0 ? 4 : 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	// create a window object
-	GLFWwindow *window = glfwCreateWindow(800, 600, "Testing", NULL, NULL);
+	// create a window object. headless, EGL first and OSMesa if that doesn't work out
+	GLFWwindow *window = NULL;
+	if (headless) {
+		window = headless_create_window(&headlessApi, !headlessApiGiven, 800, 600, indirectDraws > 0 ? 4 : 3, 3);
+	} else {
+		window = glfwCreateWindow(800, 600, "Testing", NULL, NULL);
+	}
 
 	if (window == NULL) {
 		printf("Failed to create GLFW window");
@@ -59,15 +256,84 @@ int main() {
 		return -1;
 	}
 
-	glfwMakeContextCurrent(window); // make window the current context object
+	// make window the current context object (headless already did its own)
+	if (!headless) {
+		glfwMakeContextCurrent(window);
+	}
 
 	// try to intialize glad
-	if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+	if (!gladLoadGLLoader(headless ? (GLADloadproc) headless_get_proc_address : (GLADloadproc) glfwGetProcAddress)) {
 		printf("Failed to initalize Glad\n");
 		return -1;
 	}
 
-	glViewport(0, 0, 800, 600);
+	// start the state shadow off as "unknown" now that there's a context
+	gl_state_invalidate();
+
+	// one worker per core, everything that goes wide schedules onto these
+	job_system_init(0);
+
+	gls_viewport(0, 0, 800, 600);
+
+	headless_target headlessTarget;
+	if (headless) {
+		if (!headless_target_create(&headlessTarget, 800, 600)) {
+			headless_destroy_context();
+			job_system_shutdown();
+			glfwTerminate();
+			return -1;
+		}
+		printf("headless: rendering into an 800x600 FBO, %s context, %s\n",
+			headless_api_name(headlessApi), (const char *) glGetString(GL_RENDERER));
+	}
+
+	// the benchmark brings its own scenes and loop, none of the setup below is needed
+	if (benchmark) {
+		bench.framesInFlight = framesInFlight;
+		bench.present = !headless;
+		int result = benchmark_run(window, bench);
+		if (headless) {
+			headless_target_destroy(&headlessTarget);
+			headless_destroy_context();
+		}
+		job_system_shutdown();
+		glfwTerminate();
+		return result;
+	}
+
+	window_user user = { NULL, NULL };
+	glfwSetWindowUserPointer(window, &user);
+
+	rt_pool targetPool;
+	render_surface surface;
+	if (offscreen) {
+		int surfaceWidth = 800, surfaceHeight = 600;
+		if (!headless) {
+			glfwGetFramebufferSize(window, &surfaceWidth, &surfaceHeight);
+		}
+		rt_pool_init(&targetPool);
+		if (!render_surface_init(&surface, &targetPool, surfaceWidth, surfaceHeight, offscreenSamples)) {
+			glfwTerminate();
+			return -1;
+		}
+		user.surface = &surface;
+		printf("offscreen: %dx%d targets, %d samples\n", surfaceWidth, surfaceHeight, surface.samples);
+	}
+
+	redraw_state redraw;
+	if (onDemand) {
+		redraw_init(&redraw, window);
+		user.redraw = &redraw;
+	}
+
+	// key presses as timestamped events, the arrow keys go to the simulation
+	input_queue input;
+	input_init(&input, window);
+	input_bind(&input, GLFW_KEY_LEFT, SIM_KEY_LEFT);
+	input_bind(&input, GLFW_KEY_RIGHT, SIM_KEY_RIGHT);
+	input_bind(&input, GLFW_KEY_UP, SIM_KEY_UP);
+	input_bind(&input, GLFW_KEY_DOWN, SIM_KEY_DOWN);
+	input_bind(&input, GLFW_KEY_ESCAPE, KEY_QUIT);
 
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
@@ -152,7 +418,8 @@ int main() {
 
 
 	// now we try to draw two triangles next to each other
-	// this time using two different VAOs and VBOs
+	// the triforce is three copies of the same triangle, so only triangle_1
+	// goes into the VBO and the other two become per-instance offsets
 
 	// now set up the vertices and indices
 	float triangle_1[] = {
@@ -161,102 +428,336 @@ int main() {
 		-0.25f, 0.0f, 0.0f,
 	};
 
-	float triangle_2[] = {
-		0.0f, -0.5f, 0.0f,
-		0.5f, -0.5f, 0.0f,
-		0.25f, 0.0f, 0.0f,
-	};
-
-
-	float triangle_3[] = {
-		-0.25f, 0.0f, 0.0f,
-		0.25f, 0.0f, 0.0f,
-		0.0f, 0.5f, 0.0f,
+	// the triforce is a root entity with the three triangles hanging off it,
+	// where they go lives in the scene store instead of in the instance data
+	scene_store scene;
+	scene_init(&scene);
+	entity triforceRoot = scene_create(&scene, SCENE_NO_ENTITY);
+	const float triforceOffsets[3][2] = {
+		{ 0.0f, 0.0f }, // where triangle_1 was
+		{ 0.5f, 0.0f }, // triangle_2
+		{ 0.25f, 0.5f }, // triangle_3
 	};
+	entity triforceParts[3];
+	for (int i = 0; i < 3; i++) {
+		triforceParts[i] = scene_create(&scene, triforceRoot);
+		scene_set_position(&scene, triforceParts[i], triforceOffsets[i][0], triforceOffsets[i][1], 0.0f);
+		scene_set_mesh(&scene, triforceParts[i], 0, 0);
+	}
+	scene_update(&scene);
+
+	// xy offset, scale, rotation | color, pulled out of the world matrices
+	instance_data triforce[3];
+	for (int i = 0; i < 3; i++) {
+		const float *w = scene_world_matrix(scene, triforceParts[i]);
+		triforce[i].transform[0] = w[12];
+		triforce[i].transform[1] = w[13];
+		triforce[i].transform[2] = sqrtf(w[0] * w[0] + w[1] * w[1]);
+		triforce[i].transform[3] = atan2f(w[1], w[0]);
+		triforce[i].color[0] = 1.0f;
+		triforce[i].color[1] = 1.0f;
+		triforce[i].color[2] = 0.2f;
+		triforce[i].color[3] = 1.0f;
+	}
 
 
 	// setting up our buffer objects
 	
-	unsigned int VBO1, VAO1;
-	glGenVertexArrays(1, &VAO1); // Vertex Array Object
-	glGenBuffers(1, &VBO1); // Vertex Buffer Array
+	unsigned int VBO, VAO;
+	glGenVertexArrays(1, &VAO); // Vertex Array Object
+	glGenBuffers(1, &VBO); // Vertex Buffer Array
 
-	glBindVertexArray(VAO1); // vertex array is our VAO 
+	gls_bind_vertex_array(VAO); // vertex array is our VAO 
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO1); // VBO is our Array Buffer
-	// put triangle_1 into VBO1
+	gls_bind_buffer(GL_ARRAY_BUFFER, VBO); // VBO is our Array Buffer
+	// put triangle_1 into VBO
 	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle_1), triangle_1, GL_STATIC_DRAW);
 
 	// set vertex attributes
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
 	glEnableVertexAttribArray(0);
 
-	// for the 2nd triangle
-	unsigned int VBO2, VAO2;
-	glGenVertexArrays(1, &VAO2);
-	glGenBuffers(1, &VBO2);
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+	gls_bind_vertex_array(0);
+
+	// per-instance transforms and colors on attributes 1 and 2
+	instance_buffer instances = instance_buffer_create(VAO, 1);
+	if (stressInstances > 0) {
+		std::vector<instance_data> grid;
+		instance_make_grid(grid, stressInstances, -0.5f, -0.5f, 0.5f);
+		instance_buffer_upload(&instances, grid.data(), stressInstances);
+		printf("stress scene: %u instances\n", stressInstances);
+	} else {
+		instance_buffer_upload(&instances, triforce, 3);
+	}
 
-	glBindVertexArray(VAO2);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-	// put triangle 2 into VBO2
-	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle_2), triangle_2, GL_STATIC_DRAW);
+	// every object as its own draw command, all of them in one glMultiDrawArraysIndirect
+	indirect_scene indirectScene;
+	unsigned int recordThreads = std::thread::hardware_concurrency();
+	if (recordThreads == 0) {
+		recordThreads = 1;
+	}
+	if (indirectDraws > 0) {
+		std::vector<instance_data> objects;
+		instance_make_grid(objects, indirectDraws, -0.5f, -0.5f, 0.5f);
+		if (!indirect_scene_create(&indirectScene, VBO, 3, objects)) {
+			indirectDraws = 0;
+		} else {
+			printf("indirect scene: %u draws, %s\n", indirectDraws, indirect_has_draw_id() ? "gl_DrawID" : "baseInstance draw ids");
+		}
+	}
 
-	// set vertex attributes
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
-	glEnableVertexAttribArray(0);
-	
-	// another fucking VAO and VBO
-	unsigned int VBO3, VAO3;
-	glGenVertexArrays(1, &VAO3);
-	glGenBuffers(1, &VBO3);
+	// every object as its own uniform upload + draw, recorded into per-thread command lists
+	command_scene commandScene;
+	if (commandDraws > 0 && indirectDraws == 0) {
+		std::vector<instance_data> objects;
+		instance_make_grid(objects, commandDraws, -0.5f, -0.5f, 0.5f);
+		if (!command_scene_create(&commandScene, VAO, 3, objects, recordThreads)) {
+			commandDraws = 0;
+		} else {
+			printf("command list scene: %u draws recorded on %u thread(s)\n", commandDraws, recordThreads);
+		}
+	} else {
+		commandDraws = 0;
+	}
 
-	glBindVertexArray(VAO3);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO3);
-	// put triangle 3 into VBO3
-	glBufferData(GL_ARRAY_BUFFER, sizeof(triangle_3), triangle_3, GL_STATIC_DRAW);
+	render_queue queue;
 
-	// set vertex attributes
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
-	glEnableVertexAttribArray(0);
+	frame_pacer pacer;
+	frame_pacer_init(&pacer, vsync, targetFps, framesInFlight);
+	int pacingFrames = 0;
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	gpu_profiler profiler;
+	if (profilePath) {
+		gpu_profiler_init(&profiler, 100000);
+	}
+	int profileFrames = 0;
 
+	// zones from every thread, flushed to a trace file in the background
+	PROFILE_THREAD_NAME("main");
+	if (cpuProfilePath) {
+		cpu_profiler_start(cpuProfilePath);
+	}
+
+	int offsetLocation = glGetUniformLocation(shaderProgram, "uOffset");
+
+	// fixed rate simulation on its own thread, the loop below only ever reads its snapshots
+	simulation sim;
+	simulation_start(&sim, tickRate, &input);
+
+	double submitMs = 0.0;
+	int statFrames = 0;
+	unsigned int filteredCalls = 0;
+
+	// the size is fixed for the whole recording, resizing the window crops it
+	capture recorder;
+	if (capturePath) {
+		int captureWidth = 800, captureHeight = 600;
+		if (!headless) {
+			glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+		}
+		if (!capture_init(&recorder, captureFormat, capturePath, captureWidth, captureHeight, 0)) {
+			capturePath = NULL;
+		}
+	}
+
+	unsigned int frameCount = 0;
+	double runStartMs = bench_now_ms();
 	
 	// render loop
 
-	while (!glfwWindowShouldClose(window)) {
+	while (!glfwWindowShouldClose(window) && (!headless || frameCount < headlessFrames)) {
+		PROFILE_ZONE("frame");
+
+		// nothing has changed since the last frame: sleep until something does.
+		// a resize that's still settling needs one more frame once it has
+		if (onDemand) {
+			PROFILE_ZONE("redraw_wait");
+			bool settling = offscreen && surface.resize.pending;
+			if (!redraw_wait(&redraw, window, settling ? RT_RESIZE_SETTLE_MS : -1.0) && !settling) {
+				continue;
+			}
+		}
+
+		// wait for the GPU (and the frame limiter) before polling, not after,
+		// so the input we act on is as fresh as it can be
+		{
+			PROFILE_ZONE("frame_pacer_begin_frame");
+			frame_pacer_begin_frame(&pacer);
+		}
+
 		// input
-		processInput(window);
+		{
+			PROFILE_ZONE("glfwPollEvents");
+			glfwPollEvents();
+		}
+		{
+			PROFILE_ZONE("processInput");
+			processInput(window, &input);
+		}
+
+		if (offscreen) {
+			render_surface_begin_frame(&surface, bench_now_ms());
+		}
+
+		if (profilePath) {
+			gpu_profiler_begin_frame(&profiler);
+			gpu_profiler_push(&profiler, "clear");
+		}
 
 		//render
-		glClearColor(0.2f, 0.8f, 0.2f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
+		{
+			PROFILE_ZONE("clear");
+			gls_clear_color(0.2f, 0.8f, 0.2f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+
+		if (profilePath) {
+			gpu_profiler_pop(&profiler);
+			gpu_profiler_push(&profiler, indirectDraws > 0 ? "indirect draws" : commandDraws > 0 ? "command lists" : "triforce");
+		}
+
+		// one draw call no matter how many instances (or indirect draws) there are
+		double submitStart = bench_now_ms();
+		{
+			PROFILE_ZONE("draw");
+			if (indirectDraws > 0) {
+				indirect_scene_draw(&indirectScene, recordThreads);
+			} else if (commandDraws > 0) {
+				command_scene_draw(&commandScene);
+			} else {
+				sim_state simState;
+				if (lateLatch) {
+					PROFILE_ZONE("input_latch");
+					unsigned int keys = input_latch(&input);
+					sim_extrapolate(simulation_latest(&sim), keys, sim.tickMs, bench_now_ms(), &simState);
+				} else {
+					sim_interpolate(simulation_latest(&sim), sim.tickMs, bench_now_ms(), &simState);
+				}
+				gls_use_program(shaderProgram);
+				glUniform2f(offsetLocation, simState.offset[0], simState.offset[1]);
+
+				// everything goes through the sort-key queue so draws get grouped by
+				// state instead of landing in whatever order they were written here
+				render_queue_clear(&queue);
+				render_cmd triforceCmd = { shaderProgram, VAO, 0, GL_TRIANGLES, false, 0, 3, 0, (GLsizei) instances.count };
+				render_queue_push(&queue, render_key_encode(0, shaderProgram, VAO, 0, 0.0f, false), triforceCmd);
+				render_queue_sort(&queue);
+				render_queue_submit(&queue, NULL, NULL, NULL);
+			}
+		}
+		submitMs += bench_now_ms() - submitStart;
+
+		if (profilePath) {
+			gpu_profiler_pop(&profiler);
+			gpu_profiler_end_frame(&profiler);
+		}
+
+		if (offscreen) {
+			PROFILE_ZONE("present");
+			render_surface_present(&surface, headless ? headlessTarget.fbo : 0);
+			rt_pool_end_frame(&targetPool);
+		}
+
+		// the back buffer is still the read buffer until it's swapped
+		if (capturePath) {
+			PROFILE_ZONE("capture");
+			capture_frame(&recorder);
+		}
+
+		// there's no surface to present to headless, just get the frame going
+		if (headless) {
+			glFlush();
+		} else {
+			PROFILE_ZONE("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+		}
+		frameCount++;
+		frame_pacer_end_frame(&pacer);
+
+		// the triforce keeps sliding for a while after the keys are let go
+		if (onDemand && indirectDraws == 0 && commandDraws == 0 && !simulation_at_rest(&sim)) {
+			redraw_mark(&redraw, REDRAW_SCENE);
+		}
+
+		filteredCalls += gl_state_end_frame().filtered;
+
+		// CPU submission cost should stay flat whatever --instances is
+		if ((stressInstances > 0 || indirectDraws > 0 || commandDraws > 0) && ++statFrames == 300) {
+			unsigned int drawn = indirectDraws > 0 ? indirectDraws : commandDraws > 0 ? commandDraws : stressInstances;
+			const char *what = indirectDraws > 0 ? "indirect draws" : commandDraws > 0 ? "command list draws" : "instances";
+			printf("%u %s: %.4f ms CPU submit per frame, %.1f redundant GL calls filtered per frame\n",
+				drawn, what, submitMs / statFrames, (double) filteredCalls / statFrames);
+			submitMs = 0.0;
+			statFrames = 0;
+			filteredCalls = 0;
+		}
+
+		if (profilePath && ++profileFrames == 300) {
+			gpu_profiler_report(&profiler);
+			profileFrames = 0;
+		}
+
+		if (reportPacing && ++pacingFrames == 300) {
+			frame_pacer_report(&pacer, pacingFrames);
+			pacingFrames = 0;
+		}
+	}
 
-		//draw first triangle
-		glUseProgram(shaderProgram);
-		glBindVertexArray(VAO1);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+	if (capturePath) {
+		capture_finish(&recorder);
+	}
 
-		// draw second triangle
-		//glUseProgram(yellowShaderProgram);
-		glBindVertexArray(VAO2);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+	if (onDemand) {
+		redraw_report(redraw, bench_now_ms() - runStartMs);
+	}
 
+	if (offscreen) {
+		user.surface = NULL;
+		render_surface_destroy(&surface);
+		rt_pool_destroy(&targetPool);
+	}
 
-		glBindVertexArray(VAO3);
-		glDrawArrays(GL_TRIANGLES, 0, 3);
+	if (headless) {
+		glFinish();
+		double runMs = bench_now_ms() - runStartMs;
+		if (frameCount > 0) {
+			printf("headless: %u frames in %.1f ms, %.3f ms per frame (%.1f fps)\n",
+				frameCount, runMs, runMs / frameCount, frameCount * 1000.0 / runMs);
+		} else {
+			printf("headless: no frames rendered\n");
+		}
+		headless_target_destroy(&headlessTarget);
+	}
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	simulation_stop(&sim);
+	if (input.dropped.load() > 0) {
+		printf("input: %u events dropped, the queue was full\n", input.dropped.load());
+	}
+	if (cpuProfilePath) {
+		cpu_profiler_stop();
+	}
+	job_system_shutdown();
+	frame_pacer_destroy(&pacer);
+	if (profilePath) {
+		gpu_profiler_write_trace(&profiler, profilePath);
+		gpu_profiler_destroy(&profiler);
 	}
 	
-	glDeleteVertexArrays(1, &VAO1);
-	glDeleteVertexArrays(1, &VAO2);
-	glDeleteBuffers(1, &VBO1);
-	glDeleteBuffers(1, &VBO2);
+	if (indirectDraws > 0) {
+		indirect_scene_destroy(&indirectScene);
+	}
+	if (commandDraws > 0) {
+		command_scene_destroy(&commandScene);
+	}
+	instance_buffer_destroy(&instances);
+	gls_delete_vertex_arrays(1, &VAO);
+	gls_delete_buffers(1, &VBO);
 	glDeleteProgram(shaderProgram);
 	glDeleteProgram(yellowShaderProgram);
+	if (headless) {
+		headless_destroy_context();
+	}
 
 	printf("Successfully ran the test. Returning 0... \n");
 	return 0; 
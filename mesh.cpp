@@ -0,0 +1,152 @@
+#include "mesh.h"
+
+#include <math.h>
+
+#include "glad/glad.h"
+#include "gl_state.h"
+
+mesh mesh_make_grid(int cellsX, int cellsY, float size) {
+	mesh m;
+
+	for (int y = 0; y <= cellsY; y++) {
+		for (int x = 0; x <= cellsX; x++) {
+			m.positions.push_back(((float) x / cellsX - 0.5f) * size);
+			m.positions.push_back(((float) y / cellsY - 0.5f) * size);
+			m.positions.push_back(0.0f);
+		}
+	}
+
+	// two triangles per cell, counter clockwise
+	for (int y = 0; y < cellsY; y++) {
+		for (int x = 0; x < cellsX; x++) {
+			unsigned int i0 = y * (cellsX + 1) + x;
+			unsigned int i1 = i0 + 1;
+			unsigned int i2 = i0 + (cellsX + 1);
+			unsigned int i3 = i2 + 1;
+
+			m.indices.push_back(i0); m.indices.push_back(i1); m.indices.push_back(i3);
+			m.indices.push_back(i0); m.indices.push_back(i3); m.indices.push_back(i2);
+		}
+	}
+
+	return m;
+}
+
+mesh mesh_make_sphere(int rings, int segments, float radius) {
+	mesh m;
+	const float pi = 3.14159265358979f;
+
+	// poles are single vertices so the mesh is closed (no seams or slivers)
+	m.positions.push_back(0.0f); m.positions.push_back(radius); m.positions.push_back(0.0f);
+
+	for (int r = 1; r < rings; r++) {
+		float phi = pi * r / rings;
+		for (int s = 0; s < segments; s++) {
+			float theta = 2.0f * pi * s / segments;
+			m.positions.push_back(radius * sinf(phi) * cosf(theta));
+			m.positions.push_back(radius * cosf(phi));
+			m.positions.push_back(radius * sinf(phi) * sinf(theta));
+		}
+	}
+
+	m.positions.push_back(0.0f); m.positions.push_back(-radius); m.positions.push_back(0.0f);
+
+	unsigned int bottom = m.vertex_count() - 1;
+
+	// top cap
+	for (int s = 0; s < segments; s++) {
+		m.indices.push_back(0);
+		m.indices.push_back(1 + (s + 1) % segments);
+		m.indices.push_back(1 + s);
+	}
+
+	// bands
+	for (int r = 0; r < rings - 2; r++) {
+		unsigned int row = 1 + r * segments;
+		unsigned int next = row + segments;
+		for (int s = 0; s < segments; s++) {
+			unsigned int s1 = (s + 1) % segments;
+			m.indices.push_back(row + s); m.indices.push_back(row + s1); m.indices.push_back(next + s1);
+			m.indices.push_back(row + s); m.indices.push_back(next + s1); m.indices.push_back(next + s);
+		}
+	}
+
+	// bottom cap
+	unsigned int last = 1 + (rings - 2) * segments;
+	for (int s = 0; s < segments; s++) {
+		m.indices.push_back(bottom);
+		m.indices.push_back(last + s);
+		m.indices.push_back(last + (s + 1) % segments);
+	}
+
+	return m;
+}
+
+void mesh_bounds(const mesh &m, float center[3], float *radius) {
+	center[0] = center[1] = center[2] = 0.0f;
+	*radius = 0.0f;
+
+	unsigned int count = m.vertex_count();
+	if (count == 0) {
+		return;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		center[0] += m.positions[i * 3 + 0];
+		center[1] += m.positions[i * 3 + 1];
+		center[2] += m.positions[i * 3 + 2];
+	}
+	center[0] /= count;
+	center[1] /= count;
+	center[2] /= count;
+
+	float maxDist2 = 0.0f;
+	for (unsigned int i = 0; i < count; i++) {
+		float dx = m.positions[i * 3 + 0] - center[0];
+		float dy = m.positions[i * 3 + 1] - center[1];
+		float dz = m.positions[i * 3 + 2] - center[2];
+		float d2 = dx * dx + dy * dy + dz * dz;
+		if (d2 > maxDist2) {
+			maxDist2 = d2;
+		}
+	}
+	*radius = sqrtf(maxDist2);
+}
+
+gpu_mesh mesh_upload_indices(const mesh &m, const std::vector<unsigned int> &indices) {
+	gpu_mesh gm;
+	gm.indexCount = (unsigned int) indices.size();
+
+	glGenVertexArrays(1, &gm.VAO);
+	glGenBuffers(1, &gm.VBO);
+	glGenBuffers(1, &gm.EBO);
+
+	gls_bind_vertex_array(gm.VAO);
+
+	gls_bind_buffer(GL_ARRAY_BUFFER, gm.VBO);
+	glBufferData(GL_ARRAY_BUFFER, m.positions.size() * sizeof(float), m.positions.data(), GL_STATIC_DRAW);
+
+	// the EBO binding is part of the VAO state so leave it bound
+	gls_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, gm.EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *) 0);
+	glEnableVertexAttribArray(0);
+
+	gls_bind_vertex_array(0);
+	gls_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	return gm;
+}
+
+gpu_mesh mesh_upload(const mesh &m) {
+	return mesh_upload_indices(m, m.indices);
+}
+
+void mesh_destroy(gpu_mesh *gm) {
+	gls_delete_vertex_arrays(1, &gm->VAO);
+	gls_delete_buffers(1, &gm->VBO);
+	gls_delete_buffers(1, &gm->EBO);
+	gm->VAO = gm->VBO = gm->EBO = 0;
+	gm->indexCount = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+
+// indexed triangle mesh, positions are packed xyz floats the same way the
+// triangle arrays in main.cpp are (3 * sizeof(float) stride)
+struct mesh {
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+
+	unsigned int vertex_count() const { return (unsigned int) (positions.size() / 3); }
+	unsigned int triangle_count() const { return (unsigned int) (indices.size() / 3); }
+};
+
+// the VAO/VBO/EBO triple you get from uploading a mesh
+struct gpu_mesh {
+	unsigned int VAO;
+	unsigned int VBO;
+	unsigned int EBO;
+	unsigned int indexCount;
+};
+
+// procedural test geometry, we don't have a model loader yet
+mesh mesh_make_grid(int cellsX, int cellsY, float size);
+mesh mesh_make_sphere(int rings, int segments, float radius);
+
+// bounding sphere around the centroid (not minimal but good enough for LOD/culling)
+void mesh_bounds(const mesh &m, float center[3], float *radius);
+
+// upload positions and indices into a new VAO with attribute 0 = vec3 position
+gpu_mesh mesh_upload(const mesh &m);
+// same thing but with a different index list (e.g. a LOD chain or a culled stream)
+gpu_mesh mesh_upload_indices(const mesh &m, const std::vector<unsigned int> &indices);
+void mesh_destroy(gpu_mesh *gm);
+
+#endif
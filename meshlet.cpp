@@ -0,0 +1,380 @@
+#include "meshlet.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "glad/glad.h"
+#include "gl_state.h"
+#include "microbench.h"
+
+static void normalize3(float v[3]) {
+	float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (len > 0.0f) {
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+static float dot3(const float *a, const float *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static float dist2(const float *a, const float *b) {
+	float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return dx * dx + dy * dy + dz * dz;
+}
+
+// Ritter's bounding sphere, within a few % of the minimal one and O(n)
+static void meshlet_compute_sphere(const mesh &m, const unsigned int *verts, unsigned int count, meshlet &ml) {
+	const float *pos = m.positions.data();
+
+	const float *x = pos + verts[0] * 3;
+	const float *y = x;
+	for (unsigned int i = 0; i < count; i++) {
+		const float *p = pos + verts[i] * 3;
+		if (dist2(p, x) > dist2(y, x)) {
+			y = p;
+		}
+	}
+	const float *z = y;
+	for (unsigned int i = 0; i < count; i++) {
+		const float *p = pos + verts[i] * 3;
+		if (dist2(p, y) > dist2(z, y)) {
+			z = p;
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		ml.center[k] = (y[k] + z[k]) * 0.5f;
+	}
+	ml.radius = sqrtf(dist2(y, z)) * 0.5f;
+
+	// grow it for whatever is still sticking out
+	for (unsigned int i = 0; i < count; i++) {
+		const float *p = pos + verts[i] * 3;
+		float d = sqrtf(dist2(p, ml.center));
+		if (d > ml.radius) {
+			float grow = (d - ml.radius) * 0.5f;
+			ml.radius += grow;
+			for (int k = 0; k < 3; k++) {
+				ml.center[k] += (p[k] - ml.center[k]) * (grow / d);
+			}
+		}
+	}
+}
+
+static void meshlet_compute_cone(const mesh &m, const meshlet_set &set, meshlet &ml) {
+	const float *pos = m.positions.data();
+	const unsigned int *verts = &set.vertices[ml.vertexOffset];
+	const unsigned char *tris = &set.triangles[ml.triangleOffset];
+
+	std::vector<float> normals(ml.triangleCount * 3);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (unsigned int t = 0; t < ml.triangleCount; t++) {
+		const float *p0 = pos + verts[tris[t * 3 + 0]] * 3;
+		const float *p1 = pos + verts[tris[t * 3 + 1]] * 3;
+		const float *p2 = pos + verts[tris[t * 3 + 2]] * 3;
+		float u[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float v[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float *n = &normals[t * 3];
+		n[0] = u[1] * v[2] - u[2] * v[1];
+		n[1] = u[2] * v[0] - u[0] * v[2];
+		n[2] = u[0] * v[1] - u[1] * v[0];
+		normalize3(n);
+		axis[0] += n[0];
+		axis[1] += n[1];
+		axis[2] += n[2];
+	}
+	normalize3(axis);
+
+	float minDot = 1.0f;
+	for (unsigned int t = 0; t < ml.triangleCount; t++) {
+		float d = dot3(&normals[t * 3], axis);
+		if (d < minDot) {
+			minDot = d;
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		ml.coneAxis[k] = axis[k];
+		ml.coneApex[k] = ml.center[k];
+	}
+
+	// normals spread over more than a hemisphere, there's no angle we can cull from
+	if (minDot <= 0.0f) {
+		ml.coneCutoff = 1.0f;
+		return;
+	}
+
+	// slide the apex back along the axis until it's behind every triangle's plane
+	// (dot(apex - p0, n) <= 0), then anything looking at the apex from inside the
+	// cone sees only back faces. convex clusters already have the center behind
+	// every plane, concave ones are what need the apex moved
+	float maxT = 0.0f;
+	for (unsigned int t = 0; t < ml.triangleCount; t++) {
+		const float *n = &normals[t * 3];
+		const float *p0 = pos + verts[tris[t * 3 + 0]] * 3;
+		float offset[3] = { ml.center[0] - p0[0], ml.center[1] - p0[1], ml.center[2] - p0[2] };
+		float dn = dot3(n, axis);
+		if (dn > 0.0f) {
+			float tt = dot3(offset, n) / dn;
+			if (tt > maxT) {
+				maxT = tt;
+			}
+		}
+	}
+
+	for (int k = 0; k < 3; k++) {
+		ml.coneApex[k] = ml.center[k] - axis[k] * maxT;
+	}
+	ml.coneCutoff = sqrtf(1.0f - minDot * minDot);
+}
+
+meshlet_set meshlet_build(const mesh &m, unsigned int maxVertices, unsigned int maxTriangles) {
+	meshlet_set set;
+
+	if (maxVertices > MESHLET_MAX_VERTICES) {
+		maxVertices = MESHLET_MAX_VERTICES;
+	}
+	if (maxTriangles > MESHLET_MAX_TRIANGLES) {
+		maxTriangles = MESHLET_MAX_TRIANGLES;
+	}
+	// anything smaller can't hold a single triangle and no cluster would ever fill
+	if (maxVertices < 3) {
+		maxVertices = 3;
+	}
+	if (maxTriangles < 1) {
+		maxTriangles = 1;
+	}
+
+	unsigned int vertexCount = m.vertex_count();
+	unsigned int triCount = m.triangle_count();
+	const unsigned int *indices = m.indices.data();
+
+	// vertex -> triangles adjacency, packed
+	std::vector<unsigned int> adjOffset(vertexCount + 1, 0);
+	for (unsigned int i = 0; i < triCount * 3; i++) {
+		adjOffset[indices[i] + 1]++;
+	}
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		adjOffset[v + 1] += adjOffset[v];
+	}
+	std::vector<unsigned int> adj(triCount * 3);
+	std::vector<unsigned int> fill(adjOffset.begin(), adjOffset.end() - 1);
+	for (unsigned int t = 0; t < triCount; t++) {
+		for (int k = 0; k < 3; k++) {
+			adj[fill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<char> used(triCount, 0);
+	std::vector<unsigned char> local(vertexCount, 0xff); // 0xff = not in the current meshlet
+	unsigned int seed = 0;
+
+	meshlet current = {};
+
+	for (;;) {
+		// prefer the unused neighbour that brings in the fewest new vertices
+		int best = -1;
+		int bestNew = 4;
+		for (unsigned int i = 0; i < current.vertexCount && bestNew > 0; i++) {
+			unsigned int v = set.vertices[current.vertexOffset + i];
+			for (unsigned int a = adjOffset[v]; a < adjOffset[v + 1]; a++) {
+				unsigned int t = adj[a];
+				if (used[t]) {
+					continue;
+				}
+				int newVerts = (local[indices[t * 3 + 0]] == 0xff) + (local[indices[t * 3 + 1]] == 0xff) + (local[indices[t * 3 + 2]] == 0xff);
+				if (newVerts < bestNew) {
+					best = (int) t;
+					bestNew = newVerts;
+				}
+			}
+		}
+
+		// nothing connected left, jump to the next unused triangle
+		if (best < 0) {
+			while (seed < triCount && used[seed]) {
+				seed++;
+			}
+			if (seed == triCount) {
+				break;
+			}
+			best = (int) seed;
+			bestNew = (local[indices[seed * 3 + 0]] == 0xff) + (local[indices[seed * 3 + 1]] == 0xff) + (local[indices[seed * 3 + 2]] == 0xff);
+		}
+
+		// full, close it and start the next one from the same triangle so
+		// neighbouring clusters stay next to each other
+		if (current.vertexCount + bestNew > maxVertices || current.triangleCount + 1 > maxTriangles) {
+			for (unsigned int i = 0; i < current.vertexCount; i++) {
+				local[set.vertices[current.vertexOffset + i]] = 0xff;
+			}
+			set.meshlets.push_back(current);
+
+			meshlet next = {};
+			next.vertexOffset = (unsigned int) set.vertices.size();
+			next.triangleOffset = (unsigned int) set.triangles.size();
+			current = next;
+			continue;
+		}
+
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = indices[best * 3 + k];
+			if (local[v] == 0xff) {
+				local[v] = (unsigned char) current.vertexCount++;
+				set.vertices.push_back(v);
+			}
+			set.triangles.push_back(local[v]);
+		}
+		current.triangleCount++;
+		used[best] = 1;
+	}
+
+	if (current.triangleCount > 0) {
+		set.meshlets.push_back(current);
+	}
+
+	for (size_t i = 0; i < set.meshlets.size(); i++) {
+		meshlet &ml = set.meshlets[i];
+		meshlet_compute_sphere(m, &set.vertices[ml.vertexOffset], ml.vertexCount, ml);
+		meshlet_compute_cone(m, set, ml);
+	}
+
+	return set;
+}
+
+void meshlet_cull(const meshlet_set &set, const frustum &f, const float cameraPos[3],
+	std::vector<unsigned int> &outIndices, meshlet_cull_stats *stats) {
+
+	meshlet_cull_stats s = {};
+	outIndices.clear();
+
+	for (size_t i = 0; i < set.meshlets.size(); i++) {
+		const meshlet &ml = set.meshlets[i];
+		s.trianglesIn += ml.triangleCount;
+
+		float view[3] = { ml.coneApex[0] - cameraPos[0], ml.coneApex[1] - cameraPos[1], ml.coneApex[2] - cameraPos[2] };
+		normalize3(view);
+		if (dot3(view, ml.coneAxis) >= ml.coneCutoff) {
+			s.backfacing++;
+			continue;
+		}
+
+		if (!frustum_test_sphere(f, ml.center, ml.radius)) {
+			s.offscreen++;
+			continue;
+		}
+
+		s.visible++;
+		s.trianglesOut += ml.triangleCount;
+
+		const unsigned int *verts = &set.vertices[ml.vertexOffset];
+		const unsigned char *tris = &set.triangles[ml.triangleOffset];
+		for (unsigned int t = 0; t < ml.triangleCount * 3; t++) {
+			outIndices.push_back(verts[tris[t]]);
+		}
+	}
+
+	if (stats) {
+		*stats = s;
+	}
+}
+
+void meshlet_draw_stream(const gpu_mesh &gm, const std::vector<unsigned int> &indices) {
+	gls_bind_vertex_array(gm.VAO);
+	gls_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, gm.EBO);
+
+	// orphan the old storage so we don't wait on last frame's draw
+	GLsizeiptr size = (GLsizeiptr) (indices.size() * sizeof(unsigned int));
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, size, indices.data());
+
+	glDrawElements(GL_TRIANGLES, (GLsizei) indices.size(), GL_UNSIGNED_INT, (void *) 0);
+}
+
+// clusters the cone test throws away that have a triangle facing the camera
+static unsigned int wrongly_backfacing(const mesh &m, const meshlet_set &set, const float cameraPos[3]) {
+	const float *pos = m.positions.data();
+	unsigned int wrong = 0;
+	for (size_t i = 0; i < set.meshlets.size(); i++) {
+		const meshlet &ml = set.meshlets[i];
+		float view[3] = { ml.coneApex[0] - cameraPos[0], ml.coneApex[1] - cameraPos[1], ml.coneApex[2] - cameraPos[2] };
+		normalize3(view);
+		if (dot3(view, ml.coneAxis) < ml.coneCutoff) {
+			continue;
+		}
+
+		const unsigned int *verts = &set.vertices[ml.vertexOffset];
+		const unsigned char *tris = &set.triangles[ml.triangleOffset];
+		for (unsigned int t = 0; t < ml.triangleCount; t++) {
+			const float *p0 = pos + verts[tris[t * 3 + 0]] * 3;
+			const float *p1 = pos + verts[tris[t * 3 + 1]] * 3;
+			const float *p2 = pos + verts[tris[t * 3 + 2]] * 3;
+			float u[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float v[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+			float toCamera[3] = { cameraPos[0] - p0[0], cameraPos[1] - p0[1], cameraPos[2] - p0[2] };
+			if (dot3(n, toCamera) > 0.0f) {
+				wrong++;
+				break;
+			}
+		}
+	}
+	return wrong;
+}
+
+void meshlet_bench() {
+	mesh sphere = mesh_make_sphere(512, 1024, 1.0f);
+
+	double start = bench_now_ms();
+	meshlet_set set = meshlet_build(sphere, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+	double buildMs = bench_now_ms() - start;
+
+	printf("meshlet: %u triangles -> %zu clusters (avg %.1f triangles, %.1f vertices) in %.2f ms\n",
+		sphere.triangle_count(), set.meshlets.size(),
+		(double) sphere.triangle_count() / set.meshlets.size(),
+		(double) set.vertices.size() / set.meshlets.size(), buildMs);
+
+	// camera close enough that the sphere spills over the edges of the screen
+	float eye[3] = { 0.0f, 0.0f, 1.6f };
+	float viewProj[16];
+	frustum_view_projection(eye, 60.0f * 3.14159265f / 180.0f, 800.0f / 600.0f, 0.1f, 100.0f, viewProj);
+	frustum f = frustum_from_matrix(viewProj);
+
+	std::vector<unsigned int> stream;
+	stream.reserve(sphere.indices.size());
+	meshlet_cull_stats stats;
+
+	const int runs = 20;
+	start = bench_now_ms();
+	for (int i = 0; i < runs; i++) {
+		meshlet_cull(set, f, eye, stream, &stats);
+	}
+	double cullMs = (bench_now_ms() - start) / runs;
+
+	printf("meshlet: %u visible, %u backfacing, %u offscreen clusters\n", stats.visible, stats.backfacing, stats.offscreen);
+	printf("  triangles drawn %u of %u (%.1f%%), cull + stream build %.3f ms\n",
+		stats.trianglesOut, stats.trianglesIn, 100.0 * stats.trianglesOut / stats.trianglesIn, cullMs);
+	printf("  convex, seen from outside: %u clusters wrongly culled as backfacing\n", wrongly_backfacing(sphere, set, eye));
+
+	// a coarser sphere wound inwards and looked at from inside, close to the
+	// wall. every cluster is concave and every triangle faces the camera, so
+	// none may be culled as backfacing
+	mesh inside = mesh_make_sphere(64, 128, 1.0f);
+	for (size_t i = 0; i < inside.indices.size(); i += 3) {
+		unsigned int swap = inside.indices[i + 1];
+		inside.indices[i + 1] = inside.indices[i + 2];
+		inside.indices[i + 2] = swap;
+	}
+	meshlet_set insideSet = meshlet_build(inside, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+	const float insideEyes[3][3] = { { 0.0f, 0.0f, 0.99f }, { 0.7f, 0.0f, 0.7f }, { 0.0f, 0.0f, -0.99f } };
+	unsigned int wrong = 0;
+	for (int e = 0; e < 3; e++) {
+		wrong += wrongly_backfacing(inside, insideSet, insideEyes[e]);
+	}
+	printf("  concave, seen from inside near the wall: %u of %zu clusters wrongly culled as backfacing over 3 views\n",
+		wrong, insideSet.meshlets.size() * 3);
+}
@@ -0,0 +1,61 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <vector>
+
+#include "frustum.h"
+#include "mesh.h"
+
+// limits that keep a cluster's local indices in a byte and line up with what
+// mesh shader hardware likes, even though we only feed glDrawElements here
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct meshlet {
+	unsigned int vertexOffset; // into meshlet_set::vertices
+	unsigned int triangleOffset; // into meshlet_set::triangles, 3 local indices per triangle
+	unsigned int vertexCount;
+	unsigned int triangleCount;
+
+	// bounding sphere for frustum culling
+	float center[3];
+	float radius;
+
+	// normal cone for backface culling, the whole cluster faces away from the
+	// camera if dot(normalize(apex - camera), axis) >= cutoff. cutoff is 1 (never
+	// cull) when the normals spread too much for the cone to mean anything
+	float coneApex[3];
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+struct meshlet_set {
+	std::vector<meshlet> meshlets;
+	std::vector<unsigned int> vertices; // global vertex index for each local one
+	std::vector<unsigned char> triangles; // local vertex indices
+};
+
+struct meshlet_cull_stats {
+	unsigned int visible;
+	unsigned int backfacing;
+	unsigned int offscreen;
+	unsigned int trianglesIn;
+	unsigned int trianglesOut;
+};
+
+// partition the mesh into clusters of at most maxVertices / maxTriangles,
+// growing each cluster over adjacent triangles so it stays compact. the
+// limits are clamped to MESHLET_MAX_* and to at least one triangle
+meshlet_set meshlet_build(const mesh &m, unsigned int maxVertices, unsigned int maxTriangles);
+
+// reject clusters that face away from cameraPos or are outside the frustum and
+// write the triangles of the rest as global indices into outIndices
+void meshlet_cull(const meshlet_set &set, const frustum &f, const float cameraPos[3],
+	std::vector<unsigned int> &outIndices, meshlet_cull_stats *stats);
+
+// orphan the mesh's EBO, upload the culled stream and draw it
+void meshlet_draw_stream(const gpu_mesh &gm, const std::vector<unsigned int> &indices);
+
+void meshlet_bench();
+
+#endif
@@ -0,0 +1,120 @@
+#include "microbench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "batch.h"
+#include "bvh.h"
+#include "capture.h"
+#include "command_list.h"
+#include "cpu_profiler.h"
+#include "cull.h"
+#include "frame_graph.h"
+#include "indirect.h"
+#include "input.h"
+#include "job_system.h"
+#include "lod.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "render_queue.h"
+#include "render_target.h"
+#include "scene.h"
+#include "vecmath.h"
+
+struct microbench {
+	const char *name;
+	void (*run)();
+};
+
+static const microbench benches[] = {
+	{ "lod", lod_bench },
+	{ "meshlet", meshlet_bench },
+	{ "batch", batch_bench },
+	{ "indirect", indirect_bench },
+	{ "queue", render_queue_bench },
+	{ "commands", command_list_bench },
+	{ "jobs", job_bench },
+	{ "cull", cull_bench },
+	{ "occlusion", occlusion_bench },
+	{ "bvh", bvh_bench },
+	{ "scene", scene_bench },
+	{ "math", math_bench },
+	{ "profiler", cpu_profiler_bench },
+	{ "framegraph", frame_graph_bench },
+	{ "capture", capture_bench },
+	{ "resize", render_surface_bench },
+	{ "input", input_bench },
+};
+
+double bench_now_ms() {
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+void json_write_string(FILE *file, const char *s) {
+	fputc('"', file);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', file);
+			fputc(*s, file);
+		} else if ((unsigned char) *s < 0x20) {
+			fprintf(file, "\\u%04x", (unsigned char) *s);
+		} else {
+			fputc(*s, file);
+		}
+	}
+	fputc('"', file);
+}
+
+unsigned int bench_random_u32(unsigned int *state) {
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+float bench_random_float(unsigned int *state) {
+	return bench_random_u32(state) * (1.0f / 16777216.0f);
+}
+
+unsigned int bench_max_threads() {
+	unsigned int hw = std::thread::hardware_concurrency();
+	return hw == 0 ? 1 : hw;
+}
+
+unsigned int bench_next_threads(unsigned int threads, unsigned int maxThreads) {
+	if (threads * 2 > maxThreads && threads != maxThreads) {
+		return maxThreads; // make sure maxThreads itself gets measured
+	}
+	return threads * 2;
+}
+
+int run_microbench(const char *name) {
+	const int count = sizeof(benches) / sizeof(benches[0]);
+	bool all = strcmp(name, "all") == 0;
+	bool found = false;
+
+	// benchmarks that go wide schedule onto the job system like the real thing does
+	job_system_init(0);
+
+	for (int i = 0; i < count; i++) {
+		if (all || strcmp(name, benches[i].name) == 0) {
+			printf("==== %s ====\n", benches[i].name);
+			benches[i].run();
+			found = true;
+		}
+	}
+
+	job_system_shutdown();
+
+	if (!found) {
+		printf("unknown microbenchmark '%s', pick one of:\n", name);
+		for (int i = 0; i < count; i++) {
+			printf("  %s\n", benches[i].name);
+		}
+		printf("  all\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <stdio.h>
+
+// CPU side benchmarks that don't need a window, run with
+//   ./test --microbench <name>     (or "all")
+
+// wall clock in milliseconds, only good for differences
+double bench_now_ms();
+
+// the LCG the benches make their fixtures with, so every run sees the same
+// data. bench_random_u32 is the top 24 bits of the state, the float one the
+// same bits scaled to [0, 1)
+unsigned int bench_random_u32(unsigned int *state);
+float bench_random_float(unsigned int *state);
+
+// thread counts for the scaling sweeps: 1, 2, 4, ... and the core count
+// itself, even when that isn't a power of two.
+//   for (unsigned int t = 1; t <= max; t = bench_next_threads(t, max))
+unsigned int bench_max_threads();
+unsigned int bench_next_threads(unsigned int threads, unsigned int maxThreads);
+
+// s as a quoted JSON string, for the trace / results files. quotes,
+// backslashes and control characters get escaped
+void json_write_string(FILE *file, const char *s);
+
+// returns 0 on success, 1 if there's no benchmark with that name
+int run_microbench(const char *name);
+
+#endif
@@ -0,0 +1,337 @@
+#include "occlusion.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "frustum.h"
+#include "microbench.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+// anything with w below this is at or behind the camera
+static const float nearW = 1e-4f;
+
+struct screen_vertex {
+	float x, y, z;
+};
+
+void occlusion_init(occlusion_buffer *buf, int width, int height) {
+	buf->tilesX = (width + OCCLUSION_TILE_W - 1) / OCCLUSION_TILE_W;
+	buf->tilesY = (height + OCCLUSION_TILE_H - 1) / OCCLUSION_TILE_H;
+	buf->width = buf->tilesX * OCCLUSION_TILE_W;
+	buf->height = buf->tilesY * OCCLUSION_TILE_H;
+	buf->depth.assign(buf->width * buf->height, 1.0f);
+	buf->tileMax.assign(buf->tilesX * buf->tilesY, 1.0f);
+	memset(&buf->stats, 0, sizeof(buf->stats));
+}
+
+void occlusion_begin(occlusion_buffer *buf, const float viewProj[16]) {
+	std::fill(buf->depth.begin(), buf->depth.end(), 1.0f);
+	std::fill(buf->tileMax.begin(), buf->tileMax.end(), 1.0f);
+	memcpy(buf->viewProj, viewProj, sizeof(buf->viewProj));
+	memset(&buf->stats, 0, sizeof(buf->stats));
+}
+
+static void transform(const float m[16], const float *p, float clip[4]) {
+	for (int r = 0; r < 4; r++) {
+		clip[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+	}
+}
+
+static void to_screen(const occlusion_buffer *buf, const float clip[4], screen_vertex *v) {
+	float invW = 1.0f / clip[3];
+	v->x = (clip[0] * invW * 0.5f + 0.5f) * buf->width;
+	v->y = (clip[1] * invW * 0.5f + 0.5f) * buf->height;
+	v->z = clip[2] * invW;
+}
+
+// a pixel only counts as covered if the whole pixel is inside the triangle,
+// and it gets the farthest depth the triangle has anywhere in that pixel.
+// that way an occluder can only ever hide less than it really would (edges
+// shared between two triangles leave a one pixel seam, which is fine for that)
+static void raster_triangle(occlusion_buffer *buf, const screen_vertex &v0, const screen_vertex &v1, const screen_vertex &v2) {
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+	if (area <= 0.0f) {
+		buf->stats.trianglesSkipped++; // backfacing or degenerate
+		return;
+	}
+
+	int minX = (int) floorf(fminf(v0.x, fminf(v1.x, v2.x)));
+	int maxX = (int) ceilf(fmaxf(v0.x, fmaxf(v1.x, v2.x)));
+	int minY = (int) floorf(fminf(v0.y, fminf(v1.y, v2.y)));
+	int maxY = (int) ceilf(fmaxf(v0.y, fmaxf(v1.y, v2.y)));
+	if (minX < 0) minX = 0;
+	if (minY < 0) minY = 0;
+	if (maxX > buf->width - 1) maxX = buf->width - 1;
+	if (maxY > buf->height - 1) maxY = buf->height - 1;
+	if (minX > maxX || minY > maxY) {
+		buf->stats.trianglesSkipped++;
+		return;
+	}
+	buf->stats.trianglesRasterized++;
+
+	// edge(a, b, p) = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x), positive inside
+	const screen_vertex *a[3] = { &v0, &v1, &v2 };
+	const screen_vertex *b[3] = { &v1, &v2, &v0 };
+	float stepX[3], stepY[3], origin[3];
+	float startX = (float) (minX & ~3) + 0.5f; // rows start on a 4 pixel boundary for the SIMD path
+	float startY = (float) minY + 0.5f;
+	for (int e = 0; e < 3; e++) {
+		stepX[e] = -(b[e]->y - a[e]->y);
+		stepY[e] = b[e]->x - a[e]->x;
+		origin[e] = stepY[e] * (startY - a[e]->y) + stepX[e] * (startX - a[e]->x);
+
+		// moving the edge in by the most it changes over half a pixel
+		origin[e] -= 0.5f * (fabsf(stepX[e]) + fabsf(stepY[e]));
+	}
+
+	// depth is linear in screen space after the divide
+	float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+	float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+	float zOrigin = v0.z + dzdx * (startX - v0.x) + dzdy * (startY - v0.y) + 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+
+	int firstX = minX & ~3;
+	for (int y = minY; y <= maxY; y++) {
+		float *row = &buf->depth[y * buf->width];
+		float rowOffset = (float) (y - minY);
+		float e0 = origin[0] + stepY[0] * rowOffset;
+		float e1 = origin[1] + stepY[1] * rowOffset;
+		float e2 = origin[2] + stepY[2] * rowOffset;
+		float z = zOrigin + dzdy * rowOffset;
+
+#ifdef OCCLUSION_SSE
+		const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		__m128 ve0 = _mm_add_ps(_mm_set1_ps(e0), _mm_mul_ps(lane, _mm_set1_ps(stepX[0])));
+		__m128 ve1 = _mm_add_ps(_mm_set1_ps(e1), _mm_mul_ps(lane, _mm_set1_ps(stepX[1])));
+		__m128 ve2 = _mm_add_ps(_mm_set1_ps(e2), _mm_mul_ps(lane, _mm_set1_ps(stepX[2])));
+		__m128 vz = _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(lane, _mm_set1_ps(dzdx)));
+		const __m128 step0 = _mm_set1_ps(stepX[0] * 4.0f);
+		const __m128 step1 = _mm_set1_ps(stepX[1] * 4.0f);
+		const __m128 step2 = _mm_set1_ps(stepX[2] * 4.0f);
+		const __m128 stepZ = _mm_set1_ps(dzdx * 4.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (int x = firstX; x <= maxX; x += 4) {
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(ve0, zero), _mm_cmpge_ps(ve1, zero)), _mm_cmpge_ps(ve2, zero));
+			if (_mm_movemask_ps(inside)) {
+				__m128 old = _mm_loadu_ps(&row[x]);
+				__m128 nearer = _mm_min_ps(old, vz);
+				_mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+			ve0 = _mm_add_ps(ve0, step0);
+			ve1 = _mm_add_ps(ve1, step1);
+			ve2 = _mm_add_ps(ve2, step2);
+			vz = _mm_add_ps(vz, stepZ);
+		}
+#else
+		for (int x = firstX; x <= maxX; x++) {
+			if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f && z < row[x]) {
+				row[x] = z;
+			}
+			e0 += stepX[0];
+			e1 += stepX[1];
+			e2 += stepX[2];
+			z += dzdx;
+		}
+#endif
+	}
+}
+
+void occlusion_rasterize(occlusion_buffer *buf, const float *positions, const unsigned int *indices, unsigned int indexCount) {
+	double start = bench_now_ms();
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3) {
+		float clip[3][4];
+		bool behind = false;
+		for (int k = 0; k < 3; k++) {
+			transform(buf->viewProj, &positions[indices[i + k] * 3], clip[k]);
+			behind = behind || clip[k][3] < nearW;
+		}
+
+		// no clipping, anything touching the near plane just isn't an occluder
+		if (behind) {
+			buf->stats.trianglesSkipped++;
+			continue;
+		}
+
+		screen_vertex v[3];
+		for (int k = 0; k < 3; k++) {
+			to_screen(buf, clip[k], &v[k]);
+		}
+		raster_triangle(buf, v[0], v[1], v[2]);
+	}
+
+	buf->stats.rasterMs += bench_now_ms() - start;
+}
+
+void occlusion_build_hiz(occlusion_buffer *buf) {
+	double start = bench_now_ms();
+
+	for (int ty = 0; ty < buf->tilesY; ty++) {
+		for (int tx = 0; tx < buf->tilesX; tx++) {
+			float farthest = 0.0f;
+			for (int y = 0; y < OCCLUSION_TILE_H; y++) {
+				const float *row = &buf->depth[(ty * OCCLUSION_TILE_H + y) * buf->width + tx * OCCLUSION_TILE_W];
+				for (int x = 0; x < OCCLUSION_TILE_W; x++) {
+					farthest = row[x] > farthest ? row[x] : farthest;
+				}
+			}
+			buf->tileMax[ty * buf->tilesX + tx] = farthest;
+		}
+	}
+
+	buf->stats.rasterMs += bench_now_ms() - start;
+}
+
+bool occlusion_test_box(occlusion_buffer *buf, const float boxMin[3], const float boxMax[3]) {
+	buf->stats.tested++;
+
+	// the transform is linear, so transform one corner and step along the
+	// matrix columns scaled by the box size to get the other seven
+	const float *m = buf->viewProj;
+	float base[4], axis[3][4];
+	transform(m, boxMin, base);
+	for (int k = 0; k < 3; k++) {
+		float size = boxMax[k] - boxMin[k];
+		for (int r = 0; r < 4; r++) {
+			axis[k][r] = m[k * 4 + r] * size;
+		}
+	}
+
+	float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, minZ = 1e30f;
+	for (int c = 0; c < 8; c++) {
+		float clip[4];
+		for (int r = 0; r < 4; r++) {
+			clip[r] = base[r] + ((c & 1) ? axis[0][r] : 0.0f) + ((c & 2) ? axis[1][r] : 0.0f) + ((c & 4) ? axis[2][r] : 0.0f);
+		}
+		if (clip[3] < nearW) {
+			return false; // reaches behind the camera, can't be behind anything
+		}
+
+		screen_vertex v;
+		to_screen(buf, clip, &v);
+		// plain compares, fminf is a libm call unless NaNs are ruled out
+		minX = v.x < minX ? v.x : minX;
+		minY = v.y < minY ? v.y : minY;
+		maxX = v.x > maxX ? v.x : maxX;
+		maxY = v.y > maxY ? v.y : maxY;
+		minZ = v.z < minZ ? v.z : minZ;
+	}
+
+	int x0 = (int) floorf(minX), x1 = (int) ceilf(maxX);
+	int y0 = (int) floorf(minY), y1 = (int) ceilf(maxY);
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > buf->width - 1) x1 = buf->width - 1;
+	if (y1 > buf->height - 1) y1 = buf->height - 1;
+	if (x0 > x1 || y0 > y1) {
+		return false; // off screen, that's the frustum culler's call
+	}
+
+	// hidden only if every pixel under the box already has something nearer
+	for (int ty = y0 / OCCLUSION_TILE_H; ty <= y1 / OCCLUSION_TILE_H; ty++) {
+		for (int tx = x0 / OCCLUSION_TILE_W; tx <= x1 / OCCLUSION_TILE_W; tx++) {
+			if (buf->tileMax[ty * buf->tilesX + tx] < minZ) {
+				continue; // the whole tile is in front
+			}
+
+			int px0 = tx * OCCLUSION_TILE_W > x0 ? tx * OCCLUSION_TILE_W : x0;
+			int px1 = (tx + 1) * OCCLUSION_TILE_W - 1 < x1 ? (tx + 1) * OCCLUSION_TILE_W - 1 : x1;
+			int py0 = ty * OCCLUSION_TILE_H > y0 ? ty * OCCLUSION_TILE_H : y0;
+			int py1 = (ty + 1) * OCCLUSION_TILE_H - 1 < y1 ? (ty + 1) * OCCLUSION_TILE_H - 1 : y1;
+			for (int y = py0; y <= py1; y++) {
+				for (int x = px0; x <= px1; x++) {
+					if (buf->depth[y * buf->width + x] >= minZ) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	buf->stats.occluded++;
+	return true;
+}
+
+// axis aligned quad facing +z (towards a camera looking down -z)
+static void add_wall(std::vector<float> &positions, std::vector<unsigned int> &indices,
+	float x0, float y0, float x1, float y1, float z) {
+
+	unsigned int base = (unsigned int) positions.size() / 3;
+	float corners[4][3] = { { x0, y0, z }, { x1, y0, z }, { x1, y1, z }, { x0, y1, z } };
+	for (int c = 0; c < 4; c++) {
+		positions.insert(positions.end(), corners[c], corners[c] + 3);
+	}
+	unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+	for (int k = 0; k < 6; k++) {
+		indices.push_back(base + quad[k]);
+	}
+}
+
+void occlusion_bench() {
+	// an interior: rows of wall panels with gaps between them, and lots of
+	// small props scattered behind and between the rows
+	std::vector<float> positions;
+	std::vector<unsigned int> indices;
+	unsigned int seed = 777;
+	for (int row = 0; row < 4; row++) {
+		float z = -8.0f - row * 10.0f;
+		for (int panel = -6; panel < 6; panel++) {
+			// every row leaves a different doorway open
+			if ((panel + row * 5 + 12) % 7 == 0) {
+				continue;
+			}
+			float x = panel * 4.0f;
+			add_wall(positions, indices, x, -4.0f, x + 3.8f, 6.0f, z);
+		}
+	}
+
+	const unsigned int propCount = 20000;
+	std::vector<float> props(propCount * 6);
+	for (unsigned int i = 0; i < propCount; i++) {
+		float *p = &props[i * 6];
+		float cx = (bench_random_float(&seed) - 0.5f) * 40.0f;
+		float cy = -3.5f + bench_random_float(&seed) * 3.0f;
+		float cz = -3.0f - bench_random_float(&seed) * 45.0f;
+		float s = 0.1f + bench_random_float(&seed) * 0.4f;
+		p[0] = cx - s; p[1] = cy - s; p[2] = cz - s;
+		p[3] = cx + s; p[4] = cy + s; p[5] = cz + s;
+	}
+
+	float eye[3] = { 0.0f, 0.0f, 0.0f };
+	float viewProj[16];
+	frustum_view_projection(eye, 60.0f * 3.14159265f / 180.0f, 16.0f / 9.0f, 0.1f, 100.0f, viewProj);
+
+	int sizes[3][2] = { { 160, 90 }, { 320, 180 }, { 640, 360 } };
+	printf("occlusion: %zu occluder triangles, %u props\n", indices.size() / 3, propCount);
+	for (int s = 0; s < 3; s++) {
+		occlusion_buffer buf;
+		occlusion_init(&buf, sizes[s][0], sizes[s][1]);
+
+		const int runs = 20;
+		double rasterMs = 0.0, testMs = 0.0;
+		unsigned int occluded = 0;
+		for (int r = 0; r < runs; r++) {
+			occlusion_begin(&buf, viewProj);
+			occlusion_rasterize(&buf, positions.data(), indices.data(), (unsigned int) indices.size());
+			occlusion_build_hiz(&buf);
+
+			double start = bench_now_ms();
+			for (unsigned int i = 0; i < propCount; i++) {
+				occlusion_test_box(&buf, &props[i * 6], &props[i * 6 + 3]);
+			}
+			testMs += bench_now_ms() - start;
+			rasterMs += buf.stats.rasterMs;
+			occluded = buf.stats.occluded;
+		}
+
+		printf("  %dx%d: raster + hiz %.3f ms, testing %.3f ms, %u of %u props culled (%.1f%%)\n",
+			buf.width, buf.height, rasterMs / runs, testMs / runs, occluded, propCount, 100.0 * occluded / propCount);
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+
+// software occlusion culling. occluders (cheap stand-in meshes that sit inside
+// the real geometry) get rasterized on the CPU into a small depth buffer, then
+// occludee bounding boxes are tested against it before anything is drawn.
+// depth is NDC z / w, smaller is nearer. a second level keeps the farthest
+// depth of every OCCLUSION_TILE_W x OCCLUSION_TILE_H tile so most boxes are
+// decided without looking at single pixels
+
+#define OCCLUSION_TILE_W 8
+#define OCCLUSION_TILE_H 4
+
+struct occlusion_stats {
+	unsigned int trianglesRasterized;
+	unsigned int trianglesSkipped; // backfacing, behind the camera, or off screen
+	unsigned int tested;
+	unsigned int occluded;
+	double rasterMs;
+	double testMs;
+};
+
+struct occlusion_buffer {
+	int width, height; // rounded up to whole tiles
+	int tilesX, tilesY;
+	std::vector<float> depth;
+	std::vector<float> tileMax;
+	float viewProj[16]; // column major, set by occlusion_begin
+	occlusion_stats stats;
+};
+
+void occlusion_init(occlusion_buffer *buf, int width, int height);
+
+// clears depth and stats and sets the camera for the frame
+void occlusion_begin(occlusion_buffer *buf, const float viewProj[16]);
+
+// positions are xyz in world space, counter clockwise triangles are front facing.
+// triangles crossing the near plane are dropped, which only ever loses occlusion
+void occlusion_rasterize(occlusion_buffer *buf, const float *positions, const unsigned int *indices, unsigned int indexCount);
+
+// call after the last occluder, before testing
+void occlusion_build_hiz(occlusion_buffer *buf);
+
+// true if the box is definitely hidden behind what's been rasterized
+bool occlusion_test_box(occlusion_buffer *buf, const float boxMin[3], const float boxMax[3]);
+
+void occlusion_bench();
+
+#endif
@@ -0,0 +1,122 @@
+#include "redraw.h"
+
+#include <stdio.h>
+
+#include "glfw/include/GLFW/glfw3.h"
+
+#include "microbench.h"
+
+// glfw callbacks don't carry a user pointer of their own, and main already
+// owns the window one. there's only ever one window
+static redraw_state *state = NULL;
+
+static void key_callback(GLFWwindow *, int, int, int, int) {
+	redraw_mark(state, REDRAW_INPUT);
+}
+
+static void mouse_button_callback(GLFWwindow *, int, int, int) {
+	redraw_mark(state, REDRAW_INPUT);
+}
+
+static void scroll_callback(GLFWwindow *, double, double) {
+	redraw_mark(state, REDRAW_INPUT);
+}
+
+// nothing follows the cursor, so plain mouse movement isn't a reason to draw
+
+static void refresh_callback(GLFWwindow *) {
+	redraw_mark(state, REDRAW_WINDOW);
+}
+
+static void iconify_callback(GLFWwindow *, int iconified) {
+	state->iconified.store(iconified != 0);
+	redraw_mark(state, REDRAW_WINDOW);
+}
+
+static void focus_callback(GLFWwindow *, int) {
+	redraw_mark(state, REDRAW_WINDOW);
+}
+
+void redraw_init(redraw_state *r, GLFWwindow *window) {
+	r->dirty.store(REDRAW_ALL);
+	r->iconified.store(glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0);
+	redraw_stats empty = { 0, 0, 0, 0, 0.0, { 0, 0, 0 } };
+	r->stats = empty;
+
+	state = r;
+	glfwSetKeyCallback(window, key_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetWindowRefreshCallback(window, refresh_callback);
+	glfwSetWindowIconifyCallback(window, iconify_callback);
+	glfwSetWindowFocusCallback(window, focus_callback);
+}
+
+void redraw_mark(redraw_state *r, unsigned int reasons) {
+	// only the first mark needs to wake anyone, the rest find it already awake
+	unsigned int old = r->dirty.fetch_or(reasons, std::memory_order_release);
+	if ((old & reasons) != reasons) {
+		glfwPostEmptyEvent();
+	}
+}
+
+static bool hidden(const redraw_state &r, GLFWwindow *window) {
+	if (r.iconified.load()) {
+		return true;
+	}
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	return width == 0 || height == 0;
+}
+
+unsigned int redraw_wait(redraw_state *r, GLFWwindow *window, double timeoutMs) {
+	double start = bench_now_ms();
+	unsigned int reasons = 0;
+	bool woken = false;
+
+	while (!glfwWindowShouldClose(window)) {
+		bool isHidden = hidden(*r, window);
+		if (!isHidden && r->dirty.load(std::memory_order_acquire) != 0) {
+			reasons = r->dirty.exchange(0, std::memory_order_acquire);
+			break;
+		}
+		if (woken) {
+			if (isHidden) {
+				r->stats.hiddenWakeups++;
+			} else {
+				r->stats.idleWakeups++;
+			}
+		}
+
+		double remaining = timeoutMs - (bench_now_ms() - start);
+		if (timeoutMs >= 0.0 && !isHidden && remaining <= 0.0) {
+			break;
+		}
+		if (timeoutMs < 0.0 || isHidden) {
+			glfwWaitEvents();
+		} else {
+			glfwWaitEventsTimeout(remaining / 1000.0);
+		}
+		r->stats.wakeups++;
+		woken = true;
+	}
+
+	r->stats.waitMs += bench_now_ms() - start;
+	if (reasons) {
+		r->stats.frames++;
+		for (int i = 0; i < 3; i++) {
+			if (reasons & (1u << i)) {
+				r->stats.reasons[i]++;
+			}
+		}
+	}
+	return reasons;
+}
+
+void redraw_report(const redraw_state &r, double runMs) {
+	const redraw_stats &s = r.stats;
+	printf("on demand: %u frames in %.1f s, asleep %.1f%% of the time\n",
+		s.frames, runMs / 1000.0, runMs > 0.0 ? 100.0 * s.waitMs / runMs : 0.0);
+	printf("  %u wakeups, %u with nothing to draw, %u while hidden\n", s.wakeups, s.idleWakeups, s.hiddenWakeups);
+	printf("  frames drawn for input %u, window %u, scene %u\n", s.reasons[0], s.reasons[1], s.reasons[2]);
+}
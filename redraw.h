@@ -0,0 +1,49 @@
+#ifndef REDRAW_H
+#define REDRAW_H
+
+#include <atomic>
+
+// --on-demand: only draw when something changed. the window callbacks (and
+// anything else, from any thread) mark the frame dirty with a reason, and the
+// loop sleeps in glfwWaitEvents until one does instead of redrawing the same
+// picture flat out. iconified or 0x0 windows aren't drawn at all, whatever is
+// dirty keeps until they come back
+
+#define REDRAW_INPUT  (1u << 0) // keys, mouse buttons, scrolling
+#define REDRAW_WINDOW (1u << 1) // resized, exposed, restored, focus changed
+#define REDRAW_SCENE  (1u << 2) // something in the scene is still moving
+#define REDRAW_ALL    (REDRAW_INPUT | REDRAW_WINDOW | REDRAW_SCENE)
+
+struct GLFWwindow;
+
+struct redraw_stats {
+	unsigned int frames; // waits that ended in something to draw
+	unsigned int wakeups; // times glfwWait* returned
+	unsigned int idleWakeups; // ... with nothing to draw after all
+	unsigned int hiddenWakeups; // ... while iconified or 0x0
+	double waitMs;
+	unsigned int reasons[3]; // frames per REDRAW_* bit
+};
+
+struct redraw_state {
+	std::atomic<unsigned int> dirty;
+	std::atomic<bool> iconified;
+	redraw_stats stats;
+};
+
+// installs the input / window callbacks (not the framebuffer size one, main
+// has its own and marks REDRAW_WINDOW from it). the first frame is dirty
+void redraw_init(redraw_state *r, GLFWwindow *window);
+
+// any thread. wakes the loop if it's asleep and the reason is new
+void redraw_mark(redraw_state *r, unsigned int reasons);
+
+// blocks until there's a reason to draw and the window is visible, then
+// returns the reasons and clears them. timeoutMs < 0 waits as long as it
+// takes, otherwise returns 0 once it runs out with nothing dirty (hidden
+// windows ignore it). also returns 0 when the window is closing
+unsigned int redraw_wait(redraw_state *r, GLFWwindow *window, double timeoutMs);
+
+void redraw_report(const redraw_state &r, double runMs);
+
+#endif
@@ -0,0 +1,220 @@
+#include "render_queue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "gl_state.h"
+#include "microbench.h"
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES ((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+uint64_t render_key_encode(unsigned int pass, unsigned int program, unsigned int VAO,
+	unsigned int material, float depth, bool backToFront) {
+
+	const uint32_t depthMax = (1u << RENDER_KEY_DEPTH_BITS) - 1;
+
+	if (depth < 0.0f) {
+		depth = 0.0f;
+	}
+	if (depth > 1.0f) {
+		depth = 1.0f;
+	}
+	uint32_t d = (uint32_t) (depth * depthMax);
+	if (backToFront) {
+		d = depthMax - d;
+	}
+
+	uint64_t key = pass & ((1u << RENDER_KEY_PASS_BITS) - 1);
+	key = (key << RENDER_KEY_PROGRAM_BITS) | (program & ((1u << RENDER_KEY_PROGRAM_BITS) - 1));
+	key = (key << RENDER_KEY_VAO_BITS) | (VAO & ((1u << RENDER_KEY_VAO_BITS) - 1));
+	key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+	key = (key << RENDER_KEY_DEPTH_BITS) | d;
+	return key;
+}
+
+void render_queue_clear(render_queue *q) {
+	q->keys.clear();
+	q->values.clear();
+	q->cmds.clear();
+}
+
+void render_queue_push(render_queue *q, uint64_t key, const render_cmd &cmd) {
+	q->keys.push_back(key);
+	q->values.push_back((uint32_t) q->cmds.size());
+	q->cmds.push_back(cmd);
+}
+
+void radix_sort_keys(uint64_t *keys, uint32_t *values, uint64_t *tmpKeys, uint32_t *tmpValues, size_t count) {
+	if (count < 2) {
+		return;
+	}
+
+	// every histogram in one read over the keys (48KB, fine on the stack)
+	uint32_t histograms[RADIX_PASSES][RADIX_SIZE];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t k = keys[i];
+		for (int p = 0; p < RADIX_PASSES; p++) {
+			histograms[p][(k >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+		}
+	}
+
+	uint64_t *srcKeys = keys, *dstKeys = tmpKeys;
+	uint32_t *srcValues = values, *dstValues = tmpValues;
+
+	for (int p = 0; p < RADIX_PASSES; p++) {
+		uint32_t *h = histograms[p];
+		int shift = p * RADIX_BITS;
+
+		// all keys have the same digit here (usually the unused top bits or an
+		// empty field), this pass wouldn't move anything
+		if (h[(srcKeys[0] >> shift) & (RADIX_SIZE - 1)] == count) {
+			continue;
+		}
+
+		uint32_t sum = 0;
+		for (int b = 0; b < RADIX_SIZE; b++) {
+			uint32_t c = h[b];
+			h[b] = sum;
+			sum += c;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			uint64_t k = srcKeys[i];
+			uint32_t dst = h[(k >> shift) & (RADIX_SIZE - 1)]++;
+			dstKeys[dst] = k;
+			dstValues[dst] = srcValues[i];
+		}
+
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+	}
+
+	// odd number of passes actually ran, the result is in the scratch arrays
+	if (srcKeys != keys) {
+		memcpy(keys, srcKeys, count * sizeof(uint64_t));
+		memcpy(values, srcValues, count * sizeof(uint32_t));
+	}
+}
+
+void render_queue_sort(render_queue *q) {
+	size_t count = q->keys.size();
+	if (q->scratchKeys.size() < count) {
+		q->scratchKeys.resize(count);
+		q->scratchValues.resize(count);
+	}
+	radix_sort_keys(q->keys.data(), q->values.data(), q->scratchKeys.data(), q->scratchValues.data(), count);
+}
+
+void render_queue_submit(const render_queue *q, void (*bindMaterial)(unsigned int material, void *user),
+	void *user, render_queue_stats *stats) {
+
+	render_queue_stats s = {};
+	const render_cmd *prev = NULL;
+
+	for (size_t i = 0; i < q->keys.size(); i++) {
+		const render_cmd &cmd = q->cmds[q->values[i]];
+
+		if (prev == NULL || prev->program != cmd.program) {
+			gls_use_program(cmd.program);
+			s.programChanges++;
+		}
+		if (prev == NULL || prev->VAO != cmd.VAO) {
+			gls_bind_vertex_array(cmd.VAO);
+			s.VAOChanges++;
+		}
+		if (prev == NULL || prev->material != cmd.material) {
+			if (bindMaterial) {
+				bindMaterial(cmd.material, user);
+			}
+			s.materialChanges++;
+		}
+
+		if (cmd.indexed) {
+			void *offset = (void *) (cmd.indexOffset * sizeof(unsigned int));
+			if (cmd.instanceCount > 1) {
+				glDrawElementsInstancedBaseVertex(cmd.mode, cmd.count, GL_UNSIGNED_INT, offset, cmd.instanceCount, cmd.first);
+			} else {
+				glDrawElementsBaseVertex(cmd.mode, cmd.count, GL_UNSIGNED_INT, offset, cmd.first);
+			}
+		} else {
+			if (cmd.instanceCount > 1) {
+				glDrawArraysInstanced(cmd.mode, cmd.first, cmd.count, cmd.instanceCount);
+			} else {
+				glDrawArrays(cmd.mode, cmd.first, cmd.count);
+			}
+		}
+
+		s.draws++;
+		prev = &cmd;
+	}
+
+	if (stats) {
+		*stats = s;
+	}
+}
+
+struct key_value {
+	uint64_t key;
+	uint32_t value;
+
+	bool operator<(const key_value &o) const { return key < o.key; }
+};
+
+void render_queue_bench() {
+	const size_t sizes[] = { 10000, 100000, 250000, 1000000 };
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t count = sizes[s];
+
+		// a realistic-ish frame: 2 passes, 64 programs, 256 VAOs, 1024 materials, random depth
+		std::vector<uint64_t> source(count);
+		unsigned int seed = 4242;
+		for (size_t i = 0; i < count; i++) {
+			seed = seed * 1664525u + 1013904223u;
+			unsigned int pass = (seed >> 30) & 1;
+			unsigned int program = (seed >> 4) & 63;
+			unsigned int VAO = (seed >> 10) & 255;
+			seed = seed * 1664525u + 1013904223u;
+			unsigned int material = (seed >> 8) & 1023;
+			float depth = (float) (seed >> 20) / 4096.0f;
+			source[i] = render_key_encode(pass, program, VAO, material, depth, pass == 1);
+		}
+
+		std::vector<uint64_t> keys(count), tmpKeys(count);
+		std::vector<uint32_t> values(count), tmpValues(count);
+		std::vector<key_value> pairs(count);
+
+		const int runs = 10;
+		double radixMs = 0.0, stdMs = 0.0;
+		for (int r = 0; r < runs; r++) {
+			for (size_t i = 0; i < count; i++) {
+				keys[i] = source[i];
+				values[i] = (uint32_t) i;
+				pairs[i].key = source[i];
+				pairs[i].value = (uint32_t) i;
+			}
+
+			double start = bench_now_ms();
+			radix_sort_keys(keys.data(), values.data(), tmpKeys.data(), tmpValues.data(), count);
+			radixMs += bench_now_ms() - start;
+
+			start = bench_now_ms();
+			std::stable_sort(pairs.begin(), pairs.end());
+			stdMs += bench_now_ms() - start;
+		}
+
+		bool sorted = true;
+		for (size_t i = 0; i < count; i++) {
+			sorted &= keys[i] == pairs[i].key && values[i] == pairs[i].value;
+		}
+
+		printf("render queue: %7zu draws, radix sort %.3f ms, std::stable_sort %.3f ms%s\n",
+			count, radixMs / runs, stdMs / runs, sorted ? "" : "  (MISMATCH)");
+	}
+}
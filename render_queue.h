@@ -0,0 +1,74 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "glad/glad.h"
+
+// 64 bit sort key, most significant first:
+//   pass 4 | program 12 | VAO 12 | material 12 | depth 24
+// sorting the keys groups draws by pass, then by the most expensive state to
+// change. program / VAO / material are small ids, not GL names necessarily,
+// anything above 12 bits gets masked off
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PROGRAM_BITS 12
+#define RENDER_KEY_VAO_BITS 12
+#define RENDER_KEY_MATERIAL_BITS 12
+#define RENDER_KEY_DEPTH_BITS 24
+
+// depth is view depth in [0, 1]. opaque passes want front to back (early z),
+// transparent ones back to front, which is the same bits flipped
+uint64_t render_key_encode(unsigned int pass, unsigned int program, unsigned int VAO,
+	unsigned int material, float depth, bool backToFront);
+
+// what actually gets drawn for a key
+struct render_cmd {
+	unsigned int program; // GL names
+	unsigned int VAO;
+	unsigned int material;
+	GLenum mode;
+	bool indexed;
+	GLint first; // first vertex, or base vertex for indexed draws
+	GLsizei count;
+	unsigned int indexOffset; // in indices
+	GLsizei instanceCount; // 1 for a plain draw
+};
+
+struct render_queue {
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> values; // index into cmds
+	std::vector<render_cmd> cmds;
+
+	// ping pong buffers for the radix sort, kept to avoid reallocating every frame
+	std::vector<uint64_t> scratchKeys;
+	std::vector<uint32_t> scratchValues;
+};
+
+struct render_queue_stats {
+	unsigned int draws;
+	unsigned int programChanges;
+	unsigned int VAOChanges;
+	unsigned int materialChanges;
+};
+
+void render_queue_clear(render_queue *q);
+void render_queue_push(render_queue *q, uint64_t key, const render_cmd &cmd);
+
+// LSD radix sort on the keys, 11 bits per pass (6 passes at most, passes where
+// every key has the same digit are skipped). stable, so equal keys keep push order
+void render_queue_sort(render_queue *q);
+
+// same thing on bare arrays, used by the queue and the benchmark
+void radix_sort_keys(uint64_t *keys, uint32_t *values, uint64_t *tmpKeys, uint32_t *tmpValues, size_t count);
+
+// walk the sorted queue, only touching the program / VAO when it changes.
+// bindMaterial (optional) gets called whenever the material id changes
+void render_queue_submit(const render_queue *q, void (*bindMaterial)(unsigned int material, void *user),
+	void *user, render_queue_stats *stats);
+
+void render_queue_bench();
+
+#endif
@@ -0,0 +1,382 @@
+#include "render_target.h"
+
+#include <stdio.h>
+
+#include "gl_state.h"
+
+static size_t texel_bytes(GLenum format) {
+	switch (format) {
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+		return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+static size_t desc_bytes(const rt_desc &desc) {
+	return (size_t) desc.width * desc.height * desc.samples * texel_bytes(desc.format);
+}
+
+static bool same_desc(const rt_desc &a, const rt_desc &b) {
+	return a.width == b.width && a.height == b.height && a.format == b.format && a.samples == b.samples;
+}
+
+static bool is_depth(GLenum format) {
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F ||
+		format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+bool rt_is_renderbuffer(const rt_desc &desc) {
+	return desc.samples > 1 || is_depth(desc.format);
+}
+
+void rt_pool_init(rt_pool *pool) {
+	pool->entries.clear();
+	pool->frame = 0;
+	rt_pool_stats empty = { 0, 0, 0, 0 };
+	pool->stats = empty;
+}
+
+static GLuint create_target(const rt_desc &desc) {
+	GLuint name = 0;
+	if (rt_is_renderbuffer(desc)) {
+		glGenRenderbuffers(1, &name);
+		glBindRenderbuffer(GL_RENDERBUFFER, name);
+		if (desc.samples > 1) {
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.format, desc.width, desc.height);
+		} else {
+			glRenderbufferStorage(GL_RENDERBUFFER, desc.format, desc.width, desc.height);
+		}
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	} else {
+		// no data, so format / type only have to be a legal pair
+		glGenTextures(1, &name);
+		gls_bind_texture(GL_TEXTURE_2D, name);
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	return name;
+}
+
+static void delete_target(rt_pool *pool, rt_entry *e) {
+	if (rt_is_renderbuffer(e->desc)) {
+		glDeleteRenderbuffers(1, &e->name);
+	} else {
+		gls_delete_textures(1, &e->name);
+	}
+	e->name = 0;
+	pool->stats.deleted++;
+	pool->stats.liveBytes -= desc_bytes(e->desc);
+}
+
+unsigned int rt_pool_acquire(rt_pool *pool, const rt_desc &desc) {
+	unsigned int freeSlot = (unsigned int) pool->entries.size();
+	for (size_t i = 0; i < pool->entries.size(); i++) {
+		rt_entry &e = pool->entries[i];
+		if (e.name == 0) {
+			if (freeSlot == pool->entries.size()) {
+				freeSlot = (unsigned int) i;
+			}
+		} else if (!e.inUse && same_desc(e.desc, desc)) {
+			e.inUse = true;
+			pool->stats.reused++;
+			return (unsigned int) i;
+		}
+	}
+
+	if (freeSlot == pool->entries.size()) {
+		pool->entries.push_back(rt_entry());
+	}
+	rt_entry &e = pool->entries[freeSlot];
+	e.desc = desc;
+	e.name = create_target(desc);
+	e.inUse = true;
+	e.releasedFrame = 0;
+	pool->stats.created++;
+	pool->stats.liveBytes += desc_bytes(desc);
+	return freeSlot;
+}
+
+GLuint rt_pool_name(const rt_pool &pool, unsigned int handle) {
+	return pool.entries[handle].name;
+}
+
+void rt_pool_release(rt_pool *pool, unsigned int handle) {
+	rt_entry &e = pool->entries[handle];
+	e.inUse = false;
+	e.releasedFrame = pool->frame;
+}
+
+void rt_pool_end_frame(rt_pool *pool) {
+	pool->frame++;
+	for (size_t i = 0; i < pool->entries.size(); i++) {
+		rt_entry &e = pool->entries[i];
+		if (e.name != 0 && !e.inUse && pool->frame - e.releasedFrame > RT_POOL_KEEP_FRAMES) {
+			delete_target(pool, &e);
+		}
+	}
+}
+
+void rt_pool_destroy(rt_pool *pool) {
+	for (size_t i = 0; i < pool->entries.size(); i++) {
+		if (pool->entries[i].name != 0) {
+			delete_target(pool, &pool->entries[i]);
+		}
+	}
+	pool->entries.clear();
+}
+
+void resize_debouncer_init(resize_debouncer *d, int width, int height) {
+	d->width = width;
+	d->height = height;
+	d->settledWidth = width;
+	d->settledHeight = height;
+	d->lastEventMs = 0.0;
+	d->pending = false;
+	d->events = 0;
+}
+
+void resize_debouncer_event(resize_debouncer *d, int width, int height, double nowMs) {
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	d->width = width;
+	d->height = height;
+	d->lastEventMs = nowMs;
+	d->pending = true;
+	d->events++;
+}
+
+bool resize_debouncer_settle(resize_debouncer *d, double nowMs) {
+	if (!d->pending || nowMs - d->lastEventMs < RT_RESIZE_SETTLE_MS) {
+		return false;
+	}
+	d->pending = false;
+	if (d->width == d->settledWidth && d->height == d->settledHeight) {
+		return false;
+	}
+	d->settledWidth = d->width;
+	d->settledHeight = d->height;
+	return true;
+}
+
+bool rt_plan_frame(resize_debouncer *d, double nowMs, int *capacityWidth, int *capacityHeight, int *drawWidth, int *drawHeight) {
+	bool rebuild = resize_debouncer_settle(d, nowMs);
+	if (rebuild) {
+		*capacityWidth = d->settledWidth;
+		*capacityHeight = d->settledHeight;
+	}
+
+	if (d->width <= *capacityWidth && d->height <= *capacityHeight) {
+		*drawWidth = d->width;
+		*drawHeight = d->height;
+	} else {
+		double sx = (double) *capacityWidth / d->width;
+		double sy = (double) *capacityHeight / d->height;
+		double scale = sx < sy ? sx : sy;
+		*drawWidth = (int) (d->width * scale);
+		*drawHeight = (int) (d->height * scale);
+		*drawWidth = *drawWidth > 0 ? *drawWidth : 1;
+		*drawHeight = *drawHeight > 0 ? *drawHeight : 1;
+	}
+	return rebuild;
+}
+
+static void attach(const rt_pool &pool, unsigned int handle, GLenum attachment) {
+	const rt_entry &e = pool.entries[handle];
+	if (rt_is_renderbuffer(e.desc)) {
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, e.name);
+	} else {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, e.name, 0);
+	}
+}
+
+static bool build_targets(render_surface *s) {
+	rt_desc color = { s->capacityWidth, s->capacityHeight, s->colorFormat, s->samples };
+	rt_desc depth = { s->capacityWidth, s->capacityHeight, s->depthFormat, s->samples };
+	s->color = rt_pool_acquire(s->pool, color);
+	s->depth = rt_pool_acquire(s->pool, depth);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+	attach(*s->pool, s->color, GL_COLOR_ATTACHMENT0);
+	attach(*s->pool, s->depth, s->depthFormat == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (s->samples > 1) {
+		rt_desc resolve = { s->capacityWidth, s->capacityHeight, s->colorFormat, 1 };
+		s->resolve = rt_pool_acquire(s->pool, resolve);
+		glBindFramebuffer(GL_FRAMEBUFFER, s->resolveFbo);
+		attach(*s->pool, s->resolve, GL_COLOR_ATTACHMENT0);
+		if (status == GL_FRAMEBUFFER_COMPLETE) {
+			status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		}
+	}
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		printf("render target: framebuffer incomplete at %dx%d, %d samples (0x%x)\n",
+			s->capacityWidth, s->capacityHeight, s->samples, status);
+		return false;
+	}
+	return true;
+}
+
+static void release_targets(render_surface *s) {
+	rt_pool_release(s->pool, s->color);
+	rt_pool_release(s->pool, s->depth);
+	if (s->samples > 1) {
+		rt_pool_release(s->pool, s->resolve);
+	}
+}
+
+static void delete_framebuffers(render_surface *s) {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &s->fbo);
+	if (s->resolveFbo) {
+		glDeleteFramebuffers(1, &s->resolveFbo);
+	}
+	s->fbo = 0;
+	s->resolveFbo = 0;
+}
+
+bool render_surface_init(render_surface *s, rt_pool *pool, int width, int height, int samples) {
+	s->pool = pool;
+	s->colorFormat = GL_RGBA8;
+	s->depthFormat = GL_DEPTH24_STENCIL8;
+	s->samples = samples > 1 ? samples : 1;
+	resize_debouncer_init(&s->resize, width, height);
+	s->capacityWidth = width;
+	s->capacityHeight = height;
+	s->drawWidth = width;
+	s->drawHeight = height;
+	s->rebuilds = 0;
+	s->subRectFrames = 0;
+	s->scaledFrames = 0;
+
+	s->resolveFbo = 0;
+	glGenFramebuffers(1, &s->fbo);
+	if (s->samples > 1) {
+		glGenFramebuffers(1, &s->resolveFbo);
+	}
+	bool complete = build_targets(s);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		release_targets(s);
+		delete_framebuffers(s);
+	}
+	return complete;
+}
+
+void render_surface_resize(render_surface *s, int width, int height, double nowMs) {
+	resize_debouncer_event(&s->resize, width, height, nowMs);
+}
+
+void render_surface_begin_frame(render_surface *s, double nowMs) {
+	if (rt_plan_frame(&s->resize, nowMs, &s->capacityWidth, &s->capacityHeight, &s->drawWidth, &s->drawHeight)) {
+		// the old targets go back to the pool, dragging back to that size soon picks them up again
+		release_targets(s);
+		build_targets(s);
+		s->rebuilds++;
+	}
+
+	if (s->drawWidth != s->resize.width || s->drawHeight != s->resize.height) {
+		s->scaledFrames++;
+	} else if (s->drawWidth != s->capacityWidth || s->drawHeight != s->capacityHeight) {
+		s->subRectFrames++;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, s->fbo);
+	gls_viewport(0, 0, s->drawWidth, s->drawHeight);
+}
+
+void render_surface_present(render_surface *s, GLuint dstFbo) {
+	int w = s->drawWidth, h = s->drawHeight;
+	GLuint src = s->fbo;
+
+	// multisampled blits can't scale, so resolve the draw rect 1:1 first
+	if (s->samples > 1) {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, s->fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, s->resolveFbo);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		src = s->resolveFbo;
+	}
+
+	bool scaled = w != s->resize.width || h != s->resize.height;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, src);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dstFbo);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, s->resize.width, s->resize.height, GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, dstFbo);
+}
+
+void render_surface_destroy(render_surface *s) {
+	const rt_pool_stats &p = s->pool->stats;
+	printf("render targets: %u resize events, %u rebuilds, %u frames in a sub-rect, %u scaled\n",
+		s->resize.events, s->rebuilds, s->subRectFrames, s->scaledFrames);
+	printf("  pool: %u created, %u reused, %u deleted, %.1f MB live\n",
+		p.created, p.reused, p.deleted, p.liveBytes / (1024.0 * 1024.0));
+
+	release_targets(s);
+	delete_framebuffers(s);
+}
+
+// a window drag at 60 fps: in from 1280x720 to 800x450, held there a moment,
+// then out to 1600x900. what the targets cost when every event rebuilds them
+// vs when they wait for the size to settle
+void render_surface_bench() {
+	const double frameMs = 1000.0 / 60.0;
+	const int frames = 240;
+	const size_t bytesPerPixel = 4 + 4; // RGBA8 + D24S8
+
+	resize_debouncer d;
+	resize_debouncer_init(&d, 1280, 720);
+	int capacityWidth = 1280, capacityHeight = 720, drawWidth = 0, drawHeight = 0;
+	int lastWidth = 1280, lastHeight = 720;
+	unsigned int eagerRebuilds = 0, rebuilds = 0, subRect = 0, scaled = 0;
+	size_t eagerBytes = 0, bytes = 0;
+
+	for (int f = 0; f < frames; f++) {
+		double t = f * frameMs;
+		int w = lastWidth, h = lastHeight;
+		if (f < 40) {
+			w = 1280 - 480 * f / 39;
+			h = 720 - 270 * f / 39;
+		} else if (f >= 60 && f < 110) {
+			w = 800 + 800 * (f - 60) / 49;
+			h = 450 + 450 * (f - 60) / 49;
+		}
+
+		if (w != lastWidth || h != lastHeight) {
+			resize_debouncer_event(&d, w, h, t);
+			eagerRebuilds++;
+			eagerBytes += (size_t) w * h * bytesPerPixel;
+			lastWidth = w;
+			lastHeight = h;
+		}
+
+		if (rt_plan_frame(&d, t, &capacityWidth, &capacityHeight, &drawWidth, &drawHeight)) {
+			rebuilds++;
+			bytes += (size_t) capacityWidth * capacityHeight * bytesPerPixel;
+		}
+		if (drawWidth != d.width || drawHeight != d.height) {
+			scaled++;
+		} else if (drawWidth != capacityWidth || drawHeight != capacityHeight) {
+			subRect++;
+		}
+	}
+
+	printf("render targets: %d frame window drag, %u resize events\n", frames, d.events);
+	printf("  rebuild on every event: %4u rebuilds, %8.1f MB allocated\n", eagerRebuilds, eagerBytes / (1024.0 * 1024.0));
+	printf("  debounced (%.0f ms):     %4u rebuilds, %8.1f MB allocated, final %dx%d\n",
+		RT_RESIZE_SETTLE_MS, rebuilds, bytes / (1024.0 * 1024.0), capacityWidth, capacityHeight);
+	printf("  while settling: %u frames drawn 1:1 in a sub-rect, %u scaled up to the window\n", subRect, scaled);
+}
@@ -0,0 +1,125 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "glad/glad.h"
+
+// offscreen render targets. the pool hands out textures / renderbuffers keyed
+// by format, size and sample count, and keeps released ones around for a
+// while so asking for the same thing again (dragging a window back to where
+// it was, a pass that only runs every other frame) doesn't make new ones.
+//
+// render_surface is the scene target on top of it. a window resize used to go
+// straight to glViewport, and with offscreen targets every one of the dozens
+// of events a drag produces would reallocate them all. instead the size has to
+// settle first, and until then the frame is drawn into a sub-rect of the
+// targets it already has (1:1 if the window got smaller, scaled down to fit
+// and stretched back on present if it got bigger)
+
+// released targets are deleted after this many frames without being asked for again
+#define RT_POOL_KEEP_FRAMES 60
+
+// how long the window size has to stay put before the targets are rebuilt for it
+#define RT_RESIZE_SETTLE_MS 150.0
+
+struct rt_desc {
+	int width, height;
+	GLenum format; // sized internal format, integer formats not supported
+	int samples; // 1 for none
+};
+
+struct rt_entry {
+	rt_desc desc;
+	GLuint name; // 0 for a free slot
+	bool inUse;
+	unsigned int releasedFrame;
+};
+
+struct rt_pool_stats {
+	unsigned int created, reused, deleted;
+	size_t liveBytes;
+};
+
+struct rt_pool {
+	std::vector<rt_entry> entries; // handles are indices, they never move
+	unsigned int frame;
+	rt_pool_stats stats;
+};
+
+// single sampled color is a texture so it can be sampled, depth and anything
+// multisampled is a renderbuffer
+bool rt_is_renderbuffer(const rt_desc &desc);
+
+void rt_pool_init(rt_pool *pool);
+
+// a handle, the GL object is rt_pool_name(). contents are undefined
+unsigned int rt_pool_acquire(rt_pool *pool, const rt_desc &desc);
+GLuint rt_pool_name(const rt_pool &pool, unsigned int handle);
+void rt_pool_release(rt_pool *pool, unsigned int handle);
+
+// once a frame, deletes whatever has sat unused for RT_POOL_KEEP_FRAMES
+void rt_pool_end_frame(rt_pool *pool);
+void rt_pool_destroy(rt_pool *pool);
+
+// the CPU side of resizing, no GL in here
+struct resize_debouncer {
+	int width, height; // latest size the window reported
+	int settledWidth, settledHeight; // what the targets were last built for
+	double lastEventMs;
+	bool pending;
+	unsigned int events;
+};
+
+void resize_debouncer_init(resize_debouncer *d, int width, int height);
+
+// minimized windows report 0x0, that's ignored
+void resize_debouncer_event(resize_debouncer *d, int width, int height, double nowMs);
+
+// true once the size has stayed the same for RT_RESIZE_SETTLE_MS and differs
+// from what was settled on last time
+bool resize_debouncer_settle(resize_debouncer *d, double nowMs);
+
+// where this frame gets drawn inside targets of the given capacity: the
+// window's own size if it fits, otherwise scaled down to fit keeping the
+// aspect ratio. returns whether the targets have to be rebuilt first (and
+// updates the capacity if so)
+bool rt_plan_frame(resize_debouncer *d, double nowMs, int *capacityWidth, int *capacityHeight, int *drawWidth, int *drawHeight);
+
+struct render_surface {
+	rt_pool *pool;
+	GLenum colorFormat, depthFormat;
+	int samples;
+	resize_debouncer resize;
+
+	int capacityWidth, capacityHeight; // what the targets are allocated at
+	int drawWidth, drawHeight; // this frame, from the bottom left corner
+
+	GLuint fbo, resolveFbo; // resolveFbo only when multisampled
+	unsigned int color, depth, resolve; // pool handles
+
+	unsigned int rebuilds;
+	unsigned int subRectFrames; // drawn 1:1 into part of bigger targets
+	unsigned int scaledFrames; // drawn smaller than the window and stretched
+};
+
+bool render_surface_init(render_surface *s, rt_pool *pool, int width, int height, int samples);
+
+// from the framebuffer size callback
+void render_surface_resize(render_surface *s, int width, int height, double nowMs);
+
+// rebuilds the targets if the size has settled, then binds the FBO and sets
+// the viewport to the draw rect
+void render_surface_begin_frame(render_surface *s, double nowMs);
+
+// resolves if multisampled and blits the draw rect over the whole of dstFbo
+// (window sized). leaves dstFbo bound for both drawing and reading
+void render_surface_present(render_surface *s, GLuint dstFbo);
+
+void render_surface_destroy(render_surface *s);
+
+void render_surface_bench();
+
+#endif
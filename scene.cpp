@@ -0,0 +1,581 @@
+#include "scene.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "job_system.h"
+#include "microbench.h"
+#include "vecmath.h"
+
+#define SCENE_NO_ROW 0xffffffffu
+
+// rows per job when sweeping a level
+#define SCENE_GRAIN 16384
+
+// rows looked at together inside a job, local matrices get built a block at a time
+#define SCENE_BLOCK 64
+
+static uint32_t slot_of(entity e) {
+	return e & (SCENE_MAX_ENTITIES - 1);
+}
+
+static uint8_t generation_of(entity e) {
+	return (uint8_t) (e >> SCENE_INDEX_BITS);
+}
+
+void scene_init(scene_store *s) {
+	*s = scene_store();
+	s->levels.push_back(0);
+	s->orderDirty = false;
+	s->liveCount = 0;
+}
+
+bool scene_alive(const scene_store &s, entity e) {
+	if (e == SCENE_NO_ENTITY) {
+		return false;
+	}
+	uint32_t slot = slot_of(e);
+	return slot < s.slotRows.size() && s.slotGenerations[slot] == generation_of(e);
+}
+
+uint32_t scene_row(const scene_store &s, entity e) {
+	return scene_alive(s, e) ? s.slotRows[slot_of(e)] : SCENE_NO_ROW;
+}
+
+entity scene_create(scene_store *s, entity parent) {
+	uint32_t slot;
+	if (!s->freeSlots.empty()) {
+		slot = s->freeSlots.back();
+		s->freeSlots.pop_back();
+	} else {
+		if (s->slotRows.size() >= SCENE_MAX_ENTITIES) {
+			return SCENE_NO_ENTITY;
+		}
+		slot = (uint32_t) s->slotRows.size();
+		s->slotRows.push_back(SCENE_NO_ROW);
+		s->slotGenerations.push_back(0);
+	}
+
+	entity e = slot | ((uint32_t) s->slotGenerations[slot] << SCENE_INDEX_BITS);
+	uint32_t row = (uint32_t) s->entities.size();
+	s->slotRows[slot] = row;
+
+	s->entities.push_back(e);
+	s->parents.push_back(scene_alive(*s, parent) ? parent : SCENE_NO_ENTITY);
+	s->parentRows.push_back(SCENE_NO_ROW);
+	s->flags.push_back(SCENE_LOCAL_DIRTY);
+
+	s->posX.push_back(0.0f);
+	s->posY.push_back(0.0f);
+	s->posZ.push_back(0.0f);
+	s->rotX.push_back(0.0f);
+	s->rotY.push_back(0.0f);
+	s->rotZ.push_back(0.0f);
+	s->rotW.push_back(1.0f);
+	s->scaleX.push_back(1.0f);
+	s->scaleY.push_back(1.0f);
+	s->scaleZ.push_back(1.0f);
+
+	static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	s->world.insert(s->world.end(), identity, identity + 16);
+
+	s->meshes.push_back(SCENE_NO_MESH);
+	s->materials.push_back(0);
+
+	float zero[3] = { 0.0f, 0.0f, 0.0f };
+	s->boundsX.push_back(0.0f);
+	s->boundsY.push_back(0.0f);
+	s->boundsZ.push_back(0.0f);
+	s->extentX.push_back(0.0f);
+	s->extentY.push_back(0.0f);
+	s->extentZ.push_back(0.0f);
+	cull_set_add(&s->worldBounds, zero, zero);
+
+	// even a root has to go in front of everything deeper
+	s->orderDirty = true;
+	s->liveCount++;
+	return e;
+}
+
+void scene_destroy(scene_store *s, entity e) {
+	if (!scene_alive(*s, e)) {
+		return;
+	}
+	uint32_t slot = slot_of(e);
+
+	// the row stays until the next update compacts it, the handle dies now
+	s->flags[s->slotRows[slot]] |= SCENE_DEAD;
+	s->slotRows[slot] = SCENE_NO_ROW;
+	s->slotGenerations[slot]++;
+	s->freeSlots.push_back(slot);
+	s->orderDirty = true;
+	s->liveCount--;
+}
+
+bool scene_set_parent(scene_store *s, entity e, entity parent) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW || (parent != SCENE_NO_ENTITY && !scene_alive(*s, parent))) {
+		return false;
+	}
+
+	// e can't end up as its own ancestor
+	for (entity p = parent; scene_alive(*s, p); p = s->parents[s->slotRows[slot_of(p)]]) {
+		if (p == e) {
+			return false;
+		}
+	}
+
+	s->parents[row] = parent;
+	s->flags[row] |= SCENE_LOCAL_DIRTY;
+	s->orderDirty = true;
+	return true;
+}
+
+void scene_set_position(scene_store *s, entity e, float x, float y, float z) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW) {
+		return;
+	}
+	s->posX[row] = x;
+	s->posY[row] = y;
+	s->posZ[row] = z;
+	s->flags[row] |= SCENE_LOCAL_DIRTY;
+}
+
+void scene_set_rotation(scene_store *s, entity e, const float quat[4]) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW) {
+		return;
+	}
+	s->rotX[row] = quat[0];
+	s->rotY[row] = quat[1];
+	s->rotZ[row] = quat[2];
+	s->rotW[row] = quat[3];
+	s->flags[row] |= SCENE_LOCAL_DIRTY;
+}
+
+void scene_set_scale(scene_store *s, entity e, float x, float y, float z) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW) {
+		return;
+	}
+	s->scaleX[row] = x;
+	s->scaleY[row] = y;
+	s->scaleZ[row] = z;
+	s->flags[row] |= SCENE_LOCAL_DIRTY;
+}
+
+void scene_set_mesh(scene_store *s, entity e, uint32_t mesh, uint32_t material) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW) {
+		return;
+	}
+	s->meshes[row] = mesh;
+	s->materials[row] = material;
+}
+
+void scene_set_bounds(scene_store *s, entity e, const float center[3], const float extent[3]) {
+	uint32_t row = scene_row(*s, e);
+	if (row == SCENE_NO_ROW) {
+		return;
+	}
+	s->boundsX[row] = center[0];
+	s->boundsY[row] = center[1];
+	s->boundsZ[row] = center[2];
+	s->extentX[row] = extent[0];
+	s->extentY[row] = extent[1];
+	s->extentZ[row] = extent[2];
+
+	// world bounds only get recomputed for rows that are flagged
+	s->flags[row] |= SCENE_LOCAL_DIRTY;
+}
+
+const float *scene_world_matrix(const scene_store &s, entity e) {
+	uint32_t row = scene_row(s, e);
+	return row == SCENE_NO_ROW ? NULL : &s.world[row * 16];
+}
+
+// new row i is old row order[i]
+template <typename T>
+static void gather(std::vector<T> &v, const std::vector<uint32_t> &order, unsigned int stride, std::vector<T> &scratch) {
+	scratch.resize(order.size() * stride);
+	for (size_t i = 0; i < order.size(); i++) {
+		memcpy(&scratch[i * stride], &v[order[i] * stride], stride * sizeof(T));
+	}
+	v.swap(scratch);
+}
+
+// counting sort of the live rows by depth, dead rows dropped. parents always
+// end up in an earlier level than their children
+static void scene_reorder(scene_store *s) {
+	uint32_t count = (uint32_t) s->entities.size();
+
+	std::vector<uint32_t> depth(count, SCENE_NO_ROW);
+	std::vector<uint32_t> chain;
+	uint32_t maxDepth = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if ((s->flags[i] & SCENE_DEAD) || depth[i] != SCENE_NO_ROW) {
+			continue;
+		}
+
+		// walk up until a row with a known depth (or a root), then fill the chain in on the way down
+		uint32_t r = i;
+		uint32_t d = 0;
+		chain.clear();
+		for (;;) {
+			chain.push_back(r);
+			entity p = s->parents[r];
+			if (p != SCENE_NO_ENTITY && !scene_alive(*s, p)) {
+				// parent was destroyed, carry on as a root
+				s->parents[r] = SCENE_NO_ENTITY;
+				s->flags[r] |= SCENE_LOCAL_DIRTY;
+				p = SCENE_NO_ENTITY;
+			}
+			if (p == SCENE_NO_ENTITY) {
+				break;
+			}
+			uint32_t pr = s->slotRows[slot_of(p)];
+			if (depth[pr] != SCENE_NO_ROW) {
+				d = depth[pr] + 1;
+				break;
+			}
+			r = pr;
+		}
+		for (size_t c = chain.size(); c-- > 0;) {
+			depth[chain[c]] = d++;
+		}
+		if (d - 1 > maxDepth) {
+			maxDepth = d - 1;
+		}
+	}
+
+	s->levels.assign(maxDepth + 2, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		if (!(s->flags[i] & SCENE_DEAD)) {
+			s->levels[depth[i] + 1]++;
+		}
+	}
+	for (uint32_t d = 1; d < s->levels.size(); d++) {
+		s->levels[d] += s->levels[d - 1];
+	}
+
+	std::vector<uint32_t> order(s->levels.back());
+	std::vector<uint32_t> next(s->levels.begin(), s->levels.end() - 1);
+	for (uint32_t i = 0; i < count; i++) {
+		if (!(s->flags[i] & SCENE_DEAD)) {
+			order[next[depth[i]]++] = i;
+		}
+	}
+
+	std::vector<uint32_t> scratch32;
+	std::vector<uint8_t> scratch8;
+	std::vector<float> scratchF;
+	gather(s->entities, order, 1, scratch32);
+	gather(s->parents, order, 1, scratch32);
+	gather(s->flags, order, 1, scratch8);
+	gather(s->posX, order, 1, scratchF);
+	gather(s->posY, order, 1, scratchF);
+	gather(s->posZ, order, 1, scratchF);
+	gather(s->rotX, order, 1, scratchF);
+	gather(s->rotY, order, 1, scratchF);
+	gather(s->rotZ, order, 1, scratchF);
+	gather(s->rotW, order, 1, scratchF);
+	gather(s->scaleX, order, 1, scratchF);
+	gather(s->scaleY, order, 1, scratchF);
+	gather(s->scaleZ, order, 1, scratchF);
+	gather(s->world, order, 16, scratchF);
+	gather(s->meshes, order, 1, scratch32);
+	gather(s->materials, order, 1, scratch32);
+	gather(s->boundsX, order, 1, scratchF);
+	gather(s->boundsY, order, 1, scratchF);
+	gather(s->boundsZ, order, 1, scratchF);
+	gather(s->extentX, order, 1, scratchF);
+	gather(s->extentY, order, 1, scratchF);
+	gather(s->extentZ, order, 1, scratchF);
+	gather(s->worldBounds.centerX, order, 1, scratchF);
+	gather(s->worldBounds.centerY, order, 1, scratchF);
+	gather(s->worldBounds.centerZ, order, 1, scratchF);
+	gather(s->worldBounds.radius, order, 1, scratchF);
+	gather(s->worldBounds.extentX, order, 1, scratchF);
+	gather(s->worldBounds.extentY, order, 1, scratchF);
+	gather(s->worldBounds.extentZ, order, 1, scratchF);
+
+	uint32_t live = (uint32_t) order.size();
+	for (uint32_t i = 0; i < live; i++) {
+		s->slotRows[slot_of(s->entities[i])] = i;
+	}
+	s->parentRows.resize(live);
+	for (uint32_t i = 0; i < live; i++) {
+		entity p = s->parents[i];
+		s->parentRows[i] = p == SCENE_NO_ENTITY ? SCENE_NO_ROW : s->slotRows[slot_of(p)];
+	}
+
+	s->orderDirty = false;
+}
+
+struct propagate_job {
+	scene_store *s;
+	uint32_t first;
+	math_isa isa;
+	std::atomic<uint32_t> recomputed;
+};
+
+static void propagate_range(unsigned int begin, unsigned int end, void *user) {
+	propagate_job *job = (propagate_job *) user;
+	scene_store *s = job->s;
+	cull_set &wb = s->worldBounds;
+	uint32_t recomputed = 0;
+	float local[SCENE_BLOCK * 16];
+	uint32_t changedRows[SCENE_BLOCK];
+
+	for (uint32_t block = job->first + begin; block < job->first + end; block += SCENE_BLOCK) {
+		uint32_t blockEnd = block + SCENE_BLOCK < job->first + end ? block + SCENE_BLOCK : job->first + end;
+
+		// the parent's level has already been swept, so its flag is this update's
+		uint32_t n = 0;
+		for (uint32_t i = block; i < blockEnd; i++) {
+			uint8_t f = s->flags[i];
+			uint32_t p = s->parentRows[i];
+			if ((f & SCENE_LOCAL_DIRTY) || (p != SCENE_NO_ROW && (s->flags[p] & SCENE_WORLD_CHANGED))) {
+				s->flags[i] = SCENE_WORLD_CHANGED;
+				changedRows[n++] = i;
+			} else if (f) {
+				s->flags[i] = 0;
+			}
+		}
+		if (n == 0) {
+			continue;
+		}
+
+		// when a good part of the block moved it's cheaper to build every local
+		// matrix in one SIMD batch straight off the component arrays than to go one by one
+		bool batched = n * 4 >= blockEnd - block;
+		if (batched) {
+			trs_stream in = {
+				&s->posX[block], &s->posY[block], &s->posZ[block],
+				&s->rotX[block], &s->rotY[block], &s->rotZ[block], &s->rotW[block],
+				&s->scaleX[block], &s->scaleY[block], &s->scaleZ[block],
+			};
+			math_compose_trs(in, local, blockEnd - block, job->isa);
+		}
+
+		for (uint32_t k = 0; k < n; k++) {
+			uint32_t i = changedRows[k];
+			float *l = &local[(i - block) * 16];
+			if (!batched) {
+				float pos[3] = { s->posX[i], s->posY[i], s->posZ[i] };
+				float rot[4] = { s->rotX[i], s->rotY[i], s->rotZ[i], s->rotW[i] };
+				float scale[3] = { s->scaleX[i], s->scaleY[i], s->scaleZ[i] };
+				mat4_trs(pos, rot, scale, l);
+			}
+
+			float *w = &s->world[i * 16];
+			uint32_t p = s->parentRows[i];
+			if (p == SCENE_NO_ROW) {
+				memcpy(w, l, 16 * sizeof(float));
+			} else {
+				mat4_mul_affine(&s->world[p * 16], l, w);
+			}
+
+			float center[3] = { s->boundsX[i], s->boundsY[i], s->boundsZ[i] };
+			float extent[3] = { s->extentX[i], s->extentY[i], s->extentZ[i] };
+			float wc[3], we[3];
+			mat4_transform_box(w, center, extent, wc, we);
+			wb.centerX[i] = wc[0];
+			wb.centerY[i] = wc[1];
+			wb.centerZ[i] = wc[2];
+			wb.extentX[i] = we[0];
+			wb.extentY[i] = we[1];
+			wb.extentZ[i] = we[2];
+			wb.radius[i] = vec3_length(we);
+		}
+		recomputed += n;
+	}
+
+	job->recomputed.fetch_add(recomputed, std::memory_order_relaxed);
+}
+
+uint32_t scene_update(scene_store *s) {
+	if (s->orderDirty) {
+		scene_reorder(s);
+	}
+
+	propagate_job job;
+	job.s = s;
+	job.isa = math_best_isa();
+	job.recomputed.store(0);
+
+	// levels one after the other, rows inside a level in parallel
+	for (size_t d = 0; d + 1 < s->levels.size(); d++) {
+		job.first = s->levels[d];
+		parallel_for(s->levels[d + 1] - s->levels[d], SCENE_GRAIN, propagate_range, &job);
+	}
+	return job.recomputed.load();
+}
+
+// what the store replaces: a node per allocation, children by pointer,
+// world matrices by recursion
+struct bench_node {
+	float pos[3];
+	float rot[4];
+	float scale[3];
+	float world[16];
+	std::vector<bench_node *> children;
+};
+
+static void bench_node_update(bench_node *n, const float *parentWorld) {
+	float local[16];
+	mat4_trs(n->pos, n->rot, n->scale, local);
+	if (parentWorld) {
+		mat4_mul_affine(parentWorld, local, n->world);
+	} else {
+		memcpy(n->world, local, sizeof(local));
+	}
+	for (size_t c = 0; c < n->children.size(); c++) {
+		bench_node_update(n->children[c], n->world);
+	}
+}
+
+void scene_bench() {
+	const uint32_t roots = 1000, children = 10, total = 1000000;
+	unsigned int seed = 5;
+
+	printf("scene: %u entities (%u roots, %u children each, the rest leaves), %u thread(s)\n",
+		total, roots, children, job_system_thread_count());
+
+	// leaves get created first so the rows start out in the wrong order
+	scene_store s;
+	scene_init(&s);
+	uint32_t mids = roots * children;
+	std::vector<entity> handles;
+	for (uint32_t i = 0; i < total; i++) {
+		handles.push_back(scene_create(&s, SCENE_NO_ENTITY));
+	}
+	for (uint32_t i = 0; i < total; i++) {
+		entity parent;
+		if (i < roots) {
+			parent = SCENE_NO_ENTITY;
+		} else if (i < roots + mids) {
+			parent = handles[(i - roots) / children];
+		} else {
+			parent = handles[roots + (uint32_t) (bench_random_float(&seed) * mids) % mids];
+		}
+		scene_set_parent(&s, handles[i], parent);
+
+		float q[4] = { 0.0f, 0.0f, sinf(i * 0.01f), cosf(i * 0.01f) };
+		scene_set_position(&s, handles[i], bench_random_float(&seed), bench_random_float(&seed), bench_random_float(&seed));
+		scene_set_rotation(&s, handles[i], q);
+		float center[3] = { 0.0f, 0.0f, 0.0f };
+		float extent[3] = { 0.5f, 0.5f, 0.5f };
+		scene_set_bounds(&s, handles[i], center, extent);
+		scene_set_mesh(&s, handles[i], i % 16, i % 64);
+	}
+
+	double start = bench_now_ms();
+	uint32_t n = scene_update(&s);
+	double firstMs = bench_now_ms() - start;
+	printf("  first update (sort by depth + everything): %.2f ms, %u recomputed, %u levels\n",
+		firstMs, n, (uint32_t) s.levels.size() - 1);
+
+	const int frames = 20;
+	start = bench_now_ms();
+	for (int f = 0; f < frames; f++) {
+		n = scene_update(&s);
+	}
+	printf("  nothing moved:    %.3f ms per update, %u recomputed\n", (bench_now_ms() - start) / frames, n);
+
+	double ms = 0.0;
+	for (int f = 0; f < frames; f++) {
+		for (uint32_t i = 0; i < total / 100; i++) {
+			uint32_t leaf = roots + mids + (uint32_t) (bench_random_float(&seed) * (total - roots - mids)) % (total - roots - mids);
+			scene_set_position(&s, handles[leaf], bench_random_float(&seed), 0.0f, 0.0f);
+		}
+		start = bench_now_ms();
+		n = scene_update(&s);
+		ms += bench_now_ms() - start;
+	}
+	printf("  1%% of leaves:     %.3f ms per update, %u recomputed\n", ms / frames, n);
+
+	ms = 0.0;
+	for (int f = 0; f < frames; f++) {
+		for (uint32_t i = 0; i < roots; i++) {
+			scene_set_position(&s, handles[i], (float) f, 0.0f, 0.0f);
+		}
+		start = bench_now_ms();
+		n = scene_update(&s);
+		ms += bench_now_ms() - start;
+	}
+	double soaMs = ms / frames;
+	printf("  every root:       %.3f ms per update, %u recomputed\n", soaMs, n);
+
+	// same hierarchy as heap nodes, allocated in a shuffled order like a scene
+	// graph that has been edited for a while
+	std::vector<bench_node *> nodes(total);
+	std::vector<uint32_t> allocOrder(total);
+	for (uint32_t i = 0; i < total; i++) {
+		allocOrder[i] = i;
+	}
+	for (uint32_t i = total - 1; i > 0; i--) {
+		uint32_t j = (uint32_t) (bench_random_float(&seed) * (i + 1)) % (i + 1);
+		uint32_t t = allocOrder[i];
+		allocOrder[i] = allocOrder[j];
+		allocOrder[j] = t;
+	}
+	for (uint32_t i = 0; i < total; i++) {
+		bench_node *node = new bench_node;
+		uint32_t row = scene_row(s, handles[allocOrder[i]]);
+		node->pos[0] = s.posX[row];
+		node->pos[1] = s.posY[row];
+		node->pos[2] = s.posZ[row];
+		node->rot[0] = s.rotX[row];
+		node->rot[1] = s.rotY[row];
+		node->rot[2] = s.rotZ[row];
+		node->rot[3] = s.rotW[row];
+		node->scale[0] = node->scale[1] = node->scale[2] = 1.0f;
+		nodes[allocOrder[i]] = node;
+	}
+	for (uint32_t i = roots; i < total; i++) {
+		uint32_t parentRow = s.parentRows[scene_row(s, handles[i])];
+		nodes[slot_of(s.entities[parentRow])]->children.push_back(nodes[i]);
+	}
+
+	start = bench_now_ms();
+	for (int f = 0; f < frames; f++) {
+		for (uint32_t i = 0; i < roots; i++) {
+			nodes[i]->pos[0] = (float) f;
+			bench_node_update(nodes[i], NULL);
+		}
+	}
+	double treeMs = (bench_now_ms() - start) / frames;
+	printf("  pointer tree:     %.3f ms per full update (%.1fx the store, single threaded, no bounds)\n",
+		treeMs, treeMs / soaMs);
+
+	// the two should agree on where everything ended up
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < total; i += 997) {
+		const float *w = scene_world_matrix(s, handles[i]);
+		for (int k = 0; k < 16; k++) {
+			float e = fabsf(w[k] - nodes[i]->world[k]);
+			maxError = e > maxError ? e : maxError;
+		}
+	}
+	printf("  max difference between the two: %g\n", maxError);
+
+	for (uint32_t i = 0; i < total; i++) {
+		delete nodes[i];
+	}
+
+	// churn: drop 1% and add them back, which costs a re-sort
+	for (uint32_t i = 0; i < total / 100; i++) {
+		uint32_t victim = roots + mids + i * 97 % (total - roots - mids);
+		scene_destroy(&s, handles[victim]);
+		handles[victim] = scene_create(&s, handles[roots + i % mids]);
+	}
+	start = bench_now_ms();
+	n = scene_update(&s);
+	printf("  after destroying + creating 1%%: %.2f ms (re-sort included), %u recomputed, %u live\n",
+		bench_now_ms() - start, n, s.liveCount);
+}
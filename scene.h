@@ -0,0 +1,98 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "cull.h"
+
+// entity/component scene store. every entity has the same components
+// (local transform, world matrix, mesh, material, bounds) so there's only one
+// archetype: each component is its own tightly packed array and an entity is
+// a row index into all of them. rows are kept sorted by depth in the
+// hierarchy, parents always before their children, so updating world
+// matrices is one linear sweep per level with no pointer chasing, and every
+// level is split across the job system
+
+// handles are a slot index plus a generation so a stale handle to a destroyed
+// (and reused) slot is caught instead of silently pointing at someone else
+typedef uint32_t entity;
+
+#define SCENE_NO_ENTITY 0xffffffffu
+#define SCENE_NO_MESH 0xffffffffu
+#define SCENE_INDEX_BITS 24
+#define SCENE_MAX_ENTITIES (1u << SCENE_INDEX_BITS)
+
+// per row flags
+#define SCENE_LOCAL_DIRTY 1 // local transform or parent changed since the last update
+#define SCENE_WORLD_CHANGED 2 // world matrix was recomputed in the last update
+#define SCENE_DEAD 4 // destroyed, the row goes away at the next update
+
+struct scene_store {
+	// rows, all the same length
+	std::vector<entity> entities;
+	std::vector<entity> parents; // SCENE_NO_ENTITY for roots
+	std::vector<uint32_t> parentRows; // same thing as a row index, valid after an update
+	std::vector<uint8_t> flags;
+
+	// local transform: translation, rotation quaternion (xyzw), scale
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> rotX, rotY, rotZ, rotW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	std::vector<float> world; // 16 floats per row, column major
+
+	std::vector<uint32_t> meshes; // SCENE_NO_MESH for pure transform nodes
+	std::vector<uint32_t> materials;
+
+	// local space box (center + half extents), and the same thing in world
+	// space kept as a cull_set with the same rows so it can be culled directly
+	std::vector<float> boundsX, boundsY, boundsZ;
+	std::vector<float> extentX, extentY, extentZ;
+	cull_set worldBounds;
+
+	// rows [levels[d], levels[d + 1]) are at depth d
+	std::vector<uint32_t> levels;
+
+	// slot -> row and the generation living in it
+	std::vector<uint32_t> slotRows;
+	std::vector<uint8_t> slotGenerations;
+	std::vector<uint32_t> freeSlots;
+
+	bool orderDirty; // rows were added, removed or reparented
+	uint32_t liveCount;
+};
+
+void scene_init(scene_store *s);
+
+// identity transform, no mesh, empty bounds. parent can be SCENE_NO_ENTITY
+entity scene_create(scene_store *s, entity parent);
+
+// children of a destroyed entity become roots, keeping their local transform
+void scene_destroy(scene_store *s, entity e);
+bool scene_alive(const scene_store &s, entity e);
+
+// false (and nothing changes) if it would make a cycle
+bool scene_set_parent(scene_store *s, entity e, entity parent);
+
+void scene_set_position(scene_store *s, entity e, float x, float y, float z);
+void scene_set_rotation(scene_store *s, entity e, const float quat[4]);
+void scene_set_scale(scene_store *s, entity e, float x, float y, float z);
+void scene_set_mesh(scene_store *s, entity e, uint32_t mesh, uint32_t material);
+void scene_set_bounds(scene_store *s, entity e, const float center[3], const float extent[3]);
+
+// the entity's current row, only stable until the next scene_update
+uint32_t scene_row(const scene_store &s, entity e);
+
+// as of the last scene_update
+const float *scene_world_matrix(const scene_store &s, entity e);
+
+// sorts rows by depth if anything was added, removed or reparented, then
+// recomputes the world matrix and world bounds of every row whose local
+// transform or any ancestor's changed. returns how many were recomputed
+uint32_t scene_update(scene_store *s);
+
+void scene_bench();
+
+#endif
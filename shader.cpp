@@ -0,0 +1,55 @@
+#include "shader.h"
+
+#include <stdio.h>
+
+unsigned int shader_compile(GLenum type, const char *source, const char *name) {
+	unsigned int shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	// check for compile errors
+	int success = 0;
+	char infoLog[512];
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success) {
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		printf("ERROR::SHADER::%s::COMPILATION_FAILED\n %s\n", name, infoLog);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+unsigned int shader_link(unsigned int vertexShader, unsigned int fragmentShader, const char *name) {
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+
+	// check for linking errors
+	int success = 0;
+	char infoLog[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		printf("ERROR::PROGRAM::%s::LINKING_FAILED\n %s\n", name, infoLog);
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+unsigned int shader_program(const char *vertexSource, const char *fragmentSource, const char *name) {
+	unsigned int vertexShader = shader_compile(GL_VERTEX_SHADER, vertexSource, name);
+	unsigned int fragmentShader = shader_compile(GL_FRAGMENT_SHADER, fragmentSource, name);
+
+	unsigned int program = 0;
+	if (vertexShader && fragmentShader) {
+		program = shader_link(vertexShader, fragmentShader, name);
+	}
+
+	// take out the trash
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return program;
+}
@@ -0,0 +1,15 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include "glad/glad.h"
+
+// the compile / check / print dance from main.cpp in one place. name only
+// shows up in the error message (ERROR::SHADER::<name>::COMPILATION_FAILED).
+// returns 0 if it didn't compile / link
+unsigned int shader_compile(GLenum type, const char *source, const char *name);
+unsigned int shader_link(unsigned int vertexShader, unsigned int fragmentShader, const char *name);
+
+// compile both, link and throw the shader objects away
+unsigned int shader_program(const char *vertexSource, const char *fragmentSource, const char *name);
+
+#endif
@@ -0,0 +1,185 @@
+#include "simulation.h"
+
+#include <string.h>
+
+#include <chrono>
+
+#include "cpu_profiler.h"
+#include "input.h"
+#include "microbench.h"
+
+#define SIM_SNAPSHOT_FRESH 4u
+
+// after a stall don't run more than this many ticks back to back, just drop the time
+static const int maxCatchUpTicks = 5;
+
+static void sim_integrate(sim_state *state, unsigned int keys, float dt) {
+	const float acceleration = 4.0f;
+	const float damping = 6.0f;
+
+	float ax = 0.0f, ay = 0.0f;
+	if (keys & SIM_KEY_LEFT) ax -= acceleration;
+	if (keys & SIM_KEY_RIGHT) ax += acceleration;
+	if (keys & SIM_KEY_DOWN) ay -= acceleration;
+	if (keys & SIM_KEY_UP) ay += acceleration;
+
+	state->velocity[0] += (ax - state->velocity[0] * damping) * dt;
+	state->velocity[1] += (ay - state->velocity[1] * damping) * dt;
+
+	for (int i = 0; i < 2; i++) {
+		state->offset[i] += state->velocity[i] * dt;
+
+		// keep the triforce on screen
+		if (state->offset[i] < -1.0f || state->offset[i] > 1.0f) {
+			state->offset[i] = state->offset[i] < 0.0f ? -1.0f : 1.0f;
+			state->velocity[i] = 0.0f;
+		}
+	}
+}
+
+// one tick, with every event from before its end applied where it happened
+// inside it instead of at the start. returns the keys it ended with
+static unsigned int step_with_events(simulation *sim, sim_state *state, unsigned int keys, double tickEndMs) {
+	double t = tickEndMs - sim->tickMs;
+	input_event event;
+	while (input_peek(sim->input, &event) && event.timeMs < tickEndMs) {
+		// delivered after this tick had already started counts from its start
+		if (event.timeMs > t) {
+			sim_integrate(state, keys, (float) ((event.timeMs - t) / 1000.0));
+			t = event.timeMs;
+		}
+		keys = event.keys;
+		input_pop(sim->input);
+	}
+	sim_integrate(state, keys, (float) ((tickEndMs - t) / 1000.0));
+	return keys;
+}
+
+static void publish(simulation *sim, const sim_state &previous, const sim_state &current) {
+	sim_snapshot &s = sim->slots[sim->back];
+	s.previous = previous;
+	s.current = current;
+	s.timeMs = bench_now_ms();
+
+	// release so the renderer sees the whole snapshot once it sees the index
+	unsigned int old = sim->middle.exchange(sim->back | SIM_SNAPSHOT_FRESH, std::memory_order_acq_rel);
+	sim->back = old & ~SIM_SNAPSHOT_FRESH;
+}
+
+static void sim_thread(simulation *sim) {
+	PROFILE_THREAD_NAME("simulation");
+	sim_state previous, current;
+	memset(&current, 0, sizeof(current));
+	previous = current;
+
+	float dt = (float) (sim->tickMs / 1000.0);
+	double nextTickMs = bench_now_ms() + sim->tickMs;
+	unsigned int keys = 0;
+
+	while (sim->running.load(std::memory_order_relaxed)) {
+		double now = bench_now_ms();
+		if (now < nextTickMs) {
+			std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(nextTickMs - now));
+			continue;
+		}
+
+		// the steps are fixed whatever the renderer is doing, a slow frame
+		// just means the renderer sees fewer of them
+		PROFILE_ZONE("simulation ticks");
+		int ticks = 0;
+		while (nextTickMs <= now && ticks < maxCatchUpTicks) {
+			previous = current;
+			if (sim->input) {
+				keys = step_with_events(sim, &current, keys, nextTickMs);
+				sim->keys.store(keys, std::memory_order_relaxed);
+			} else {
+				keys = sim->keys.load(std::memory_order_relaxed);
+				sim_integrate(&current, keys, dt);
+			}
+			current.tick++;
+			nextTickMs += sim->tickMs;
+			ticks++;
+		}
+		if (nextTickMs <= now) {
+			nextTickMs = now + sim->tickMs;
+		}
+
+		publish(sim, previous, current);
+	}
+}
+
+void simulation_start(simulation *sim, double ticksPerSecond, input_queue *input) {
+	sim->tickMs = 1000.0 / (ticksPerSecond > 0.0 ? ticksPerSecond : 60.0);
+	sim->input = input;
+	sim->keys.store(0);
+	sim->running.store(true);
+
+	// something valid to render before the first tick lands
+	memset(sim->slots, 0, sizeof(sim->slots));
+	sim->slots[0].timeMs = bench_now_ms();
+	sim->front = 0;
+	sim->middle.store(1);
+	sim->back = 2;
+
+	sim->thread = std::thread(sim_thread, sim);
+}
+
+void simulation_set_keys(simulation *sim, unsigned int keys) {
+	sim->keys.store(keys, std::memory_order_relaxed);
+}
+
+const sim_snapshot *simulation_latest(simulation *sim) {
+	if (sim->middle.load(std::memory_order_relaxed) & SIM_SNAPSHOT_FRESH) {
+		unsigned int old = sim->middle.exchange(sim->front, std::memory_order_acq_rel);
+		sim->front = old & ~SIM_SNAPSHOT_FRESH;
+	}
+	return &sim->slots[sim->front];
+}
+
+void sim_interpolate(const sim_snapshot *snapshot, double tickMs, double nowMs, sim_state *out) {
+	float alpha = (float) ((nowMs - snapshot->timeMs) / tickMs);
+	if (alpha < 0.0f) alpha = 0.0f;
+	if (alpha > 1.0f) alpha = 1.0f;
+
+	const sim_state &a = snapshot->previous;
+	const sim_state &b = snapshot->current;
+	for (int i = 0; i < 2; i++) {
+		out->offset[i] = a.offset[i] + (b.offset[i] - a.offset[i]) * alpha;
+		out->velocity[i] = a.velocity[i] + (b.velocity[i] - a.velocity[i]) * alpha;
+	}
+	out->tick = b.tick;
+}
+
+void sim_extrapolate(const sim_snapshot *snapshot, unsigned int keys, double tickMs, double nowMs, sim_state *out) {
+	double ahead = nowMs - snapshot->timeMs;
+	ahead = ahead < 0.0 ? 0.0 : ahead > tickMs ? tickMs : ahead;
+	*out = snapshot->current;
+	sim_integrate(out, keys, (float) (ahead / 1000.0));
+}
+
+bool simulation_at_rest(simulation *sim) {
+	// with a queue, events the simulation hasn't got to yet are about to move things
+	if (sim->input && (input_keys(sim->input) != 0 || input_pending(sim->input))) {
+		return false;
+	}
+	if (sim->keys.load(std::memory_order_relaxed) != 0) {
+		return false;
+	}
+	// damping never gets the velocity all the way to 0
+	const float epsilon = 1e-4f;
+	const sim_snapshot *snapshot = simulation_latest(sim);
+	for (int i = 0; i < 2; i++) {
+		float moved = snapshot->current.offset[i] - snapshot->previous.offset[i];
+		if (moved > epsilon || moved < -epsilon) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void simulation_stop(simulation *sim) {
+	sim->running.store(false);
+	if (sim->thread.joinable()) {
+		sim->thread.join();
+	}
+}
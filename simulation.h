@@ -0,0 +1,69 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <thread>
+
+// input the main thread hands over, glfw can only be polled from there
+#define SIM_KEY_LEFT  (1u << 0)
+#define SIM_KEY_RIGHT (1u << 1)
+#define SIM_KEY_UP    (1u << 2)
+#define SIM_KEY_DOWN  (1u << 3)
+
+struct input_queue;
+
+struct sim_state {
+	float offset[2];
+	float velocity[2];
+	unsigned int tick;
+};
+
+// never changed after it's published. holding both ticks means the render
+// thread gets a consistent pair to interpolate between from one slot
+struct sim_snapshot {
+	sim_state previous;
+	sim_state current;
+	double timeMs; // when current was produced
+};
+
+// the simulation ticks at a fixed rate on its own thread and hands snapshots
+// to the render thread through a triple buffer: the sim writes back, swaps it
+// with middle, and the renderer swaps middle with front when there's a new one
+struct simulation {
+	double tickMs;
+	std::atomic<unsigned int> keys;
+	std::atomic<bool> running;
+
+	sim_snapshot slots[3];
+	std::atomic<unsigned int> middle; // slot index, plus SIM_SNAPSHOT_FRESH if the renderer hasn't taken it
+	unsigned int back; // only touched by the sim thread
+	unsigned int front; // only touched by the render thread
+
+	input_queue *input; // NULL takes the keys from simulation_set_keys instead
+
+	std::thread thread;
+};
+
+// with an input queue the simulation is its only consumer, and applies every
+// event at the time it was stamped with
+void simulation_start(simulation *sim, double ticksPerSecond, input_queue *input);
+void simulation_set_keys(simulation *sim, unsigned int keys);
+
+// render thread only. the returned snapshot stays valid until the next call
+const sim_snapshot *simulation_latest(simulation *sim);
+
+// blends previous -> current, rendering one tick behind the simulation
+void sim_interpolate(const sim_snapshot *snapshot, double tickMs, double nowMs, sim_state *out);
+
+// late latching instead: runs the newest tick forward to now (at most one
+// tick) with keys read just before submission, so a press shows up in the
+// frame being drawn. a guess, the next tick has the final say
+void sim_extrapolate(const sim_snapshot *snapshot, unsigned int keys, double tickMs, double nowMs, sim_state *out);
+
+// render thread only. no keys held and nothing moved over the last tick (by
+// well under a pixel), so another frame would look the same
+bool simulation_at_rest(simulation *sim);
+
+void simulation_stop(simulation *sim);
+
+#endif
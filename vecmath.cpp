@@ -0,0 +1,642 @@
+#include "vecmath.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "microbench.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MATH_NEON 1
+#include <arm_neon.h>
+#endif
+
+// see cull.cpp, AVX2 code only inside functions marked for it
+#if defined(MATH_X86) && defined(__GNUC__)
+#define MATH_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MATH_TARGET_AVX2
+#endif
+
+// the 4 wide kernels are written once against these, SSE or NEON underneath.
+// everything is mul then add (no fma) in the same order as the scalar code,
+// so all the kernels give bit identical results
+#if defined(MATH_X86)
+#define MATH_HAS_SIMD4 1
+typedef __m128 f4;
+static inline f4 f4_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void f4_store(float *p, f4 v) { _mm_storeu_ps(p, v); }
+static inline f4 f4_set1(float f) { return _mm_set1_ps(f); }
+static inline f4 f4_load1(const float *p) { return _mm_load1_ps(p); }
+static inline f4 f4_add(f4 a, f4 b) { return _mm_add_ps(a, b); }
+static inline f4 f4_sub(f4 a, f4 b) { return _mm_sub_ps(a, b); }
+static inline f4 f4_mul(f4 a, f4 b) { return _mm_mul_ps(a, b); }
+static inline f4 f4_abs(f4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline void f4_transpose(f4 &r0, f4 &r1, f4 &r2, f4 &r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+#elif defined(MATH_NEON)
+#define MATH_HAS_SIMD4 1
+typedef float32x4_t f4;
+static inline f4 f4_load(const float *p) { return vld1q_f32(p); }
+static inline void f4_store(float *p, f4 v) { vst1q_f32(p, v); }
+static inline f4 f4_set1(float f) { return vdupq_n_f32(f); }
+static inline f4 f4_load1(const float *p) { return vld1q_dup_f32(p); }
+static inline f4 f4_add(f4 a, f4 b) { return vaddq_f32(a, b); }
+static inline f4 f4_sub(f4 a, f4 b) { return vsubq_f32(a, b); }
+static inline f4 f4_mul(f4 a, f4 b) { return vmulq_f32(a, b); }
+static inline f4 f4_abs(f4 a) { return vabsq_f32(a); }
+static inline void f4_transpose(f4 &r0, f4 &r1, f4 &r2, f4 &r3) {
+	float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#endif
+
+void quat_mul(const float a[4], const float b[4], float out[4]) {
+	float x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+	float y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+	float z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+	float w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+	out[0] = x;
+	out[1] = y;
+	out[2] = z;
+	out[3] = w;
+}
+
+void quat_normalize(float q[4]) {
+	float len = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (len > 0.0f) {
+		for (int i = 0; i < 4; i++) {
+			q[i] /= len;
+		}
+	}
+}
+
+// v + w * t + cross(q.xyz, t) with t = 2 * cross(q.xyz, v)
+void quat_rotate(const float q[4], const float v[3], float out[3]) {
+	float t[3], c[3];
+	vec3_cross(q, v, t);
+	t[0] *= 2.0f;
+	t[1] *= 2.0f;
+	t[2] *= 2.0f;
+	vec3_cross(q, t, c);
+	out[0] = v[0] + q[3] * t[0] + c[0];
+	out[1] = v[1] + q[3] * t[1] + c[1];
+	out[2] = v[2] + q[3] * t[2] + c[2];
+}
+
+void mat4_identity(float out[16]) {
+	memset(out, 0, 16 * sizeof(float));
+	out[0] = out[5] = out[10] = out[15] = 1.0f;
+}
+
+static void mul_mat4_scalar(const float a[16], const float b[16], float out[16]) {
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 4; r++) {
+			out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+		}
+	}
+}
+
+#ifdef MATH_HAS_SIMD4
+// every output column is the columns of a weighted by one column of b
+static inline void mul_mat4_simd4(const float a[16], const float b[16], float out[16]) {
+	f4 a0 = f4_load(a), a1 = f4_load(a + 4), a2 = f4_load(a + 8), a3 = f4_load(a + 12);
+	for (int c = 0; c < 4; c++) {
+		const float *bc = b + c * 4;
+		f4 col = f4_mul(a0, f4_load1(bc));
+		col = f4_add(col, f4_mul(a1, f4_load1(bc + 1)));
+		col = f4_add(col, f4_mul(a2, f4_load1(bc + 2)));
+		col = f4_add(col, f4_mul(a3, f4_load1(bc + 3)));
+		f4_store(out + c * 4, col);
+	}
+}
+#endif
+
+void mat4_mul(const float a[16], const float b[16], float out[16]) {
+#ifdef MATH_HAS_SIMD4
+	mul_mat4_simd4(a, b, out);
+#else
+	mul_mat4_scalar(a, b, out);
+#endif
+}
+
+void mat4_mul_affine(const float a[16], const float b[16], float out[16]) {
+#ifdef MATH_HAS_SIMD4
+	// a's w row is 0 0 0 1, so the w lane comes out right without special casing
+	f4 a0 = f4_load(a), a1 = f4_load(a + 4), a2 = f4_load(a + 8);
+	for (int c = 0; c < 4; c++) {
+		const float *bc = b + c * 4;
+		f4 col = f4_mul(a0, f4_load1(bc));
+		col = f4_add(col, f4_mul(a1, f4_load1(bc + 1)));
+		col = f4_add(col, f4_mul(a2, f4_load1(bc + 2)));
+		if (c == 3) {
+			col = f4_add(col, f4_load(a + 12));
+		}
+		f4_store(out + c * 4, col);
+	}
+#else
+	for (int c = 0; c < 4; c++) {
+		for (int r = 0; r < 3; r++) {
+			out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2];
+		}
+		out[c * 4 + 3] = 0.0f;
+	}
+	for (int r = 0; r < 3; r++) {
+		out[12 + r] += a[12 + r];
+	}
+	out[15] = 1.0f;
+#endif
+}
+
+void mat4_trs(const float pos[3], const float rot[4], const float scale[3], float out[16]) {
+	float x = rot[0], y = rot[1], z = rot[2], w = rot[3];
+	float xx = x * x, yy = y * y, zz = z * z;
+	float xy = x * y, xz = x * z, yz = y * z;
+	float wx = w * x, wy = w * y, wz = w * z;
+
+	out[0] = (1.0f - 2.0f * (yy + zz)) * scale[0];
+	out[1] = 2.0f * (xy + wz) * scale[0];
+	out[2] = 2.0f * (xz - wy) * scale[0];
+	out[3] = 0.0f;
+	out[4] = 2.0f * (xy - wz) * scale[1];
+	out[5] = (1.0f - 2.0f * (xx + zz)) * scale[1];
+	out[6] = 2.0f * (yz + wx) * scale[1];
+	out[7] = 0.0f;
+	out[8] = 2.0f * (xz + wy) * scale[2];
+	out[9] = 2.0f * (yz - wx) * scale[2];
+	out[10] = (1.0f - 2.0f * (xx + yy)) * scale[2];
+	out[11] = 0.0f;
+	out[12] = pos[0];
+	out[13] = pos[1];
+	out[14] = pos[2];
+	out[15] = 1.0f;
+}
+
+void mat4_transform_point(const float m[16], const float p[3], float out[3]) {
+	float x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+	float y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+	float z = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+	out[0] = x;
+	out[1] = y;
+	out[2] = z;
+}
+
+// each new half extent is the old ones scaled by the absolute rotation/scale terms (Arvo)
+void mat4_transform_box(const float m[16], const float center[3], const float extent[3],
+	float outCenter[3], float outExtent[3]) {
+#ifdef MATH_HAS_SIMD4
+	f4 c0 = f4_load(m), c1 = f4_load(m + 4), c2 = f4_load(m + 8);
+	f4 c = f4_mul(c0, f4_set1(center[0]));
+	c = f4_add(c, f4_mul(c1, f4_set1(center[1])));
+	c = f4_add(c, f4_mul(c2, f4_set1(center[2])));
+	c = f4_add(c, f4_load(m + 12));
+	f4 e = f4_mul(f4_abs(c0), f4_set1(extent[0]));
+	e = f4_add(e, f4_mul(f4_abs(c1), f4_set1(extent[1])));
+	e = f4_add(e, f4_mul(f4_abs(c2), f4_set1(extent[2])));
+	float tc[4], te[4];
+	f4_store(tc, c);
+	f4_store(te, e);
+	memcpy(outCenter, tc, 3 * sizeof(float));
+	memcpy(outExtent, te, 3 * sizeof(float));
+#else
+	float c[3], e[3];
+	for (int r = 0; r < 3; r++) {
+		c[r] = m[r] * center[0] + m[4 + r] * center[1] + m[8 + r] * center[2] + m[12 + r];
+		e[r] = fabsf(m[r]) * extent[0] + fabsf(m[4 + r]) * extent[1] + fabsf(m[8 + r]) * extent[2];
+	}
+	memcpy(outCenter, c, sizeof(c));
+	memcpy(outExtent, e, sizeof(e));
+#endif
+}
+
+void mat4_perspective(float fovY, float aspect, float zNear, float zFar, float out[16]) {
+	float f = 1.0f / tanf(fovY * 0.5f);
+	memset(out, 0, 16 * sizeof(float));
+	out[0] = f / aspect;
+	out[5] = f;
+	out[10] = (zFar + zNear) / (zNear - zFar);
+	out[11] = -1.0f;
+	out[14] = 2.0f * zFar * zNear / (zNear - zFar);
+}
+
+bool math_cpu_has_avx2() {
+#if defined(MATH_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#elif defined(MATH_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	// the OS has to be saving the ymm registers too (OSXSAVE + XCR0 bits 1 and 2)
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return false;
+#endif
+}
+
+bool math_isa_supported(math_isa isa) {
+	static const bool avx2 = math_cpu_has_avx2();
+	switch (isa) {
+	case MATH_SCALAR:
+		return true;
+	case MATH_SIMD4:
+#ifdef MATH_HAS_SIMD4
+		return true;
+#else
+		return false;
+#endif
+	case MATH_AVX2:
+		return avx2;
+	}
+	return false;
+}
+
+math_isa math_best_isa() {
+	if (math_isa_supported(MATH_AVX2)) {
+		return MATH_AVX2;
+	}
+	if (math_isa_supported(MATH_SIMD4)) {
+		return MATH_SIMD4;
+	}
+	return MATH_SCALAR;
+}
+
+const char *math_isa_name(math_isa isa) {
+#ifdef MATH_NEON
+	const char *names[] = { "scalar", "neon", "avx2" };
+#else
+	const char *names[] = { "scalar", "sse", "avx2" };
+#endif
+	return names[isa];
+}
+
+// scalar kernels, also the tails of the SIMD ones
+
+static void transform_points_scalar(const float m[16], const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		float px = x[i], py = y[i], pz = z[i];
+		outX[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+		outY[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+		outZ[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+	}
+}
+
+static void compose_trs_scalar(const trs_stream &in, float *out, unsigned int begin, unsigned int end) {
+	for (unsigned int i = begin; i < end; i++) {
+		float pos[3] = { in.posX[i], in.posY[i], in.posZ[i] };
+		float rot[4] = { in.rotX[i], in.rotY[i], in.rotZ[i], in.rotW[i] };
+		float scale[3] = { in.scaleX[i], in.scaleY[i], in.scaleZ[i] };
+		mat4_trs(pos, rot, scale, out + i * 16);
+	}
+}
+
+#ifdef MATH_HAS_SIMD4
+
+// the point stream is already structure of arrays, so 4 points per step with no shuffling
+static unsigned int transform_points_simd4(const float m[16], const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, unsigned int count) {
+	f4 m0 = f4_set1(m[0]), m1 = f4_set1(m[1]), m2 = f4_set1(m[2]);
+	f4 m4 = f4_set1(m[4]), m5 = f4_set1(m[5]), m6 = f4_set1(m[6]);
+	f4 m8 = f4_set1(m[8]), m9 = f4_set1(m[9]), m10 = f4_set1(m[10]);
+	f4 m12 = f4_set1(m[12]), m13 = f4_set1(m[13]), m14 = f4_set1(m[14]);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		f4 px = f4_load(x + i), py = f4_load(y + i), pz = f4_load(z + i);
+		f4 ox = f4_add(f4_add(f4_add(f4_mul(m0, px), f4_mul(m4, py)), f4_mul(m8, pz)), m12);
+		f4 oy = f4_add(f4_add(f4_add(f4_mul(m1, px), f4_mul(m5, py)), f4_mul(m9, pz)), m13);
+		f4 oz = f4_add(f4_add(f4_add(f4_mul(m2, px), f4_mul(m6, py)), f4_mul(m10, pz)), m14);
+		f4_store(outX + i, ox);
+		f4_store(outY + i, oy);
+		f4_store(outZ + i, oz);
+	}
+	return i;
+}
+
+// 4 objects per step: the matrix elements come out as "element k of objects
+// 0..3", then a 4x4 transpose per column turns that into 4 objects' columns
+static unsigned int compose_trs_simd4(const trs_stream &in, float *out, unsigned int count) {
+	f4 one = f4_set1(1.0f), two = f4_set1(2.0f), zero = f4_set1(0.0f);
+
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		f4 x = f4_load(in.rotX + i), y = f4_load(in.rotY + i), z = f4_load(in.rotZ + i), w = f4_load(in.rotW + i);
+		f4 sx = f4_load(in.scaleX + i), sy = f4_load(in.scaleY + i), sz = f4_load(in.scaleZ + i);
+		f4 xx = f4_mul(x, x), yy = f4_mul(y, y), zz = f4_mul(z, z);
+		f4 xy = f4_mul(x, y), xz = f4_mul(x, z), yz = f4_mul(y, z);
+		f4 wx = f4_mul(w, x), wy = f4_mul(w, y), wz = f4_mul(w, z);
+
+		f4 c0[4] = {
+			f4_mul(f4_sub(one, f4_mul(two, f4_add(yy, zz))), sx),
+			f4_mul(f4_mul(two, f4_add(xy, wz)), sx),
+			f4_mul(f4_mul(two, f4_sub(xz, wy)), sx),
+			zero,
+		};
+		f4 c1[4] = {
+			f4_mul(f4_mul(two, f4_sub(xy, wz)), sy),
+			f4_mul(f4_sub(one, f4_mul(two, f4_add(xx, zz))), sy),
+			f4_mul(f4_mul(two, f4_add(yz, wx)), sy),
+			zero,
+		};
+		f4 c2[4] = {
+			f4_mul(f4_mul(two, f4_add(xz, wy)), sz),
+			f4_mul(f4_mul(two, f4_sub(yz, wx)), sz),
+			f4_mul(f4_sub(one, f4_mul(two, f4_add(xx, yy))), sz),
+			zero,
+		};
+		f4 c3[4] = { f4_load(in.posX + i), f4_load(in.posY + i), f4_load(in.posZ + i), one };
+
+		f4 *cols[4] = { c0, c1, c2, c3 };
+		for (int c = 0; c < 4; c++) {
+			f4 *v = cols[c];
+			f4_transpose(v[0], v[1], v[2], v[3]);
+			for (int k = 0; k < 4; k++) {
+				f4_store(out + (i + k) * 16 + c * 4, v[k]);
+			}
+		}
+	}
+	return i;
+}
+
+#endif
+
+#ifdef MATH_X86
+
+MATH_TARGET_AVX2
+static unsigned int transform_points_avx2(const float m[16], const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, unsigned int count) {
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+	__m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+	__m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+		__m256 ox = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, px), _mm256_mul_ps(m4, py)), _mm256_mul_ps(m8, pz)), m12);
+		__m256 oy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, px), _mm256_mul_ps(m5, py)), _mm256_mul_ps(m9, pz)), m13);
+		__m256 oz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, px), _mm256_mul_ps(m6, py)), _mm256_mul_ps(m10, pz)), m14);
+		_mm256_storeu_ps(outX + i, ox);
+		_mm256_storeu_ps(outY + i, oy);
+		_mm256_storeu_ps(outZ + i, oz);
+	}
+	return i;
+}
+
+// two output columns per register: a's columns go in both halves, and a
+// shuffle spreads b's column c into the low half and c + 1 into the high half
+MATH_TARGET_AVX2
+static void mul_mat4_avx2(const float *a, const float *b, float *out, unsigned int count) {
+	for (unsigned int i = 0; i < count; i++) {
+		const float *am = a + i * 16, *bm = b + i * 16;
+		__m256 a0 = _mm256_broadcast_ps((const __m128 *) am);
+		__m256 a1 = _mm256_broadcast_ps((const __m128 *) (am + 4));
+		__m256 a2 = _mm256_broadcast_ps((const __m128 *) (am + 8));
+		__m256 a3 = _mm256_broadcast_ps((const __m128 *) (am + 12));
+		for (int c = 0; c < 4; c += 2) {
+			__m256 bc = _mm256_loadu_ps(bm + c * 4);
+			__m256 col = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, 0x00));
+			col = _mm256_add_ps(col, _mm256_mul_ps(a1, _mm256_shuffle_ps(bc, bc, 0x55)));
+			col = _mm256_add_ps(col, _mm256_mul_ps(a2, _mm256_shuffle_ps(bc, bc, 0xaa)));
+			col = _mm256_add_ps(col, _mm256_mul_ps(a3, _mm256_shuffle_ps(bc, bc, 0xff)));
+			_mm256_storeu_ps(out + i * 16 + c * 4, col);
+		}
+	}
+}
+
+// 8 objects per step, each half goes through the same 4x4 transpose as the SSE version
+MATH_TARGET_AVX2
+static unsigned int compose_trs_avx2(const trs_stream &in, float *out, unsigned int count) {
+	__m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_loadu_ps(in.rotX + i), y = _mm256_loadu_ps(in.rotY + i);
+		__m256 z = _mm256_loadu_ps(in.rotZ + i), w = _mm256_loadu_ps(in.rotW + i);
+		__m256 sx = _mm256_loadu_ps(in.scaleX + i), sy = _mm256_loadu_ps(in.scaleY + i), sz = _mm256_loadu_ps(in.scaleZ + i);
+		__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+		__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+		__m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+		__m256 m[16] = {
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+			zero,
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+			zero,
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+			_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+			_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+			zero,
+			_mm256_loadu_ps(in.posX + i),
+			_mm256_loadu_ps(in.posY + i),
+			_mm256_loadu_ps(in.posZ + i),
+			one,
+		};
+
+		for (int c = 0; c < 4; c++) {
+			__m128 lo[4], hi[4];
+			for (int k = 0; k < 4; k++) {
+				lo[k] = _mm256_castps256_ps128(m[c * 4 + k]);
+				hi[k] = _mm256_extractf128_ps(m[c * 4 + k], 1);
+			}
+			_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+			_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+			for (int k = 0; k < 4; k++) {
+				_mm_storeu_ps(out + (i + k) * 16 + c * 4, lo[k]);
+				_mm_storeu_ps(out + (i + 4 + k) * 16 + c * 4, hi[k]);
+			}
+		}
+	}
+	return i;
+}
+
+#endif
+
+void math_transform_points(const float m[16], const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, unsigned int count, math_isa isa) {
+	unsigned int done = 0;
+#ifdef MATH_X86
+	if (isa == MATH_AVX2 && math_isa_supported(MATH_AVX2)) {
+		done = transform_points_avx2(m, x, y, z, outX, outY, outZ, count);
+	}
+#endif
+#ifdef MATH_HAS_SIMD4
+	if (isa != MATH_SCALAR && done == 0) {
+		done = transform_points_simd4(m, x, y, z, outX, outY, outZ, count);
+	}
+#endif
+	transform_points_scalar(m, x, y, z, outX, outY, outZ, done, count);
+}
+
+void math_mul_mat4(const float *a, const float *b, float *out, unsigned int count, math_isa isa) {
+#ifdef MATH_X86
+	if (isa == MATH_AVX2 && math_isa_supported(MATH_AVX2)) {
+		mul_mat4_avx2(a, b, out, count);
+		return;
+	}
+#endif
+#ifdef MATH_HAS_SIMD4
+	if (isa != MATH_SCALAR) {
+		for (unsigned int i = 0; i < count; i++) {
+			mul_mat4_simd4(a + i * 16, b + i * 16, out + i * 16);
+		}
+		return;
+	}
+#endif
+	for (unsigned int i = 0; i < count; i++) {
+		mul_mat4_scalar(a + i * 16, b + i * 16, out + i * 16);
+	}
+}
+
+void math_compose_trs(const trs_stream &in, float *out, unsigned int count, math_isa isa) {
+	unsigned int done = 0;
+#ifdef MATH_X86
+	if (isa == MATH_AVX2 && math_isa_supported(MATH_AVX2)) {
+		done = compose_trs_avx2(in, out, count);
+	}
+#endif
+#ifdef MATH_HAS_SIMD4
+	if (isa != MATH_SCALAR && done == 0) {
+		done = compose_trs_simd4(in, out, count);
+	}
+#endif
+	compose_trs_scalar(in, out, done, count);
+}
+
+static float max_difference(const std::vector<float> &a, const std::vector<float> &b) {
+	float worst = 0.0f;
+	for (size_t i = 0; i < a.size(); i++) {
+		float d = fabsf(a[i] - b[i]);
+		worst = d > worst ? d : worst;
+	}
+	return worst;
+}
+
+void math_bench() {
+	const unsigned int count = 1000000;
+	const int runs = 5;
+	unsigned int seed = 11;
+
+	printf("math: %u items per batch, best of %d, widest kernel here is %s\n", count, runs, math_isa_name(math_best_isa()));
+
+	std::vector<float> px(count), py(count), pz(count);
+	std::vector<float> rx(count), ry(count), rz(count), rw(count);
+	std::vector<float> sx(count), sy(count), sz(count);
+	for (unsigned int i = 0; i < count; i++) {
+		px[i] = bench_random_float(&seed) * 100.0f - 50.0f;
+		py[i] = bench_random_float(&seed) * 100.0f - 50.0f;
+		pz[i] = bench_random_float(&seed) * 100.0f - 50.0f;
+		float axis[3] = { bench_random_float(&seed) - 0.5f, bench_random_float(&seed) - 0.5f, bench_random_float(&seed) - 0.5f };
+		vec3_normalize(axis);
+		float q[4];
+		quat_from_axis_angle(axis, bench_random_float(&seed) * 6.28f, q);
+		rx[i] = q[0];
+		ry[i] = q[1];
+		rz[i] = q[2];
+		rw[i] = q[3];
+		sx[i] = sy[i] = sz[i] = 0.5f + bench_random_float(&seed);
+	}
+	trs_stream trs = { px.data(), py.data(), pz.data(), rx.data(), ry.data(), rz.data(), rw.data(),
+		sx.data(), sy.data(), sz.data() };
+
+	std::vector<float> a(count * 16), b(count * 16);
+	math_compose_trs(trs, a.data(), count, MATH_SCALAR);
+	for (size_t i = 0; i < b.size(); i++) {
+		b[i] = bench_random_float(&seed) - 0.5f;
+	}
+
+	float viewProj[16], view[16];
+	float camPos[3] = { 0.0f, 0.0f, -80.0f }, camRot[4], camScale[3] = { 1.0f, 1.0f, 1.0f };
+	quat_identity(camRot);
+	mat4_trs(camPos, camRot, camScale, view);
+	float proj[16];
+	mat4_perspective(1.0f, 16.0f / 9.0f, 0.1f, 500.0f, proj);
+	mat4_mul(proj, view, viewProj);
+
+	const char *names[] = { "transform points", "multiply mat4", "compose TRS" };
+	for (int kernel = 0; kernel < 3; kernel++) {
+		std::vector<float> reference, out;
+		double scalarMs = 0.0;
+		for (int isa = MATH_SCALAR; isa <= MATH_AVX2; isa++) {
+			if (!math_isa_supported((math_isa) isa)) {
+				printf("  %-17s %-6s not supported here\n", names[kernel], math_isa_name((math_isa) isa));
+				continue;
+			}
+			out.assign(kernel == 0 ? count * 3 : count * 16, 0.0f);
+			double best = 1e30;
+			for (int r = 0; r < runs; r++) {
+				double start = bench_now_ms();
+				if (kernel == 0) {
+					math_transform_points(view, px.data(), py.data(), pz.data(),
+						&out[0], &out[count], &out[count * 2], count, (math_isa) isa);
+				} else if (kernel == 1) {
+					math_mul_mat4(a.data(), b.data(), out.data(), count, (math_isa) isa);
+				} else {
+					math_compose_trs(trs, out.data(), count, (math_isa) isa);
+				}
+				double ms = bench_now_ms() - start;
+				best = ms < best ? ms : best;
+			}
+			if (isa == MATH_SCALAR) {
+				reference = out;
+				scalarMs = best;
+			}
+			printf("  %-17s %-6s %7.2f ms  %4.1fx  max difference from scalar %g\n", names[kernel],
+				math_isa_name((math_isa) isa), best, scalarMs / best, max_difference(reference, out));
+		}
+	}
+
+	// and the whole thing going through the single item calls, for comparison
+	std::vector<float> out(count * 16);
+	double start = bench_now_ms();
+	for (unsigned int i = 0; i < count; i++) {
+		float pos[3] = { px[i], py[i], pz[i] };
+		float rot[4] = { rx[i], ry[i], rz[i], rw[i] };
+		float scale[3] = { sx[i], sy[i], sz[i] };
+		float local[16];
+		mat4_trs(pos, rot, scale, local);
+		mat4_mul(viewProj, local, &out[i * 16]);
+	}
+	double singleMs = bench_now_ms() - start;
+
+	// batched the way the scene store does it: local matrices a cache sized
+	// block at a time, so they're still in L1 when they get multiplied
+	math_isa best = math_best_isa();
+	std::vector<float> mvp(count * 16);
+	float local[64 * 16];
+	start = bench_now_ms();
+	for (unsigned int block = 0; block < count; block += 64) {
+		unsigned int n = count - block < 64 ? count - block : 64;
+		trs_stream in = { &px[block], &py[block], &pz[block], &rx[block], &ry[block], &rz[block], &rw[block],
+			&sx[block], &sy[block], &sz[block] };
+		math_compose_trs(in, local, n, best);
+		for (unsigned int i = 0; i < n; i++) {
+			mat4_mul(viewProj, &local[i * 16], &mvp[(block + i) * 16]);
+		}
+	}
+	double batchMs = bench_now_ms() - start;
+	printf("  model-view-projection for every object: %.2f ms one at a time, %.2f ms batched (%s), difference %g\n",
+		singleMs, batchMs, math_isa_name(best), max_difference(out, mvp));
+}
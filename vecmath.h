@@ -0,0 +1,114 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <math.h>
+
+// the math layer. vectors and quaternions are plain float arrays (xyz, xyzw),
+// matrices are float[16] column major like GL wants them, so nothing here
+// needs converting before it goes into a uniform or a buffer.
+//
+// single item functions are for the odd camera / setup math. anything that
+// runs over thousands of objects should go through the batch functions at the
+// bottom, which take structure of arrays streams and run SSE (x86), NEON (ARM)
+// or AVX2 kernels, picked at runtime like cull.h does
+
+inline float vec3_dot(const float a[3], const float b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline void vec3_cross(const float a[3], const float b[3], float out[3]) {
+	float x = a[1] * b[2] - a[2] * b[1];
+	float y = a[2] * b[0] - a[0] * b[2];
+	float z = a[0] * b[1] - a[1] * b[0];
+	out[0] = x;
+	out[1] = y;
+	out[2] = z;
+}
+
+inline float vec3_length(const float v[3]) {
+	return sqrtf(vec3_dot(v, v));
+}
+
+// leaves zero length vectors alone
+inline void vec3_normalize(float v[3]) {
+	float len = vec3_length(v);
+	if (len > 0.0f) {
+		v[0] /= len;
+		v[1] /= len;
+		v[2] /= len;
+	}
+}
+
+inline void quat_identity(float q[4]) {
+	q[0] = q[1] = q[2] = 0.0f;
+	q[3] = 1.0f;
+}
+
+// axis has to be unit length, angle in radians
+inline void quat_from_axis_angle(const float axis[3], float angle, float q[4]) {
+	float s = sinf(angle * 0.5f);
+	q[0] = axis[0] * s;
+	q[1] = axis[1] * s;
+	q[2] = axis[2] * s;
+	q[3] = cosf(angle * 0.5f);
+}
+
+// rotation b followed by rotation a
+void quat_mul(const float a[4], const float b[4], float out[4]);
+void quat_normalize(float q[4]);
+void quat_rotate(const float q[4], const float v[3], float out[3]);
+
+void mat4_identity(float out[16]);
+
+// out = a * b, out can't be a or b
+void mat4_mul(const float a[16], const float b[16], float out[16]);
+
+// same but both have to be affine (bottom row 0 0 0 1), which skips a row
+void mat4_mul_affine(const float a[16], const float b[16], float out[16]);
+
+// translation * rotation * scale
+void mat4_trs(const float pos[3], const float rot[4], const float scale[3], float out[16]);
+
+void mat4_transform_point(const float m[16], const float p[3], float out[3]);
+
+// box (center + half extents) through an affine matrix, the result is the
+// box around the transformed box
+void mat4_transform_box(const float m[16], const float center[3], const float extent[3],
+	float outCenter[3], float outExtent[3]);
+
+// GL style projection, clip z in [-w, w]
+void mat4_perspective(float fovY, float aspect, float zNear, float zFar, float out[16]);
+
+enum math_isa {
+	MATH_SCALAR,
+	MATH_SIMD4, // SSE on x86, NEON on ARM
+	MATH_AVX2,
+};
+
+// also used by cull.cpp, checked once
+bool math_cpu_has_avx2();
+
+math_isa math_best_isa();
+bool math_isa_supported(math_isa isa);
+const char *math_isa_name(math_isa isa);
+
+// translation, rotation and scale of count objects, one array per component
+struct trs_stream {
+	const float *posX, *posY, *posZ;
+	const float *rotX, *rotY, *rotZ, *rotW;
+	const float *scaleX, *scaleY, *scaleZ;
+};
+
+// out = m * (x, y, z, 1) for every point, m affine. in and out can be the same arrays
+void math_transform_points(const float m[16], const float *x, const float *y, const float *z,
+	float *outX, float *outY, float *outZ, unsigned int count, math_isa isa);
+
+// out[i] = a[i] * b[i], 16 floats per matrix
+void math_mul_mat4(const float *a, const float *b, float *out, unsigned int count, math_isa isa);
+
+// one mat4_trs per object into out, 16 floats each
+void math_compose_trs(const trs_stream &in, float *out, unsigned int count, math_isa isa);
+
+void math_bench();
+
+#endif